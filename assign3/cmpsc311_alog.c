@@ -0,0 +1,314 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : cmpsc311_alog.c
+//  Description   : This is the asynchronous mode of the CMPSC311 logging
+//                  service.  Callers claim a ring slot with a compare and
+//                  swap and render their message into it; the single writer
+//                  thread drains the ring in claim order and logs each
+//                  message through the public logging calls.
+//
+//   Author :
+//   Last Modified :
+//
+
+// Include Files
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sched.h>
+#include <dlfcn.h>
+#include <pthread.h>
+
+// Project Include Files
+#include <cmpsc311_alog.h>
+#include <cmpsc311_log.h>
+
+// Defines
+#define ASYNC_LOG_RING_MASK ( ASYNC_LOG_RING_SLOTS - 1 )
+#define ASYNC_LOG_IDLE_NSECS 10000000 // Writer re-checks an idle ring this often
+
+//
+// Type Definitions
+
+// A queued log entry, the message already rendered
+typedef struct {
+  atomic_size_t seq;                 // Ticket the slot is ready for
+  unsigned long lvl;                 // Levels of the entry
+  char msg[MAX_LOG_MESSAGE_SIZE];    // The rendered message
+} ASYNC_LOG_ENTRY;
+
+// Functional Prototypes
+void * async_log_writer( void *unused );
+void async_log_exit( void );
+void async_log_resolve( void );
+
+//
+// Global data
+static ASYNC_LOG_ENTRY ring[ASYNC_LOG_RING_SLOTS];
+static atomic_size_t ring_head;         // Next ticket to claim
+static size_t ring_tail;                // Next ticket to write (writer only)
+static atomic_size_t ring_written;      // Tickets written to the log
+static atomic_bool async_on = false;
+static atomic_bool writer_idle = false;
+static bool writer_stopping = false;
+static __thread bool writer_thread = false; // Is this the writer, logging for real?
+static pthread_t writer;
+static pthread_mutex_t writer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writer_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t writer_done = PTHREAD_COND_INITIALIZER;
+static pthread_once_t resolve_once = PTHREAD_ONCE_INIT;
+static int (*library_vlogMessage)( unsigned long, const char *, va_list );
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : enableAsyncLog
+// Description  : Start the background writer, log calls are queued from now
+//                on.  The log is flushed when the program exits.  Without
+//                the library vlogMessage to write through, logging stays
+//                synchronous.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int enableAsyncLog( void ) {
+  static bool registered = false;
+  size_t i;
+
+  if ( atomic_load( &async_on ) ) {
+    return( 0 );
+  }
+  pthread_once( &resolve_once, async_log_resolve );
+  if ( library_vlogMessage == NULL ) {
+    return( -1 );
+  }
+
+  for ( i = 0; i < ASYNC_LOG_RING_SLOTS; i++ ) {
+    atomic_store( &ring[i].seq, i );
+  }
+  atomic_store( &ring_head, 0 );
+  atomic_store( &ring_written, 0 );
+  ring_tail = 0;
+  writer_stopping = false;
+
+  if ( pthread_create( &writer, NULL, async_log_writer, NULL ) ) {
+    return( -1 );
+  }
+  if ( !registered ) {
+    atexit( async_log_exit );
+    registered = true;
+  }
+  atomic_store( &async_on, true );
+
+  return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : flushAsyncLog
+// Description  : Wait until every entry queued before the call is written
+//
+// Inputs       : none
+// Outputs      : 0 (always successful)
+
+int flushAsyncLog( void ) {
+  size_t target;
+
+  if ( !atomic_load( &async_on ) ) {
+    return( 0 );
+  }
+
+  target = atomic_load( &ring_head );
+  pthread_mutex_lock( &writer_lock );
+  pthread_cond_signal( &writer_wake );
+  while ( atomic_load( &ring_written ) < target ) {
+    pthread_cond_wait( &writer_done, &writer_lock );
+  }
+  pthread_mutex_unlock( &writer_lock );
+
+  return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : disableAsyncLog
+// Description  : Flush the log, stop the writer and go back to synchronous
+//                logging
+//
+// Inputs       : none
+// Outputs      : none
+
+void disableAsyncLog( void ) {
+  if ( !atomic_load( &async_on ) ) {
+    return;
+  }
+
+  flushAsyncLog();
+  atomic_store( &async_on, false );
+
+  pthread_mutex_lock( &writer_lock );
+  writer_stopping = true;
+  pthread_cond_signal( &writer_wake );
+  pthread_mutex_unlock( &writer_lock );
+  pthread_join( writer, NULL );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : vlogMessage
+// Description  : Log a message.  In asynchronous mode the message is rendered
+//                into the next ring slot and left for the writer, otherwise
+//                (and for the writer itself) the library version is
+//                called.  Should the library have none, the message goes
+//                to stderr rather than being lost.
+//
+// Inputs       : lvl - the levels of the message
+//                fmt - the printf-style format
+//                args - the format arguments
+// Outputs      : the length of the queued message (asynchronous), or what
+//                the library returns
+
+int vlogMessage( unsigned long lvl, const char *fmt, va_list args ) {
+  ASYNC_LOG_ENTRY *entry;
+  size_t pos, seq;
+  int len;
+
+  if ( !atomic_load( &async_on ) || writer_thread ) {
+    pthread_once( &resolve_once, async_log_resolve );
+    if ( library_vlogMessage == NULL ) {
+      return( vfprintf( stderr, fmt, args ) );
+    }
+    return( library_vlogMessage( lvl, fmt, args ) );
+  }
+  if ( !levelEnabled( lvl ) ) {
+    return( 0 );
+  }
+
+  // Claim the next ticket once its slot has been written out
+  pos = atomic_load( &ring_head );
+  while ( true ) {
+    entry = &ring[pos & ASYNC_LOG_RING_MASK];
+    seq = atomic_load_explicit( &entry->seq, memory_order_acquire );
+    if ( seq == pos ) {
+      if ( atomic_compare_exchange_weak( &ring_head, &pos, pos + 1 ) ) {
+        break;
+      }
+    }
+    else if ( seq < pos ) {
+      // Ring is full, let the writer catch up
+      sched_yield();
+      pos = atomic_load( &ring_head );
+    }
+    else {
+      pos = atomic_load( &ring_head );
+    }
+  }
+
+  entry->lvl = lvl;
+  len = vsnprintf( entry->msg, MAX_LOG_MESSAGE_SIZE, fmt, args );
+  atomic_store( &entry->seq, pos + 1 );
+
+  if ( atomic_load( &writer_idle ) ) {
+    pthread_mutex_lock( &writer_lock );
+    pthread_cond_signal( &writer_wake );
+    pthread_mutex_unlock( &writer_lock );
+  }
+
+  return( len );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : async_log_writer
+// Description  : The writer thread, takes queued entries in ticket order and
+//                logs each through logMessage, which reaches the library
+//                as this thread's calls are not queued
+//
+// Inputs       : unused - thread argument
+// Outputs      : NULL
+
+void * async_log_writer( void *unused ) {
+  char msg[MAX_LOG_MESSAGE_SIZE];
+  ASYNC_LOG_ENTRY *entry;
+  struct timespec deadline;
+  unsigned long lvl;
+  size_t count = 0;
+
+  writer_thread = true;
+  while ( true ) {
+    entry = &ring[ring_tail & ASYNC_LOG_RING_MASK];
+    if ( atomic_load_explicit( &entry->seq, memory_order_acquire ) == ring_tail + 1 ) {
+      lvl = entry->lvl;
+      memcpy( msg, entry->msg, MAX_LOG_MESSAGE_SIZE );
+      atomic_store_explicit( &entry->seq, ring_tail + ASYNC_LOG_RING_SLOTS, memory_order_release );
+      ring_tail++;
+
+      logMessage( lvl, "%s", msg );
+      count++;
+      continue;
+    }
+
+    // Caught up, tell anyone flushing
+    if ( count > 0 ) {
+      pthread_mutex_lock( &writer_lock );
+      atomic_fetch_add( &ring_written, count );
+      pthread_cond_broadcast( &writer_done );
+      pthread_mutex_unlock( &writer_lock );
+      count = 0;
+      continue;
+    }
+
+    // Nothing queued, sleep until a caller wakes us (or we stop)
+    pthread_mutex_lock( &writer_lock );
+    if ( writer_stopping && ( atomic_load( &ring_head ) == ring_tail ) ) {
+      pthread_mutex_unlock( &writer_lock );
+      break;
+    }
+    atomic_store( &writer_idle, true );
+    if ( atomic_load( &entry->seq ) != ring_tail + 1 ) {
+      clock_gettime( CLOCK_REALTIME, &deadline );
+      deadline.tv_nsec += ASYNC_LOG_IDLE_NSECS;
+      if ( deadline.tv_nsec >= 1000000000 ) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+      }
+      pthread_cond_timedwait( &writer_wake, &writer_lock, &deadline );
+    }
+    atomic_store( &writer_idle, false );
+    pthread_mutex_unlock( &writer_lock );
+  }
+
+  return( NULL );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : async_log_exit
+// Description  : Write out anything still queued when the program exits
+//
+// Inputs       : none
+// Outputs      : none
+
+void async_log_exit( void ) {
+  disableAsyncLog();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : async_log_resolve
+// Description  : Find the library version of vlogMessage, which this
+//                module stands in front of (NULL if there is none)
+//
+// Inputs       : none
+// Outputs      : none
+
+void async_log_resolve( void ) {
+  library_vlogMessage = (int (*)( unsigned long, const char *, va_list ))dlsym( RTLD_NEXT, "vlogMessage" );
+}
@@ -0,0 +1,40 @@
+#ifndef CMPSC311_ALOG_INCLUDED
+#define CMPSC311_ALOG_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : cmpsc311_alog.h
+//  Description   : This is the asynchronous mode of the CMPSC311 logging
+//                  service.  Once enabled, logMessage/vlogMessage calls
+//                  (including those made inside the libraries) only render
+//                  the message into a lock-free ring buffer; a background
+//                  thread logs the entries through logMessage, so the
+//                  log contents are the same as in the synchronous mode
+//                  (timestamps are taken as each entry is written).
+//
+//   Note: this module provides vlogMessage itself, in front of the library
+//         version, so it must be linked into the program.  It uses no
+//         library internals beyond the interface in cmpsc311_log.h.
+//
+
+// Include files
+#include <stdarg.h>
+
+//
+// Library Constants
+
+#define ASYNC_LOG_RING_SLOTS	1024	// Entries the ring holds (power of 2)
+
+//
+// Interface
+
+int enableAsyncLog( void );
+	// Start the background writer, log calls are queued from now on (-1 leaves it synchronous)
+
+int flushAsyncLog( void );
+	// Wait until every queued entry has been written
+
+void disableAsyncLog( void );
+	// Flush the log, stop the writer and go back to synchronous logging
+
+#endif
@@ -0,0 +1,660 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : smsa.c
+//  Description   : This is a source implementation of the SMSA disk array
+//                  (a stand-in for libsmsa.so).  It takes the same encoded
+//                  operations, logs the same messages and uses the same
+//                  smsa_data.dat format.  The array is one anonymous mapping,
+//                  made at the first mount and kept until the process exits,
+//                  so mounting costs nothing and the contents survive an
+//                  unmount.  Like the library, mount and unmount do not touch
+//                  smsa_data.dat.  SMSALoadArray maps the file privately over
+//                  the array (the pages are read as they are touched) and
+//                  from then on the array stays attached to it:
+//                  SMSAStoreArray and every unmount write back only the pages
+//                  written since the last write back.
+//
+//   Author :
+//   Last Modified :
+//
+
+// Include Files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+// Project Includes
+#include <smsa.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+// Defines
+#define SMSA_PAGE_SIZE 4096 // Granularity of the written page tracking
+#define SMSA_ARRAY_PAGES (MAX_SMSA_VIRTUAL_ADDRESS/SMSA_PAGE_SIZE)
+
+//
+// Type definitions
+
+// A decoded disk operation
+typedef struct {
+	SMSA_DISK_COMMAND opcode;	// The operation to perform
+	SMSA_DRUM_ID drum;			// The drum field
+	SMSA_BLOCK_ID block;		// The block field
+	uint16_t len;				// Bytes in the block buffer (0 if none)
+	unsigned char *buf;			// The block buffer
+} SMSA_OPERATION;
+
+//
+// Global Data
+SMSA_ERROR_LEVEL smsa_error_number = SMSA_NO_ERROR;
+
+// The operation names, as the library logs them
+static const char *smsa_op_text[SMSA_MAX_COMMAND] = {
+	"SMSA_MOUNT", "SMSA_UNMOUNT", "SMSA_SEEK_DRUM", "SMSA_SEEK_BLOCK",
+	"SMSA_DISK_READ", "SMSA_DISK_WRITE", "SMSA_GET_STATE", "SMSA_BLOCK_SIGN",
+	"SMSA_FORMAT_DRUM" };
+
+// The error names, the last is for values out of range
+static const char *smsa_error_text[SMSA_MAX_ERRNO+1] = {
+	"SMSA_NO_ERROR", "SMSA_UNMOUNTED_DISK", "SMSA_ILLEGAL_DRUM",
+	"SMSA_DISK_CACHELOAD_FAIL", "SMSA_DISK_CACHEWRITE_FAIL", "SMSA_BAD_OPCODE",
+	"SMSA_BAD_DRUM_ID", "SMSA_BAD_BLOCK_ID", "SMSA_BAD_READ", "SMSA_BAD_WRITE",
+	"SMSA_SIG_FAIL", "UNKNOW ERROR" };
+
+static unsigned char *smsa_array = NULL;		// The drums, one after the other
+static bool smsa_mount_state = false;			// Is the array mounted?
+static bool smsa_attached = false;				// Is the array mapped from the file?
+static bool smsa_dirty[SMSA_ARRAY_PAGES];		// Pages written since the last write back
+static SMSA_DRUM_ID smsa_drum_head = 0;			// Drum the head is on
+static uint32_t smsa_read_head = 0;				// Block the next read/write touches
+
+//
+// Functional Prototypes
+
+int decode_SMSA_operation( SMSA_OPERATION *op, uint32_t code, unsigned char *block );
+uint32_t encode_SMSA_operation( SMSA_DISK_COMMAND opcode, SMSA_DRUM_ID drum, SMSA_BLOCK_ID block );
+int SMSAMountArray( void );
+int SMSAUnmountArray( void );
+int SMSASeekDrum( SMSA_DRUM_ID drum );
+int SMSASeekBlock( SMSA_BLOCK_ID block );
+int SMSAReadBlock( unsigned char *block );
+int SMSAWriteBlock( unsigned char *block );
+int SMSAFormatDrum( void );
+int SMSAStoreArray( void );
+int SMSALoadArray( void );
+unsigned char * block_address( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block );
+int map_array( void );
+void mark_dirty( uint32_t addr, uint32_t len );
+int write_back( int fd, SMSA_DRUM_ID drum );
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_operation
+// Description  : Decode and perform a disk array operation
+//
+// Inputs       : op - the encoded operation
+//                block - the block buffer for reads and writes
+// Outputs      : 0 if successful, -1 if failure
+
+int smsa_operation( uint32_t op, unsigned char *block ) {
+
+	// Local variables
+	SMSA_OPERATION dop;
+	int ret = 0;
+
+	if ( decode_SMSA_operation(&dop, op, block) ) {
+		logMessage( LOG_ERROR_LEVEL, "Unable to decode SMSA operation [%u]", op );
+		return( -1 );
+	}
+	logMessage( LOG_INFO_LEVEL, "SMSA Array received operation [%s/did=%d,blk=%d]",
+		smsa_op_text[dop.opcode], dop.drum, dop.block );
+
+	switch ( dop.opcode ) {
+	case SMSA_MOUNT:
+		ret = SMSAMountArray();
+		break;
+
+	case SMSA_UNMOUNT:
+		ret = SMSAUnmountArray();
+		break;
+
+	case SMSA_SEEK_DRUM:
+		ret = SMSASeekDrum( dop.drum );
+		break;
+
+	case SMSA_SEEK_BLOCK:
+		ret = SMSASeekBlock( dop.block );
+		break;
+
+	case SMSA_DISK_READ:
+		ret = SMSAReadBlock( block );
+		break;
+
+	case SMSA_DISK_WRITE:
+		ret = SMSAWriteBlock( block );
+		break;
+
+	case SMSA_GET_STATE:
+		logMessage( LOG_ERROR_LEVEL, "Get state UNIMPLEMENTED, ignoring" );
+		ret = 0;
+		break;
+
+	case SMSA_FORMAT_DRUM:
+		ret = SMSAFormatDrum();
+		break;
+
+	case SMSA_BLOCK_SIGN:
+		ret = SMSABlockSign( dop.drum, dop.block );
+		break;
+
+	default:
+		logMessage( LOG_ERROR_LEVEL, "OP Illegal disk command [%u]", dop.opcode );
+		ret = -1;
+		break;
+	}
+
+	return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_error_string
+// Description  : Get the name of an SMSA error
+//
+// Inputs       : eno - the error number
+// Outputs      : the constant name string
+
+const char * smsa_error_string( int eno ) {
+	if ( (eno < 0) || (eno >= SMSA_MAX_ERRNO) ) {
+		return( smsa_error_text[SMSA_MAX_ERRNO] );
+	}
+	return( smsa_error_text[eno] );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : SMSABlockSign
+// Description  : Log the signature of a block
+//
+// Inputs       : drum - the drum of the block
+//                block - the block in the drum
+// Outputs      : 0 if successful, -1 if failure
+
+int SMSABlockSign( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block ) {
+
+	// Local variables
+	unsigned char sig[CMPSC311_HASH_LENGTH], sigstr[CMPSC311_HASH_LENGTH*4];
+	uint32_t slen = CMPSC311_HASH_LENGTH;
+
+	if ( (drum >= SMSA_DISK_ARRAY_SIZE) || (block >= SMSA_MAX_BLOCK_ID) ) {
+		logMessage( LOG_ERROR_LEVEL, "Illegal signature drum [%u/%u]", smsa_drum_head, smsa_read_head );
+		smsa_error_number = SMSA_BAD_DRUM_ID;
+		return( -1 );
+	}
+
+	if ( map_array() || generate_md5_signature(block_address(drum, block), SMSA_BLOCK_SIZE, sig, &slen) ) {
+		logMessage( LOG_ERROR_LEVEL, "Signature failed (%d/%d]", drum, block );
+		smsa_error_number = SMSA_SIG_FAIL;
+		return( -1 );
+	}
+
+	bufToString( sig, slen, sigstr, CMPSC311_HASH_LENGTH*4 );
+	logMessage( LOG_OUTPUT_LEVEL, "SIG(drum,block) %2d %3d : %s", drum, block, sigstr );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : SMSAMountArray
+// Description  : Mount the disk array, creating it on the first mount
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int SMSAMountArray( void ) {
+	if ( smsa_mount_state ) {
+		logMessage( LOG_INFO_LEVEL, "Trying to mount already mounted disk array, ignoring." );
+		return( 0 );
+	}
+
+	logMessage( LOG_INFO_LEVEL, "Mounting the disk array ..." );
+	if ( map_array() ) {
+		return( -1 );
+	}
+	smsa_drum_head = 0;
+	smsa_read_head = 0;
+	logMessage( LOG_INFO_LEVEL, "Mounted the disk array successfully." );
+	smsa_mount_state = true;
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : SMSAUnmountArray
+// Description  : Unmount the disk array, writing back the pages written
+//                since the last write back if it is attached to the file
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int SMSAUnmountArray( void ) {
+
+	// Local variables
+	int fd, drum, ret = 0;
+
+	if ( ! smsa_mount_state ) {
+		logMessage( LOG_INFO_LEVEL, "Trying to unmount unmounted disk array, ignoring." );
+		return( 0 );
+	}
+
+	logMessage( LOG_INFO_LEVEL, "Unmounting the disk array ..." );
+	if ( smsa_attached ) {
+		if ( (fd = open(SMSA_DISK_FILE, O_WRONLY)) == -1 ) {
+			logMessage( LOG_ERROR_LEVEL, "Failure opening array data for store [%s], error=[%s]",
+				SMSA_DISK_FILE, strerror(errno) );
+			smsa_error_number = SMSA_DISK_CACHEWRITE_FAIL;
+			ret = -1;
+		}
+		for ( drum=0; (ret == 0) && (drum<SMSA_DISK_ARRAY_SIZE); drum++ ) {
+			ret = write_back( fd, drum );
+		}
+		if ( fd != -1 ) {
+			close( fd );
+		}
+	}
+
+	smsa_drum_head = 0;
+	smsa_read_head = 0;
+	smsa_mount_state = false;
+	return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : SMSASeekDrum
+// Description  : Move the head to the start of a drum
+//
+// Inputs       : drum - the drum to seek to
+// Outputs      : 0 if successful, -1 if failure
+
+int SMSASeekDrum( SMSA_DRUM_ID drum ) {
+	if ( ! smsa_mount_state ) {
+		logMessage( LOG_ERROR_LEVEL, "Trying to seek on unmounted array." );
+		smsa_error_number = SMSA_UNMOUNTED_DISK;
+		return( -1 );
+	}
+
+	logMessage( LOG_INFO_LEVEL, "Seeking new drum [%u]", drum );
+	if ( drum >= SMSA_DISK_ARRAY_SIZE ) {
+		logMessage( LOG_ERROR_LEVEL, "Seek illegal drum id [%u]", drum );
+		smsa_error_number = SMSA_BAD_DRUM_ID;
+		return( -1 );
+	}
+
+	smsa_drum_head = drum;
+	smsa_read_head = 0;
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : SMSASeekBlock
+// Description  : Move the head to a block on the current drum
+//
+// Inputs       : block - the block to seek to
+// Outputs      : 0 if successful, -1 if failure
+
+int SMSASeekBlock( SMSA_BLOCK_ID block ) {
+	if ( ! smsa_mount_state ) {
+		logMessage( LOG_ERROR_LEVEL, "Trying to seek on unmounted array." );
+		smsa_error_number = SMSA_UNMOUNTED_DISK;
+		return( -1 );
+	}
+
+	logMessage( LOG_INFO_LEVEL, "Seeking new block [%u] on current disk [%d]", block, smsa_drum_head );
+	if ( block >= SMSA_MAX_BLOCK_ID ) {
+		logMessage( LOG_ERROR_LEVEL, "Seek illegal block id [%u]", block );
+		smsa_error_number = SMSA_BAD_BLOCK_ID;
+		return( -1 );
+	}
+
+	smsa_read_head = block;
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : SMSAReadBlock
+// Description  : Read the block under the head and move to the next one
+//
+// Inputs       : block - the SMSA_BLOCK_SIZE buffer to read into
+// Outputs      : 0 if successful, -1 if failure
+
+int SMSAReadBlock( unsigned char *block ) {
+	logMessage( LOG_INFO_LEVEL, "Reading drum/block [%u/%u]", smsa_drum_head, smsa_read_head );
+	assert( smsa_drum_head < SMSA_DISK_ARRAY_SIZE );
+	assert( smsa_read_head < SMSA_MAX_BLOCK_ID );
+
+	if ( ! smsa_mount_state ) {
+		logMessage( LOG_ERROR_LEVEL, "Trying to read on unmounted array." );
+		smsa_error_number = SMSA_UNMOUNTED_DISK;
+		return( -1 );
+	}
+
+	memcpy( block, block_address(smsa_drum_head, smsa_read_head), SMSA_BLOCK_SIZE );
+	smsa_read_head++;
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : SMSAWriteBlock
+// Description  : Write the block under the head and move to the next one
+//
+// Inputs       : block - the SMSA_BLOCK_SIZE buffer to write
+// Outputs      : 0 if successful, -1 if failure
+
+int SMSAWriteBlock( unsigned char *block ) {
+	logMessage( LOG_INFO_LEVEL, "Write drum/block [%u/%u]", smsa_drum_head, smsa_read_head );
+	assert( smsa_drum_head < SMSA_DISK_ARRAY_SIZE );
+	assert( smsa_read_head < SMSA_MAX_BLOCK_ID );
+
+	if ( ! smsa_mount_state ) {
+		logMessage( LOG_ERROR_LEVEL, "Trying to write on unmounted array." );
+		smsa_error_number = SMSA_UNMOUNTED_DISK;
+		return( -1 );
+	}
+
+	memcpy( block_address(smsa_drum_head, smsa_read_head), block, SMSA_BLOCK_SIZE );
+	mark_dirty( smsa_drum_head*SMSA_DISK_SIZE + smsa_read_head*SMSA_BLOCK_SIZE, SMSA_BLOCK_SIZE );
+	smsa_read_head++;
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : SMSAFormatDrum
+// Description  : Zero the drum under the head.  As in the library, the head
+//                goes back to drum 0 afterwards.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int SMSAFormatDrum( void ) {
+	logMessage( LOG_INFO_LEVEL, "Formatting drum [%u] ...", smsa_drum_head );
+	if ( ! smsa_mount_state ) {
+		smsa_error_number = SMSA_UNMOUNTED_DISK;
+		return( -1 );
+	}
+	if ( smsa_drum_head >= SMSA_DISK_ARRAY_SIZE ) {
+		smsa_error_number = SMSA_ILLEGAL_DRUM;
+		return( -1 );
+	}
+
+	memset( block_address(smsa_drum_head, 0), 0x0, SMSA_DISK_SIZE );
+	mark_dirty( smsa_drum_head*SMSA_DISK_SIZE, SMSA_DISK_SIZE );
+	smsa_drum_head = 0;
+	smsa_read_head = 0;
+	logMessage( LOG_INFO_LEVEL, "Formatting drum [%u] completed successfully.", smsa_drum_head );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : SMSAStoreArray
+// Description  : Save the array to smsa_data.dat.  An array attached to the
+//                file only writes the pages written since the last write
+//                back, otherwise the whole array is written.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int SMSAStoreArray( void ) {
+
+	// Local variables
+	int fd, drum;
+
+	logMessage( LOG_INFO_LEVEL, "Storing the disk array contents ..." );
+	if ( (fd = open(SMSA_DISK_FILE, smsa_attached ? O_WRONLY : O_WRONLY|O_CREAT|O_TRUNC, S_IRWXU)) == -1 ) {
+		logMessage( LOG_ERROR_LEVEL, "Failure opening array data for store [%s], error=[%s]",
+			SMSA_DISK_FILE, strerror(errno) );
+		smsa_error_number = SMSA_DISK_CACHEWRITE_FAIL;
+		return( -1 );
+	}
+	if ( map_array() ) {
+		close( fd );
+		return( -1 );
+	}
+	if ( ! smsa_attached ) {
+		mark_dirty( 0, MAX_SMSA_VIRTUAL_ADDRESS );
+	}
+
+	for ( drum=0; drum<SMSA_DISK_ARRAY_SIZE; drum++ ) {
+		if ( write_back(fd, drum) ) {
+			close( fd );
+			return( -1 );
+		}
+		logMessage( LOG_INFO_LEVEL, "Wrote disk (%d) contents successfully", drum );
+	}
+
+	close( fd );
+	logMessage( LOG_INFO_LEVEL, "Stored the disk array contents successfully." );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : SMSALoadArray
+// Description  : Attach the array to smsa_data.dat.  The file is mapped
+//                privately over the array, so its pages are only read as
+//                they are touched and writes reach it only on write back.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int SMSALoadArray( void ) {
+
+	// Local variables
+	struct stat st;
+	int fd, drum;
+
+	logMessage( LOG_INFO_LEVEL, "Loading the disk array contents ..." );
+	if ( (fd = open(SMSA_DISK_FILE, O_RDONLY)) == -1 ) {
+		logMessage( LOG_ERROR_LEVEL, "Failure opening array data for load [%s], error=[%s]",
+			SMSA_DISK_FILE, strerror(errno) );
+		smsa_error_number = SMSA_DISK_CACHELOAD_FAIL;
+		return( -1 );
+	}
+	if ( fstat(fd, &st) || (st.st_size < MAX_SMSA_VIRTUAL_ADDRESS) ) {
+		logMessage( LOG_ERROR_LEVEL, "Failure reading array data [%s], error=[%s]",
+			SMSA_DISK_FILE, strerror(errno ? errno : EIO) );
+		smsa_error_number = SMSA_DISK_CACHELOAD_FAIL;
+		close( fd );
+		return( -1 );
+	}
+	if ( map_array() || (mmap(smsa_array, MAX_SMSA_VIRTUAL_ADDRESS, PROT_READ|PROT_WRITE,
+			MAP_PRIVATE|MAP_FIXED, fd, 0) == MAP_FAILED) ) {
+		logMessage( LOG_ERROR_LEVEL, "Failure reading array data [%s], error=[%s]",
+			SMSA_DISK_FILE, strerror(errno) );
+		smsa_error_number = SMSA_DISK_CACHELOAD_FAIL;
+		close( fd );
+		return( -1 );
+	}
+	close( fd );
+
+	memset( smsa_dirty, 0x0, sizeof(smsa_dirty) );
+	smsa_attached = true;
+	for ( drum=0; drum<SMSA_DISK_ARRAY_SIZE; drum++ ) {
+		logMessage( LOG_INFO_LEVEL, "Loaded disk (%d) contents successfully", drum );
+	}
+	logMessage( LOG_INFO_LEVEL, "Loaded the disk array contents successfully." );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : decode_SMSA_operation
+// Description  : Split an encoded operation into its fields
+//
+// Inputs       : op - the place to put the fields
+//                code - the encoded operation
+//                block - the block buffer passed with it
+// Outputs      : 0 if successful, -1 if failure
+
+int decode_SMSA_operation( SMSA_OPERATION *op, uint32_t code, unsigned char *block ) {
+	op->opcode = code >> 26;
+	op->drum = (code >> 22) & 0xf;
+	op->block = code & 0xff;
+
+	if ( op->opcode >= SMSA_MAX_COMMAND ) {
+		logMessage( LOG_ERROR_LEVEL, "Decoded operation illegal [%u->%u]", code, op->opcode );
+		smsa_error_number = SMSA_BAD_OPCODE;
+		return( -1 );
+	}
+	if ( op->drum >= SMSA_DISK_ARRAY_SIZE ) {
+		logMessage( LOG_ERROR_LEVEL, "Decoded drum id illegal [%u->%u]", code, op->drum );
+		smsa_error_number = SMSA_BAD_DRUM_ID;
+		return( -1 );
+	}
+	if ( op->block >= SMSA_MAX_BLOCK_ID ) {
+		logMessage( LOG_ERROR_LEVEL, "Decoded block id illegal [%u->%u]", code, op->block );
+		smsa_error_number = SMSA_BAD_BLOCK_ID;
+		return( -1 );
+	}
+
+	op->len = ( block != NULL ) ? SMSA_BLOCK_SIZE : 0;
+	op->buf = block;
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : encode_SMSA_operation
+// Description  : Pack the fields of an operation
+//
+// Inputs       : opcode - the operation
+//                drum - the drum field
+//                block - the block field
+// Outputs      : the encoded operation, 0 if a field is illegal
+
+uint32_t encode_SMSA_operation( SMSA_DISK_COMMAND opcode, SMSA_DRUM_ID drum, SMSA_BLOCK_ID block ) {
+	if ( opcode >= SMSA_MAX_COMMAND ) {
+		logMessage( LOG_ERROR_LEVEL, "Encoding illegal operation  [%u]", opcode );
+		smsa_error_number = SMSA_BAD_OPCODE;
+		return( 0 );
+	}
+	if ( drum >= SMSA_DISK_ARRAY_SIZE ) {
+		logMessage( LOG_ERROR_LEVEL, "Encoding illegal drum id [%u]", drum );
+		smsa_error_number = SMSA_BAD_DRUM_ID;
+		return( 0 );
+	}
+	if ( block >= SMSA_MAX_BLOCK_ID ) {
+		logMessage( LOG_ERROR_LEVEL, "Encoding illegal block id [%u]", block );
+		smsa_error_number = SMSA_BAD_BLOCK_ID;
+		return( 0 );
+	}
+
+	return( (opcode << 26) | (drum << 22) | block );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : block_address
+// Description  : Find a block in the array
+//
+// Inputs       : drum - the drum of the block
+//                block - the block in the drum
+// Outputs      : pointer to the block's bytes
+
+unsigned char * block_address( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block ) {
+	return( &smsa_array[drum*SMSA_DISK_SIZE + block*SMSA_BLOCK_SIZE] );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : map_array
+// Description  : Create the (zero filled) array if it does not exist yet
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int map_array( void ) {
+
+	// Local variables
+	void *array;
+
+	if ( smsa_array != NULL ) {
+		return( 0 );
+	}
+	if ( (array = mmap(NULL, MAX_SMSA_VIRTUAL_ADDRESS, PROT_READ|PROT_WRITE,
+			MAP_PRIVATE|MAP_ANONYMOUS, -1, 0)) == MAP_FAILED ) {
+		logMessage( LOG_ERROR_LEVEL, "Unable to map the disk array [%s]", strerror(errno) );
+		return( -1 );
+	}
+	smsa_array = array;
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : mark_dirty
+// Description  : Note the pages covering a range of the array as written
+//
+// Inputs       : addr - the offset of the range in the array
+//                len - the number of bytes
+// Outputs      : none
+
+void mark_dirty( uint32_t addr, uint32_t len ) {
+
+	// Local variables
+	uint32_t page;
+
+	for ( page=addr/SMSA_PAGE_SIZE; page<=(addr+len-1)/SMSA_PAGE_SIZE; page++ ) {
+		smsa_dirty[page] = true;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : write_back
+// Description  : Write the runs of written pages of a drum to the file
+//
+// Inputs       : fd - the open smsa_data.dat
+//                drum - the drum to write back
+// Outputs      : 0 if successful, -1 if failure
+
+int write_back( int fd, SMSA_DRUM_ID drum ) {
+
+	// Local variables
+	uint32_t first = drum*(SMSA_DISK_SIZE/SMSA_PAGE_SIZE), last = first+SMSA_DISK_SIZE/SMSA_PAGE_SIZE;
+	uint32_t page, end, len;
+
+	for ( page=first; page<last; page=end ) {
+		if ( ! smsa_dirty[page] ) {
+			end = page+1;
+			continue;
+		}
+		for ( end=page; (end<last) && smsa_dirty[end]; end++ );
+		len = (end-page)*SMSA_PAGE_SIZE;
+		if ( pwrite(fd, &smsa_array[page*SMSA_PAGE_SIZE], len, page*SMSA_PAGE_SIZE) != len ) {
+			logMessage( LOG_ERROR_LEVEL, "Failure writing array data [%s], error=[%s]",
+				SMSA_DISK_FILE, strerror(errno) );
+			smsa_error_number = SMSA_DISK_CACHEWRITE_FAIL;
+			return( -1 );
+		}
+		memset( &smsa_dirty[page], 0x0, (end-page)*sizeof(bool) );
+	}
+
+	return( 0 );
+}
@@ -84,6 +84,12 @@ int smsa_operation( uint32_t op, unsigned char *block );
 int SMSABlockSign( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block );
 	// Generate a signature for a particular block
 
+int SMSALoadArray( void );
+	// Load the array contents from SMSA_DISK_FILE
+
+int SMSAStoreArray( void );
+	// Save the array contents to SMSA_DISK_FILE
+
 // Utility Functions
 
 const char * smsa_error_string( int eno );
@@ -0,0 +1,499 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : smsa_async.c
+//  Description    : This is the asynchronous interface to the SMSA driver.
+//                   The queue is kept in submission order; the scheduler
+//                   picks among the requests ahead of the first MOUNT,
+//                   UNMOUNT or FLUSH, scanning them all, so it relies on the
+//                   callers keeping the queue short (the bench keeps at
+//                   most its ring depth, a direct caller one request per
+//                   thread).
+//
+//   Author        :
+//   Last Modified :
+//
+
+// Include Files
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+// Project Include Files
+#include <smsa_async.h>
+#include <cmpsc311_log.h>
+
+// Defines
+#define ASYNC_DATA_OP( op ) ( ( (op) == SMSA_ASYNC_READ ) || ( (op) == SMSA_ASYNC_WRITE ) )
+
+// Functional Prototypes
+void * async_worker( void *unused );
+SMSA_ASYNC_REQUEST * async_pick( void );
+bool async_blocked( SMSA_ASYNC_REQUEST *req );
+void async_enqueue( SMSA_ASYNC_REQUEST *req );
+void async_account( SMSA_ASYNC_REQUEST *req );
+int async_execute( SMSA_ASYNC_REQUEST *req );
+uint64_t async_nsecs( void );
+
+//
+// Global data
+static pthread_t async_thread;
+static pthread_mutex_t async_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t async_work = PTHREAD_COND_INITIALIZER;  // queue has requests
+static pthread_cond_t async_done = PTHREAD_COND_INITIALIZER;  // a request completed
+static SMSA_ASYNC_REQUEST *async_head = NULL, *async_tail = NULL;
+static uint32_t async_outstanding = 0;  // queued or executing requests
+static bool async_running = false;
+static bool async_stopping = false;
+static SMSA_ASYNC_SCHEDULER async_sched = SMSA_ASYNC_FIFO;
+static uint64_t async_deadline = SMSA_ASYNC_DEADLINE * 1000ULL; // nsecs
+static uint32_t async_position = 0;     // block after the last request run
+static SMSA_ASYNC_STATS async_stats;
+static __thread bool async_on_worker = false; // is this the worker thread?
+
+// Interfaces
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_async_scheduler
+// Description  : Select the order the worker runs requests in, used from
+//                the next start
+//
+// Inputs       : sched - the scheduler
+//                deadline_usecs - how long a request may wait under C-LOOK
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_async_scheduler( SMSA_ASYNC_SCHEDULER sched, uint32_t deadline_usecs ) {
+  if ( ( sched != SMSA_ASYNC_FIFO ) && ( sched != SMSA_ASYNC_CLOOK ) ) {
+    logMessage( LOG_ERROR_LEVEL, "Unknown async scheduler [%d]", sched );
+    return -1;
+  }
+
+  pthread_mutex_lock( &async_lock );
+  if ( async_running ) {
+    pthread_mutex_unlock( &async_lock );
+    logMessage( LOG_ERROR_LEVEL, "Async scheduler changed while the worker is running" );
+    return -1;
+  }
+  async_sched = sched;
+  async_deadline = deadline_usecs * 1000ULL;
+  pthread_mutex_unlock( &async_lock );
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_async_start
+// Description  : Start the worker thread
+//
+// Inputs       : none
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_async_start( void ) {
+  if ( async_running ) {
+    return 0;
+  }
+
+  async_stopping = false;
+  async_position = 0;
+  memset( &async_stats, 0x0, sizeof(async_stats) );
+  if ( pthread_create( &async_thread, NULL, async_worker, NULL ) ) {
+    logMessage( LOG_ERROR_LEVEL, "Unable to start the async driver worker" );
+    return -1;
+  }
+  pthread_mutex_lock( &async_lock );
+  async_running = true;
+  pthread_mutex_unlock( &async_lock );
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_async_stop
+// Description  : Finish all queued requests and stop the worker thread
+//
+// Inputs       : none
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_async_stop( void ) {
+  if ( !async_running ) {
+    return 0;
+  }
+
+  pthread_mutex_lock( &async_lock );
+  async_stopping = true;
+  pthread_cond_signal( &async_work );
+  pthread_mutex_unlock( &async_lock );
+
+  if ( pthread_join( async_thread, NULL ) ) {
+    return -1;
+  }
+  pthread_mutex_lock( &async_lock );
+  async_running = false;
+  pthread_mutex_unlock( &async_lock );
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_async_submit
+// Description  : Queue a request for the worker.  The request and its buffer
+//                must stay valid until it completes.
+//
+// Inputs       : req - the request to queue
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_async_submit( SMSA_ASYNC_REQUEST *req ) {
+  pthread_mutex_lock( &async_lock );
+  if ( !async_running ) {
+    pthread_mutex_unlock( &async_lock );
+    logMessage( LOG_ERROR_LEVEL, "Async request submitted with no worker running" );
+    return -1;
+  }
+  async_enqueue( req );
+  pthread_mutex_unlock( &async_lock );
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_async_route
+// Description  : Run a direct smsa_vread or smsa_vwrite through the queue
+//                when the worker is running under C-LOOK, so it is ordered
+//                with the queued requests and the other direct callers.
+//                Calls from the worker itself (and its callbacks) are not
+//                routed, nor are calls once the worker is stopping.
+//
+// Inputs       : op - SMSA_ASYNC_READ or SMSA_ASYNC_WRITE
+//                addr - the virtual address
+//                len - the number of bytes
+//                buf - the data buffer
+//                result - the place to put the result of the driver call
+// Outputs      : true if the call ran through the queue, false if the
+//                caller must make it itself
+
+bool smsa_async_route( SMSA_ASYNC_OP op, uint32_t addr, uint32_t len, unsigned char *buf, int *result ) {
+  SMSA_ASYNC_REQUEST req;
+
+  if ( async_on_worker ) {
+    return false;
+  }
+
+  pthread_mutex_lock( &async_lock );
+  if ( !async_running || async_stopping || ( async_sched != SMSA_ASYNC_CLOOK ) ) {
+    pthread_mutex_unlock( &async_lock );
+    return false;
+  }
+  memset( &req, 0x0, sizeof(req) );
+  req.op = op;
+  req.addr = addr;
+  req.len = len;
+  req.buf = buf;
+  async_enqueue( &req );
+  while ( req.state == SMSA_ASYNC_QUEUED ) {
+    pthread_cond_wait( &async_done, &async_lock );
+  }
+  pthread_mutex_unlock( &async_lock );
+
+  *result = req.result;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_async_poll
+// Description  : Check if a request has completed
+//
+// Inputs       : req - the request to check
+// Outputs      : 1 if complete, 0 if still pending
+
+int smsa_async_poll( SMSA_ASYNC_REQUEST *req ) {
+  int complete;
+
+  pthread_mutex_lock( &async_lock );
+  complete = ( req->state == SMSA_ASYNC_COMPLETE );
+  pthread_mutex_unlock( &async_lock );
+
+  return( complete );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_async_wait
+// Description  : Wait for a request to complete
+//
+// Inputs       : req - the request to wait for
+// Outputs      : the result of the driver call (-1 if failure, 0 if success)
+
+int smsa_async_wait( SMSA_ASYNC_REQUEST *req ) {
+  pthread_mutex_lock( &async_lock );
+  while ( req->state == SMSA_ASYNC_QUEUED ) {
+    pthread_cond_wait( &async_done, &async_lock );
+  }
+  pthread_mutex_unlock( &async_lock );
+
+  return( req->result );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_async_drain
+// Description  : Wait for every queued request to complete
+//
+// Inputs       : none
+// Outputs      : 0 (always successful)
+
+int smsa_async_drain( void ) {
+  pthread_mutex_lock( &async_lock );
+  while ( async_outstanding > 0 ) {
+    pthread_cond_wait( &async_done, &async_lock );
+  }
+  pthread_mutex_unlock( &async_lock );
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_async_stats
+// Description  : Get the scheduling counters since the worker started
+//
+// Inputs       : stats - the place to put the counters
+// Outputs      : 0 (always successful)
+
+int smsa_async_stats( SMSA_ASYNC_STATS *stats ) {
+  pthread_mutex_lock( &async_lock );
+  *stats = async_stats;
+  pthread_mutex_unlock( &async_lock );
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : async_worker
+// Description  : The worker thread, runs requests in the scheduler's order.
+//                The callback runs before the request is marked complete, so
+//                it must not resubmit the request it is given.
+//
+// Inputs       : unused - thread argument
+// Outputs      : NULL
+
+void * async_worker( void *unused ) {
+  SMSA_ASYNC_REQUEST *req;
+
+  async_on_worker = true;
+  while ( true ) {
+    pthread_mutex_lock( &async_lock );
+    while ( ( async_head == NULL ) && !async_stopping ) {
+      pthread_cond_wait( &async_work, &async_lock );
+    }
+    if ( async_head == NULL ) {
+      pthread_mutex_unlock( &async_lock );
+      break;
+    }
+    req = async_pick();
+    async_account( req );
+    pthread_mutex_unlock( &async_lock );
+
+    req->result = async_execute( req );
+    if ( req->callback != NULL ) {
+      req->callback( req );
+    }
+
+    pthread_mutex_lock( &async_lock );
+    req->state = SMSA_ASYNC_COMPLETE;
+    async_outstanding--;
+    pthread_cond_broadcast( &async_done );
+    pthread_mutex_unlock( &async_lock );
+  }
+
+  return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : async_pick
+// Description  : Take the next request to run off the queue (lock held, queue
+//                not empty).  A MOUNT, UNMOUNT or FLUSH at the head runs
+//                next, and no request after one is considered.  Under C-LOOK
+//                the head runs if its deadline has passed; otherwise the
+//                lowest request at or after the current position, or failing
+//                that the lowest of all, among those not held back by an
+//                earlier request they overlap.
+//
+// Inputs       : none
+// Outputs      : the request, unlinked from the queue
+
+SMSA_ASYNC_REQUEST * async_pick( void ) {
+  SMSA_ASYNC_REQUEST *req, *prev, *best = async_head, *best_prev = NULL;
+  SMSA_ASYNC_REQUEST *low = NULL, *low_prev = NULL;
+  uint32_t start;
+
+  if ( ( async_sched == SMSA_ASYNC_CLOOK ) && ASYNC_DATA_OP( async_head->op ) ) {
+    if ( async_nsecs() - async_head->queued >= async_deadline ) {
+      async_stats.expired++;
+    }
+    else {
+      best = NULL;
+      for ( prev = NULL, req = async_head; ( req != NULL ) && ASYNC_DATA_OP( req->op );
+            prev = req, req = req->next ) {
+        if ( async_blocked( req ) ) {
+          continue;
+        }
+        start = req->addr / SMSA_BLOCK_SIZE;
+        if ( ( start >= async_position ) &&
+             ( ( best == NULL ) || ( start < best->addr / SMSA_BLOCK_SIZE ) ) ) {
+          best = req;
+          best_prev = prev;
+        }
+        if ( ( low == NULL ) || ( start < low->addr / SMSA_BLOCK_SIZE ) ) {
+          low = req;
+          low_prev = prev;
+        }
+      }
+      if ( best == NULL ) {
+        best = low;
+        best_prev = low_prev;
+      }
+    }
+  }
+
+  // Unlink it
+  if ( best_prev == NULL ) {
+    async_head = best->next;
+  }
+  else {
+    best_prev->next = best->next;
+  }
+  if ( async_tail == best ) {
+    async_tail = best_prev;
+  }
+
+  return( best );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : async_blocked
+// Description  : Check whether a queued request must wait for an earlier one
+//                it overlaps (reads may pass each other)
+//
+// Inputs       : req - the request
+// Outputs      : true if it must wait
+
+bool async_blocked( SMSA_ASYNC_REQUEST *req ) {
+  SMSA_ASYNC_REQUEST *earlier;
+
+  for ( earlier = async_head; earlier != req; earlier = earlier->next ) {
+    if ( ( ( req->op == SMSA_ASYNC_WRITE ) || ( earlier->op == SMSA_ASYNC_WRITE ) ) &&
+         ( earlier->addr < req->addr + req->len ) && ( req->addr < earlier->addr + earlier->len ) ) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : async_enqueue
+// Description  : Add a request to the tail of the queue and wake the worker
+//                (lock held)
+//
+// Inputs       : req - the request
+// Outputs      : none
+
+void async_enqueue( SMSA_ASYNC_REQUEST *req ) {
+  req->state = SMSA_ASYNC_QUEUED;
+  req->next = NULL;
+  req->queued = async_nsecs();
+  if ( async_tail != NULL ) {
+    async_tail->next = req;
+  }
+  else {
+    async_head = req;
+  }
+  async_tail = req;
+  async_outstanding++;
+  pthread_cond_signal( &async_work );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : async_account
+// Description  : Count a READ or WRITE about to run: the blocks between the
+//                end of the last one and its start, and how long it queued
+//                (lock held)
+//
+// Inputs       : req - the request
+// Outputs      : none
+
+void async_account( SMSA_ASYNC_REQUEST *req ) {
+  uint32_t start;
+  uint64_t waited;
+
+  if ( !ASYNC_DATA_OP( req->op ) ) {
+    return;
+  }
+
+  start = req->addr / SMSA_BLOCK_SIZE;
+  waited = async_nsecs() - req->queued;
+  async_stats.requests++;
+  async_stats.seek_blocks += ( start > async_position ) ? start - async_position : async_position - start;
+  async_stats.queue_nsecs += waited;
+  if ( waited > async_stats.queue_max_nsecs ) {
+    async_stats.queue_max_nsecs = waited;
+  }
+  async_position = ( req->len > 0 ) ? ( req->addr + req->len - 1 ) / SMSA_BLOCK_SIZE + 1 : start;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : async_execute
+// Description  : Make the driver call for a request
+//
+// Inputs       : req - the request
+// Outputs      : the result of the driver call
+
+int async_execute( SMSA_ASYNC_REQUEST *req ) {
+  switch ( req->op ) {
+  case SMSA_ASYNC_MOUNT:
+    return( smsa_vmount() );
+
+  case SMSA_ASYNC_UNMOUNT:
+    return( smsa_vunmount() );
+
+  case SMSA_ASYNC_READ:
+    return( smsa_vread( req->addr, req->len, req->buf ) );
+
+  case SMSA_ASYNC_WRITE:
+    return( smsa_vwrite( req->addr, req->len, req->buf ) );
+
+  case SMSA_ASYNC_FLUSH:
+    return( smsa_vflush() );
+  }
+
+  logMessage( LOG_ERROR_LEVEL, "Unknown async driver operation [%d]", req->op );
+  return -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : async_nsecs
+// Description  : Read the monotonic clock
+//
+// Inputs       : none
+// Outputs      : the current time in nanoseconds
+
+uint64_t async_nsecs( void ) {
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return( (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec );
+}
@@ -0,0 +1,123 @@
+#ifndef SMSA_ASYNC_INCLUDED
+#define SMSA_ASYNC_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : smsa_async.h
+//  Description    : This is the asynchronous interface to the SMSA driver.
+//                   Requests are queued to a worker thread which makes every
+//                   driver (and so every smsa_operation) call.  By default
+//                   they run in submission order; the C-LOOK scheduler
+//                   instead sweeps the queued reads and writes in ascending
+//                   address order, wrapping back to the lowest, and runs a
+//                   request out of turn once it has waited past its
+//                   deadline.  Either way a request never passes an earlier
+//                   one it overlaps (unless both are reads), and MOUNT,
+//                   UNMOUNT and FLUSH run alone, after everything submitted
+//                   before them and before anything submitted after.  The
+//                   driver is thread safe, so the application may still
+//                   call it directly.  While the worker runs under C-LOOK,
+//                   direct smsa_vread and smsa_vwrite calls are queued here
+//                   too and wait for their turn, so they are ordered with
+//                   the queued requests and each other; under FIFO, or with
+//                   no worker, the driver runs each call as it comes.  The
+//                   other driver calls (vectors, whole drums, format) are
+//                   never queued.
+//
+//   Author        :
+//   Last Modified :
+//
+
+// Include Files
+#include <stdint.h>
+
+// Defines
+#define SMSA_ASYNC_DEADLINE 20000 // Default C-LOOK deadline in microseconds
+
+// Project Include Files
+#include <smsa_driver.h>
+
+//
+// Type Definitions
+
+// The operations that can be queued
+typedef enum {
+  SMSA_ASYNC_MOUNT   = 0, // smsa_vmount
+  SMSA_ASYNC_UNMOUNT = 1, // smsa_vunmount
+  SMSA_ASYNC_READ    = 2, // smsa_vread
+  SMSA_ASYNC_WRITE   = 3, // smsa_vwrite
+  SMSA_ASYNC_FLUSH   = 4, // smsa_vflush
+} SMSA_ASYNC_OP;
+
+// The state of a request
+typedef enum {
+  SMSA_ASYNC_IDLE     = 0, // Not submitted
+  SMSA_ASYNC_QUEUED   = 1, // Waiting for the worker
+  SMSA_ASYNC_COMPLETE = 2, // Finished, result is valid
+} SMSA_ASYNC_STATE;
+
+// How the worker picks the next request
+typedef enum {
+  SMSA_ASYNC_FIFO  = 0, // Submission order
+  SMSA_ASYNC_CLOOK = 1, // Ascending address sweeps, with deadlines
+} SMSA_ASYNC_SCHEDULER;
+
+// Counters for the READ and WRITE requests run since the worker started
+typedef struct {
+  uint64_t requests;        // Requests run
+  uint64_t seek_blocks;     // Blocks from the end of each request to the start of the next
+  uint64_t queue_nsecs;     // Time requests waited in the queue
+  uint64_t queue_max_nsecs; // Longest wait
+  uint64_t expired;         // Requests run out of turn at their deadline
+} SMSA_ASYNC_STATS;
+
+struct smsa_async_request;
+
+// Called on the worker thread when a request completes
+typedef void (*SMSA_ASYNC_CALLBACK)( struct smsa_async_request *req );
+
+// A request, owned by the caller until it completes
+typedef struct smsa_async_request {
+  SMSA_ASYNC_OP op;                 // The operation
+  SMSA_VIRTUAL_ADDRESS addr;        // Virtual address (READ/WRITE)
+  uint32_t len;                     // Number of bytes (READ/WRITE)
+  unsigned char *buf;               // Data buffer (READ/WRITE)
+  SMSA_ASYNC_CALLBACK callback;     // Completion callback (may be NULL)
+  void *arg;                        // Caller data for the callback
+  int result;                       // Return value of the driver call
+  SMSA_ASYNC_STATE state;           // Where the request is (set by the queue)
+  uint64_t queued;                  // When it was submitted (internal)
+  struct smsa_async_request *next;  // Queue linkage (internal)
+} SMSA_ASYNC_REQUEST;
+
+//
+// Interfaces
+
+int smsa_async_scheduler( SMSA_ASYNC_SCHEDULER sched, uint32_t deadline_usecs );
+	// Select the order requests run in from the next start (deadline for C-LOOK)
+
+int smsa_async_start( void );
+	// Start the worker thread
+
+int smsa_async_stop( void );
+	// Finish all queued requests and stop the worker thread
+
+int smsa_async_submit( SMSA_ASYNC_REQUEST *req );
+	// Queue a request, returns without waiting for it
+
+bool smsa_async_route( SMSA_ASYNC_OP op, uint32_t addr, uint32_t len, unsigned char *buf, int *result );
+	// Run a direct read or write through the queue under C-LOOK (true if it did)
+
+int smsa_async_poll( SMSA_ASYNC_REQUEST *req );
+	// Check if a request has completed (1) or is still pending (0)
+
+int smsa_async_wait( SMSA_ASYNC_REQUEST *req );
+	// Wait for a request to complete and return its result
+
+int smsa_async_drain( void );
+	// Wait for every queued request to complete
+
+int smsa_async_stats( SMSA_ASYNC_STATS *stats );
+	// Get the scheduling counters since the worker started
+
+#endif
@@ -0,0 +1,742 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : smsa_cache.c
+//  Description    : This is the block cache used by the SMSA driver.  Each
+//                   drum has its own partition of the segment lists, so
+//                   callers holding a drum's lock can use it without
+//                   touching the other drums.  The budget, the lines and the
+//                   slots for full blocks are shared, taken and returned
+//                   under a short global lock, so a drum may grow into the
+//                   capacity the others leave idle.  A drum below its even
+//                   share that finds the budget spent takes a line back from
+//                   the drum furthest over its share, if that drum's lock is
+//                   free.  The protected segment of a drum is held to its
+//                   share of the whole budget in bytes.
+//
+//   Author        :
+//   Last Modified :
+//
+
+// Include Files
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Project Include Files
+#include <smsa_cache.h>
+#include <cmpsc311_log.h>
+
+// Defines
+
+//
+// Type Definitions
+
+// A segment list, most recently used line at the head
+typedef struct {
+  SMSA_CACHE_LINE *head, *tail;
+  uint32_t count;
+  uint32_t bytes;                             // Budget bytes of the lines on it
+} SMSA_CACHE_LIST;
+
+// The segments and counters of one drum
+typedef struct {
+  SMSA_CACHE_LINE *index[SMSA_MAX_BLOCK_ID];  // Line holding each block
+  uint32_t used;                              // Budget bytes of its lines (under cache_lock)
+  uint32_t uniform;                           // Number of uniform lines
+  SMSA_CACHE_LIST probation, protected;
+  uint32_t dirty;                             // Number of dirty lines
+  uint64_t hits, misses, writebacks;
+} SMSA_CACHE_PARTITION;
+
+// Functional Prototypes
+bool cache_uniform( unsigned char *data, unsigned char *fill );
+uint32_t cache_cost( SMSA_CACHE_LINE *line );
+void cache_copy( SMSA_CACHE_LINE *line, unsigned char *data );
+SMSA_CACHE_LINE * cache_take( SMSA_CACHE_PARTITION *part, bool uniform );
+void cache_release( SMSA_CACHE_PARTITION *part, SMSA_CACHE_LINE *line );
+int cache_make_room( SMSA_DRUM_ID drum );
+int cache_reclaim( SMSA_DRUM_ID drum );
+int cache_evict( SMSA_CACHE_PARTITION *part );
+int cache_flush_partition( SMSA_CACHE_PARTITION *part );
+void cache_list_remove( SMSA_CACHE_LIST *list, SMSA_CACHE_LINE *line );
+void cache_list_push( SMSA_CACHE_LIST *list, SMSA_CACHE_LINE *line, SMSA_CACHE_SEGMENT segment );
+SMSA_CACHE_LINE * cache_victim( SMSA_CACHE_PARTITION *part );
+
+//
+// Global data
+static SMSA_CACHE_PARTITION cache_drums[SMSA_DISK_ARRAY_SIZE];
+static bool cache_on = false;
+static SMSA_CACHE_WRITEBACK cache_writeback = NULL;
+static pthread_mutex_t *cache_locks = NULL;  // The drum locks, tried before taking a drum's line
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER; // The shared lines, slots and bytes
+static SMSA_CACHE_LINE *cache_pool = NULL;   // All of the lines, allocated once
+static SMSA_CACHE_LINE *cache_free = NULL;   // Unused lines (linked on next)
+static unsigned char *cache_slab = NULL;     // Storage for the full blocks
+static unsigned char **cache_slots = NULL;   // Unused blocks of the slab
+static uint32_t cache_spare;                 // Number of unused slots
+static uint32_t cache_budget, cache_used;    // Bytes the lines may and do cost
+static uint32_t cache_share;                 // Even share of the budget of a drum
+static uint32_t cache_protected_limit;       // Budget bytes a drum's protected lines may cost
+
+// Interfaces
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_cache_init
+// Description  : Create the cache with a budget of the given number of full
+//                blocks (no more than the array holds), shared by the drums
+//
+// Inputs       : lines - the number of full blocks to hold (0 disables the cache)
+//                writeback - function used to write dirty blocks back
+//                locks - the SMSA_DISK_ARRAY_SIZE drum locks of the callers
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_cache_init( uint32_t lines, SMSA_CACHE_WRITEBACK writeback, pthread_mutex_t *locks ) {
+  uint32_t full, headers, i;
+  int drum;
+
+  smsa_cache_close();
+  for ( drum = 0; drum < SMSA_DISK_ARRAY_SIZE; drum++ ) {
+    cache_drums[drum].hits = cache_drums[drum].misses = cache_drums[drum].writebacks = 0;
+  }
+  if ( lines == 0 ) {
+    return 0;
+  }
+  cache_writeback = writeback;
+  cache_locks = locks;
+
+  full = ( lines > SMSA_DISK_ARRAY_SIZE * SMSA_MAX_BLOCK_ID ) ? SMSA_DISK_ARRAY_SIZE * SMSA_MAX_BLOCK_ID : lines;
+  headers = full * SMSA_CACHE_BLOCK_COST / SMSA_CACHE_LINE_COST;
+  if ( headers > SMSA_DISK_ARRAY_SIZE * SMSA_MAX_BLOCK_ID ) {
+    headers = SMSA_DISK_ARRAY_SIZE * SMSA_MAX_BLOCK_ID;
+  }
+  if ( ( ( cache_pool = calloc( headers, sizeof(SMSA_CACHE_LINE) ) ) == NULL ) ||
+       ( ( cache_slab = malloc( full * SMSA_BLOCK_SIZE ) ) == NULL ) ||
+       ( ( cache_slots = malloc( full * sizeof(unsigned char *) ) ) == NULL ) ) {
+    logMessage( LOG_ERROR_LEVEL, "Unable to allocate block cache [%u lines]", lines );
+    smsa_cache_close();
+    return -1;
+  }
+
+  // Chain all of the lines onto the free list, and stack up the slots
+  for ( i = 0; i < headers; i++ ) {
+    cache_pool[i].next = cache_free;
+    cache_free = &cache_pool[i];
+  }
+  for ( i = 0; i < full; i++ ) {
+    cache_slots[i] = &cache_slab[i * SMSA_BLOCK_SIZE];
+  }
+  cache_spare = full;
+  cache_budget = full * SMSA_CACHE_BLOCK_COST;
+  cache_share = cache_budget / SMSA_DISK_ARRAY_SIZE;
+  cache_protected_limit = ( cache_budget * SMSA_CACHE_PROTECTED_PCT ) / 100;
+  cache_on = true;
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_cache_close
+// Description  : Release the cache and all of its lines, dirty lines are
+//                discarded so callers flush first.  The counters are kept
+//                until the next init.
+//
+// Inputs       : none
+// Outputs      : none
+
+void smsa_cache_close( void ) {
+  SMSA_CACHE_PARTITION *part, saved;
+  int drum;
+
+  for ( drum = 0; drum < SMSA_DISK_ARRAY_SIZE; drum++ ) {
+    part = &cache_drums[drum];
+    saved = *part;
+    memset( part, 0x0, sizeof(SMSA_CACHE_PARTITION) );
+    part->hits = saved.hits;
+    part->misses = saved.misses;
+    part->writebacks = saved.writebacks;
+  }
+  free( cache_pool );
+  free( cache_slab );
+  free( cache_slots );
+  cache_pool = cache_free = NULL;
+  cache_slab = NULL;
+  cache_slots = NULL;
+  cache_spare = cache_budget = cache_used = cache_share = 0;
+  cache_on = false;
+  cache_writeback = NULL;
+  cache_locks = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_cache_enabled
+// Description  : Check if the cache is currently holding blocks
+//
+// Inputs       : none
+// Outputs      : true if the cache has lines, false if not
+
+bool smsa_cache_enabled( void ) {
+  return( cache_on );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_cache_get
+// Description  : Look up a block, promoting it on a hit.  A line that is hit
+//                while on probation moves to the protected segment, which
+//                pushes the protected LRU line back onto probation if full.
+//
+// Inputs       : drum - the drum of the block
+//                block - the block within the drum
+//                data - the SMSA_BLOCK_SIZE buffer to copy the block to
+// Outputs      : true on a hit, false on a miss
+
+bool smsa_cache_get( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block, unsigned char *data ) {
+  SMSA_CACHE_PARTITION *part = &cache_drums[drum];
+  SMSA_CACHE_LINE *line;
+
+  if ( !smsa_cache_enabled() ) {
+    return false;
+  }
+
+  if ( ( line = part->index[block] ) == NULL ) {
+    part->misses++;
+    return false;
+  }
+  part->hits++;
+  cache_copy( line, data );
+
+  if ( line->segment == SMSA_CACHE_PROBATION ) {
+    cache_list_remove( &part->probation, line );
+    cache_list_push( &part->protected, line, SMSA_CACHE_PROTECTED );
+
+    // Keep the protected segment within its share of the budget
+    while ( part->protected.bytes > cache_protected_limit ) {
+      SMSA_CACHE_LINE *demoted = part->protected.tail;
+      cache_list_remove( &part->protected, demoted );
+      cache_list_push( &part->probation, demoted, SMSA_CACHE_PROBATION );
+    }
+  }
+  else {
+    cache_list_remove( &part->protected, line );
+    cache_list_push( &part->protected, line, SMSA_CACHE_PROTECTED );
+  }
+
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_cache_peek
+// Description  : Look up a block without touching the counters or the
+//                line's position
+//
+// Inputs       : drum - the drum of the block
+//                block - the block within the drum
+//                data - the SMSA_BLOCK_SIZE buffer to copy the block to,
+//                       NULL to only check that it is cached
+// Outputs      : true if cached, false if not
+
+bool smsa_cache_peek( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block, unsigned char *data ) {
+  SMSA_CACHE_LINE *line;
+
+  if ( !smsa_cache_enabled() || ( ( line = cache_drums[drum].index[block] ) == NULL ) ) {
+    return false;
+  }
+
+  if ( data != NULL ) {
+    cache_copy( line, data );
+  }
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_cache_put
+// Description  : Insert or update the contents of a block.  New blocks start
+//                on probation so that blocks touched once are evicted first.
+//                Lines are evicted until the block fits the budget; if the
+//                line to evict is dirty every dirty line of its drum is
+//                written back first, so the writes reach the device in one
+//                sweep.  A block turning uniform, or no longer uniform, is
+//                put in again as a new block.  If no drum can give up a
+//                line the block is not cached, and written back if dirty.
+//
+// Inputs       : drum - the drum of the block
+//                block - the block within the drum
+//                data - the SMSA_BLOCK_SIZE bytes of the block
+//                dirty - true if the data has not been written to the device
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_cache_put( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block, unsigned char *data, bool dirty ) {
+  SMSA_CACHE_PARTITION *part = &cache_drums[drum];
+  SMSA_CACHE_LINE *line;
+  unsigned char fill;
+  bool uniform;
+  int ret;
+
+  if ( !smsa_cache_enabled() ) {
+    return 0;
+  }
+  uniform = cache_uniform( data, &fill );
+
+  // Already cached in the same form, just refresh the contents
+  if ( ( line = part->index[block] ) != NULL ) {
+    if ( uniform == ( line->data == NULL ) ) {
+      if ( uniform ) {
+        line->fill = fill;
+      }
+      else {
+        memcpy( line->data, data, SMSA_BLOCK_SIZE );
+      }
+      part->dirty += ( dirty - line->dirty );
+      line->dirty = dirty;
+      return 0;
+    }
+
+    // The new contents replace the old, dirty or not
+    cache_list_remove( ( line->segment == SMSA_CACHE_PROBATION ) ? &part->probation : &part->protected, line );
+    cache_release( part, line );
+  }
+
+  // Evict until there is a free line and room in the budget
+  while ( ( line = cache_take( part, uniform ) ) == NULL ) {
+    if ( ( ret = cache_make_room( drum ) ) < 0 ) {
+      return -1;
+    }
+    if ( ret == 0 ) {
+      if ( dirty && cache_writeback( drum, block, data ) ) {
+        logMessage( LOG_ERROR_LEVEL, "Block cache write back failed [%d/%d]", drum, block );
+        return -1;
+      }
+      part->writebacks += dirty;
+      return 0;
+    }
+  }
+
+  line->drum = drum;
+  line->block = block;
+  line->dirty = dirty;
+  part->dirty += dirty;
+  if ( uniform ) {
+    line->fill = fill;
+    part->uniform++;
+  }
+  else {
+    memcpy( line->data, data, SMSA_BLOCK_SIZE );
+  }
+  cache_list_push( &part->probation, line, SMSA_CACHE_PROBATION );
+  part->index[block] = line;
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_cache_flush
+// Description  : Write all dirty blocks back in drum/block order, the lines
+//                stay cached and become clean
+//
+// Inputs       : none
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_cache_flush( void ) {
+  int drum;
+
+  for ( drum = 0; drum < SMSA_DISK_ARRAY_SIZE; drum++ ) {
+    if ( cache_flush_partition( &cache_drums[drum] ) ) {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_cache_flush_drum
+// Description  : Write the dirty blocks of one drum back in block order
+//
+// Inputs       : drum - the drum to flush
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_cache_flush_drum( SMSA_DRUM_ID drum ) {
+  return( cache_flush_partition( &cache_drums[drum] ) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_cache_stats
+// Description  : Get the hit, miss and write back counts since the cache
+//                was created, summed over the drums
+//
+// Inputs       : hits - place to put the hit count
+//                misses - place to put the miss count
+//                writebacks - place to put the number of blocks written back
+// Outputs      : none
+
+void smsa_cache_stats( uint64_t *hits, uint64_t *misses, uint64_t *writebacks ) {
+  int drum;
+
+  *hits = *misses = *writebacks = 0;
+  for ( drum = 0; drum < SMSA_DISK_ARRAY_SIZE; drum++ ) {
+    *hits += cache_drums[drum].hits;
+    *misses += cache_drums[drum].misses;
+    *writebacks += cache_drums[drum].writebacks;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_cache_usage
+// Description  : Get how many blocks the cache holds, summed over the drums
+//
+// Inputs       : blocks - place to put the number of blocks held
+//                uniform - place to put how many of them are uniform
+//                bytes - place to put the budget bytes they use
+// Outputs      : none
+
+void smsa_cache_usage( uint32_t *blocks, uint32_t *uniform, uint32_t *bytes ) {
+  int drum;
+
+  *blocks = *uniform = *bytes = 0;
+  for ( drum = 0; drum < SMSA_DISK_ARRAY_SIZE; drum++ ) {
+    *blocks += cache_drums[drum].probation.count + cache_drums[drum].protected.count;
+    *uniform += cache_drums[drum].uniform;
+    *bytes += cache_drums[drum].used;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cache_uniform
+// Description  : Check whether a block is one byte repeated, comparing
+//                16 bytes at a time against the first byte where SSE2 is
+//                available and 8 at a time otherwise
+//
+// Inputs       : data - the SMSA_BLOCK_SIZE bytes of the block
+//                fill - place to put the repeated byte
+// Outputs      : true if the block is uniform
+
+bool cache_uniform( unsigned char *data, unsigned char *fill ) {
+  int i;
+
+#ifdef __SSE2__
+  __m128i pattern = _mm_set1_epi8( (char)data[0] ), diff;
+
+  // Check a 64 byte stretch at a time, most blocks that differ do early
+  for ( i = 0; i < SMSA_BLOCK_SIZE; i += 64 ) {
+    diff = _mm_or_si128(
+        _mm_or_si128( _mm_xor_si128( _mm_loadu_si128( (__m128i *)&data[i] ), pattern ),
+                      _mm_xor_si128( _mm_loadu_si128( (__m128i *)&data[i + 16] ), pattern ) ),
+        _mm_or_si128( _mm_xor_si128( _mm_loadu_si128( (__m128i *)&data[i + 32] ), pattern ),
+                      _mm_xor_si128( _mm_loadu_si128( (__m128i *)&data[i + 48] ), pattern ) ) );
+    if ( _mm_movemask_epi8( _mm_cmpeq_epi8( diff, _mm_setzero_si128() ) ) != 0xffff ) {
+      return false;
+    }
+  }
+#else
+  uint64_t pattern = data[0] * 0x0101010101010101ULL, word;
+
+  for ( i = 0; i < SMSA_BLOCK_SIZE; i += sizeof(word) ) {
+    memcpy( &word, &data[i], sizeof(word) );
+    if ( word != pattern ) {
+      return false;
+    }
+  }
+#endif
+
+  *fill = data[0];
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cache_cost
+// Description  : Get the budget bytes a line costs
+//
+// Inputs       : line - the line
+// Outputs      : the bytes
+
+uint32_t cache_cost( SMSA_CACHE_LINE *line ) {
+  return( ( line->data == NULL ) ? SMSA_CACHE_LINE_COST : SMSA_CACHE_BLOCK_COST );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cache_copy
+// Description  : Copy a line's block out, expanding a uniform block
+//
+// Inputs       : line - the line
+//                data - the SMSA_BLOCK_SIZE buffer to copy to
+// Outputs      : none
+
+void cache_copy( SMSA_CACHE_LINE *line, unsigned char *data ) {
+  if ( line->data == NULL ) {
+    memset( data, line->fill, SMSA_BLOCK_SIZE );
+  }
+  else {
+    memcpy( data, line->data, SMSA_BLOCK_SIZE );
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cache_take
+// Description  : Take a free line, with a slot for a full block, if the
+//                budget has room for it, charging it to a drum
+//
+// Inputs       : part - the drum's partition
+//                uniform - true if the block is uniform (needs no slot)
+// Outputs      : the line, or NULL if there is no room
+
+SMSA_CACHE_LINE * cache_take( SMSA_CACHE_PARTITION *part, bool uniform ) {
+  uint32_t cost = uniform ? SMSA_CACHE_LINE_COST : SMSA_CACHE_BLOCK_COST;
+  SMSA_CACHE_LINE *line = NULL;
+
+  pthread_mutex_lock( &cache_lock );
+  if ( ( cache_free != NULL ) && ( cache_used + cost <= cache_budget ) && ( uniform || ( cache_spare > 0 ) ) ) {
+    line = cache_free;
+    cache_free = line->next;
+    line->data = uniform ? NULL : cache_slots[--cache_spare];
+    cache_used += cost;
+    part->used += cost;
+  }
+  pthread_mutex_unlock( &cache_lock );
+
+  return( line );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cache_release
+// Description  : Return an unlinked line, and its slot, to the free lists
+//
+// Inputs       : part - the drum's partition
+//                line - the line, already off its segment list
+// Outputs      : none
+
+void cache_release( SMSA_CACHE_PARTITION *part, SMSA_CACHE_LINE *line ) {
+  if ( line->data == NULL ) {
+    part->uniform--;
+  }
+  part->dirty -= line->dirty;
+  line->dirty = false;
+  part->index[line->block] = NULL;
+
+  pthread_mutex_lock( &cache_lock );
+  cache_used -= cache_cost( line );
+  part->used -= cache_cost( line );
+  if ( line->data != NULL ) {
+    cache_slots[cache_spare++] = line->data;
+    line->data = NULL;
+  }
+  line->next = cache_free;
+  cache_free = line;
+  pthread_mutex_unlock( &cache_lock );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cache_make_room
+// Description  : Give up one line to make room for a drum's block.  A drum
+//                below its share takes a line from another drum if it can,
+//                otherwise the drum gives up one of its own.
+//
+// Inputs       : drum - the drum needing room, its lock held by the caller
+// Outputs      : 1 if a line was given up, 0 if none could be, -1 if failure
+
+int cache_make_room( SMSA_DRUM_ID drum ) {
+  int ret;
+
+  if ( ( cache_drums[drum].used < cache_share ) && ( ( ret = cache_reclaim( drum ) ) != 0 ) ) {
+    return( ret );
+  }
+  return( cache_evict( &cache_drums[drum] ) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cache_reclaim
+// Description  : Evict a line of the drum furthest over its share.  Its
+//                lock is only tried, as the caller already holds drum locks;
+//                a drum that is busy is passed over for the next furthest.
+//
+// Inputs       : drum - the drum needing room, its lock held by the caller
+// Outputs      : 1 if a line was given up, 0 if none could be, -1 if failure
+
+int cache_reclaim( SMSA_DRUM_ID drum ) {
+  bool tried[SMSA_DISK_ARRAY_SIZE];
+  int lender, other, ret;
+  uint32_t most;
+
+  memset( tried, 0x0, sizeof(tried) );
+  for ( ;; ) {
+    lender = -1;
+    most = cache_share;
+    pthread_mutex_lock( &cache_lock );
+    for ( other = 0; other < SMSA_DISK_ARRAY_SIZE; other++ ) {
+      if ( ( other != drum ) && !tried[other] && ( cache_drums[other].used > most ) ) {
+        most = cache_drums[other].used;
+        lender = other;
+      }
+    }
+    pthread_mutex_unlock( &cache_lock );
+    if ( lender < 0 ) {
+      return 0;
+    }
+
+    tried[lender] = true;
+    if ( pthread_mutex_trylock( &cache_locks[lender] ) == 0 ) {
+      ret = cache_evict( &cache_drums[lender] );
+      pthread_mutex_unlock( &cache_locks[lender] );
+      if ( ret != 0 ) {
+        return( ret );
+      }
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cache_evict
+// Description  : Evict a drum's LRU line, writing back every dirty line of
+//                the drum first if that line is dirty.  The caller holds
+//                the drum's lock.
+//
+// Inputs       : part - the drum's partition
+// Outputs      : 1 if a line was evicted, 0 if it has none, -1 if failure
+
+int cache_evict( SMSA_CACHE_PARTITION *part ) {
+  SMSA_CACHE_LINE *line;
+
+  line = ( part->probation.tail != NULL ) ? part->probation.tail : part->protected.tail;
+  if ( line == NULL ) {
+    return 0;
+  }
+  if ( line->dirty && cache_flush_partition( part ) ) {
+    return -1;
+  }
+  cache_release( part, cache_victim( part ) );
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cache_flush_partition
+// Description  : Write the dirty lines of a drum back in block order, the
+//                lines stay cached and become clean
+//
+// Inputs       : part - the drum's partition
+// Outputs      : -1 if failure or 0 if successful
+
+int cache_flush_partition( SMSA_CACHE_PARTITION *part ) {
+  unsigned char expanded[SMSA_BLOCK_SIZE];
+  SMSA_CACHE_LINE *line;
+  int block;
+
+  for ( block = 0; ( block < SMSA_MAX_BLOCK_ID ) && ( part->dirty > 0 ); block++ ) {
+    line = part->index[block];
+    if ( ( line == NULL ) || !line->dirty ) {
+      continue;
+    }
+
+    if ( line->data == NULL ) {
+      memset( expanded, line->fill, SMSA_BLOCK_SIZE );
+    }
+    if ( cache_writeback( line->drum, line->block, ( line->data == NULL ) ? expanded : line->data ) ) {
+      logMessage( LOG_ERROR_LEVEL, "Block cache write back failed [%d/%d]", line->drum, block );
+      return -1;
+    }
+    line->dirty = false;
+    part->dirty--;
+    part->writebacks++;
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cache_victim
+// Description  : Unlink the line to evict, the probation LRU line if there
+//                is one and the protected LRU line otherwise
+//
+// Inputs       : part - the drum's partition
+// Outputs      : the unlinked line
+
+SMSA_CACHE_LINE * cache_victim( SMSA_CACHE_PARTITION *part ) {
+  SMSA_CACHE_LINE *line;
+
+  if ( part->probation.tail != NULL ) {
+    line = part->probation.tail;
+    cache_list_remove( &part->probation, line );
+  }
+  else {
+    line = part->protected.tail;
+    cache_list_remove( &part->protected, line );
+  }
+
+  return( line );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cache_list_remove
+// Description  : Unlink a line from a segment list
+//
+// Inputs       : list - the segment list
+//                line - the line to unlink
+// Outputs      : none
+
+void cache_list_remove( SMSA_CACHE_LIST *list, SMSA_CACHE_LINE *line ) {
+  if ( line->prev != NULL ) {
+    line->prev->next = line->next;
+  }
+  else {
+    list->head = line->next;
+  }
+
+  if ( line->next != NULL ) {
+    line->next->prev = line->prev;
+  }
+  else {
+    list->tail = line->prev;
+  }
+
+  line->prev = line->next = NULL;
+  line->segment = SMSA_CACHE_FREE;
+  list->count--;
+  list->bytes -= cache_cost( line );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cache_list_push
+// Description  : Link a line at the most recently used end of a segment list
+//
+// Inputs       : list - the segment list
+//                line - the line to link
+//                segment - the segment the list represents
+// Outputs      : none
+
+void cache_list_push( SMSA_CACHE_LIST *list, SMSA_CACHE_LINE *line, SMSA_CACHE_SEGMENT segment ) {
+  line->prev = NULL;
+  line->next = list->head;
+  if ( list->head != NULL ) {
+    list->head->prev = line;
+  }
+  else {
+    list->tail = line;
+  }
+
+  list->head = line;
+  line->segment = segment;
+  list->count++;
+  list->bytes += cache_cost( line );
+}
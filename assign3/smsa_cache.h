@@ -0,0 +1,98 @@
+#ifndef SMSA_CACHE_INCLUDED
+#define SMSA_CACHE_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : smsa_cache.h
+//  Description    : This is the block cache used by the SMSA driver.  Blocks
+//                   are kept in a segmented LRU (probation + protected) so
+//                   that a single sweep over the array cannot flush the
+//                   blocks that are being reused.  Each drum has its own
+//                   segments, so calls for different drums may run
+//                   concurrently and calls for the same drum may not, but
+//                   the budget is shared: one drum may hold all of it while
+//                   the others are idle.
+//                   A block that is one byte repeated (as the workloads
+//                   write them) is held as that byte in its line alone, so
+//                   the capacity is a byte budget: a full block costs its
+//                   line and SMSA_BLOCK_SIZE, a uniform block just the line.
+//                   A line is 40 bytes on 64-bit builds, so the budget of
+//                   one full block holds about 7 uniform ones.
+//
+//   Author        :
+//   Last Modified :
+//
+
+// Include Files
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+// Project Include Files
+#include <smsa.h>
+
+// Defines
+#define SMSA_DEFAULT_CACHE_LINES 1024 // Default capacity in full blocks (256KB)
+#define SMSA_CACHE_LINE_COST sizeof(SMSA_CACHE_LINE)  // Budget bytes used by a uniform block
+#define SMSA_CACHE_BLOCK_COST ( SMSA_BLOCK_SIZE + SMSA_CACHE_LINE_COST ) // ... by a full block
+#define SMSA_CACHE_PROTECTED_PCT 80   // Share of the budget for the protected segment
+
+//
+// Type Definitions
+
+// Called to write a dirty block back to the device
+typedef int (*SMSA_CACHE_WRITEBACK)( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block, unsigned char *data );
+
+// The cache segments a line can be on
+typedef enum {
+  SMSA_CACHE_FREE      = 0, // Line is unused
+  SMSA_CACHE_PROBATION = 1, // Line has been referenced once
+  SMSA_CACHE_PROTECTED = 2, // Line has been referenced more than once
+} SMSA_CACHE_SEGMENT;
+
+// A single cached block
+typedef struct smsa_cache_line {
+  SMSA_DRUM_ID drum;                    // Drum the block lives on
+  SMSA_BLOCK_ID block;                  // Block within the drum
+  SMSA_CACHE_SEGMENT segment;           // Segment the line is on
+  bool dirty;                           // Newer than the copy on the device?
+  unsigned char fill;                   // Byte filling the block if data is NULL
+  struct smsa_cache_line *prev, *next;  // Segment list linkage (MRU first)
+  unsigned char *data;                  // The block contents, NULL if uniform
+} SMSA_CACHE_LINE;
+
+//
+// Interfaces
+
+int smsa_cache_init( uint32_t lines, SMSA_CACHE_WRITEBACK writeback, pthread_mutex_t *locks );
+	// Create the cache with a budget of the given number of full blocks (0 disables it),
+	// locks are the callers' drum locks, tried before evicting another drum's lines
+
+void smsa_cache_close( void );
+	// Release the cache and all of its lines (counters are kept)
+
+bool smsa_cache_enabled( void );
+	// Is the cache currently holding blocks?
+
+bool smsa_cache_get( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block, unsigned char *data );
+	// Copy out the cached contents of a block, false on a miss
+
+bool smsa_cache_peek( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block, unsigned char *data );
+	// Copy out a cached block (if data is not NULL) without counting it as a use
+
+int smsa_cache_put( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block, unsigned char *data, bool dirty );
+	// Insert or update the contents of a block, dirty if not yet on the device
+
+int smsa_cache_flush( void );
+	// Write all dirty blocks back in drum/block order
+
+int smsa_cache_flush_drum( SMSA_DRUM_ID drum );
+	// Write the dirty blocks of one drum back in block order
+
+void smsa_cache_stats( uint64_t *hits, uint64_t *misses, uint64_t *writebacks );
+	// Get the hit, miss and write back counts since the cache was created
+
+void smsa_cache_usage( uint32_t *blocks, uint32_t *uniform, uint32_t *bytes );
+	// Get the blocks held, how many of them are uniform and the budget bytes they use
+
+#endif
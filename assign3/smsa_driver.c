@@ -1,7 +1,9 @@
 ////////////////////////////////////////////////////////////////////////////////
 //
 //  File           : smsa_driver.c
-//  Description    : This is the driver for the SMSA simulator.
+//  Description    : This is the driver for the SMSA simulator.  It maps the
+//                   virtual address space onto device operations through a
+//                   block cache, and may be called from several threads.
 //
 //   Author        : 
 //   Last Modified : 
@@ -11,22 +13,76 @@
 
 // Project Include Files
 #include <smsa_driver.h>
+#include <smsa_cache.h>
+#include <smsa_readahead.h>
+#include <smsa_journal.h>
+#include <smsa_written.h>
+#include <smsa_trace.h>
+#include <smsa_async.h>
 #include <cmpsc311_log.h>
-#include <assert.h>
+#include <pthread.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
 
 // Defines
 
+//
+// Type Definitions
+
+// A segment's address and its position in the caller's array, for sorting
+typedef struct {
+  SMSA_VIRTUAL_ADDRESS addr;
+  int index;
+} SMSA_SEGMENT_ORDER;
+
 // Functional Prototypes
-bool valid_address( uint32_t addr );
+bool valid_address( uint32_t addr, uint32_t len );
 SMSA_DRUM_ID get_drum_id( uint32_t addr );
 SMSA_BLOCK_ID get_block_id( uint32_t addr );
 SMSA_BLOCK_ID get_offset( uint32_t addr );
 uint32_t get_instruction( SMSA_DISK_COMMAND opcode, SMSA_DRUM_ID drumId, SMSA_BLOCK_ID blockId );
 void read_buf( uint32_t len, SMSA_BLOCK_ID offset, bool firstBlock, int* readBytes, unsigned char* temp, unsigned char* buf );
 void write_buf( uint32_t len, SMSA_BLOCK_ID offset, bool firstBlock, int* writtenBytes, unsigned char* temp, unsigned char* buf );
+int read_block( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block, unsigned char *temp );
+void read_ahead( SMSA_DRUM_ID drum, SMSA_BLOCK_ID first, SMSA_BLOCK_ID last, unsigned char *data );
+int write_block( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block, unsigned char *temp );
+int flush_block( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block, unsigned char *data );
+int seek_to( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block );
+int drum_transfer( SMSA_DRUM_ID drum, unsigned char *buf, bool write );
+int replay_block( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block, unsigned char *data );
+int load_array( void );
+int commit_writes( void );
+int checkpoint( void );
+int device_op( SMSA_DISK_COMMAND opcode, SMSA_DRUM_ID drum, SMSA_BLOCK_ID block, unsigned char *temp );
+uint64_t now_nsecs( void );
+int vector_io( SMSA_IOVEC *iov, int iovcnt, bool write );
+int vector_run( SMSA_IOVEC *iov, SMSA_SEGMENT_ORDER *members, int count, uint32_t start, uint32_t end, bool write );
+int compare_segments( const void *a, const void *b );
+int compare_indices( const void *a, const void *b );
+void init_locks( void );
+void lock_drums( SMSA_DRUM_ID first, SMSA_DRUM_ID last );
+void unlock_drums( SMSA_DRUM_ID first, SMSA_DRUM_ID last );
+SMSA_DRUM_ID last_drum( uint32_t addr, uint32_t len );
 
 //
 // Global data
+static uint32_t cache_lines = SMSA_DEFAULT_CACHE_LINES; // capacity used at mount
+static uint32_t readahead_depth = SMSA_DEFAULT_READAHEAD; // largest window used at mount
+static SMSA_WRITE_MODE write_mode = SMSA_WRITE_THROUGH;  // when writes reach the device
+static const char *journal_path = NULL; // journal opened at mount (NULL for none)
+static const char *written_path = NULL; // written-block map loaded at mount (NULL for none)
+static bool head_known = false;    // do we know where the device head is?
+static SMSA_DRUM_ID head_drum;     // drum the device head is on
+static uint32_t head_block;        // block the next read/write will touch
+static SMSA_DRIVER_STATS stats;    // device operation counters since mount
+static pthread_once_t locks_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t drum_locks[SMSA_DISK_ARRAY_SIZE]; // cache partition of each drum
+static pthread_mutex_t device_lock; // head position, device operations and stats
 
 // Interfaces
 
@@ -39,7 +95,31 @@ void write_buf( uint32_t len, SMSA_BLOCK_ID offset, bool firstBlock, int* writte
 // Outputs      : -1 if failure or 0 if successful
 
 int smsa_vmount( void ) {
-  return( smsa_operation( get_instruction( SMSA_MOUNT, 0, 0 ), NULL ) );
+  int ret = -1, replayed;
+
+  lock_drums( 0, SMSA_DISK_ARRAY_SIZE - 1 );
+  pthread_mutex_lock( &device_lock );
+  if ( !smsa_cache_init( cache_lines, flush_block, drum_locks ) && !smsa_readahead_init( readahead_depth ) ) {
+    memset( &stats, 0x0, sizeof(stats) );
+    ret = device_op( SMSA_MOUNT, 0, 0, NULL );
+  }
+  if ( !ret && ( written_path != NULL ) && smsa_written_load( written_path ) ) {
+    ret = -1;
+  }
+
+  // Put back the writes a previous mount did not get to unmount with
+  if ( !ret && ( journal_path != NULL ) ) {
+    if ( ( replayed = smsa_journal_open( journal_path, load_array, replay_block ) ) < 0 ) {
+      ret = -1;
+    }
+    else if ( replayed > 0 ) {
+      logMessage( LOG_INFO_LEVEL, "Replayed %d blocks from journal [%s]", replayed, journal_path );
+    }
+  }
+  pthread_mutex_unlock( &device_lock );
+  unlock_drums( 0, SMSA_DISK_ARRAY_SIZE - 1 );
+
+  return( ret );
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -51,7 +131,263 @@ int smsa_vmount( void ) {
 // Outputs      : -1 if failure or 0 if successful
 
 int smsa_vunmount( void )  {
-  return( smsa_operation( get_instruction( SMSA_UNMOUNT, 0, 0 ), NULL ) );
+  uint64_t hits, misses, writebacks, prefetched, wasted;
+  uint32_t blocks, uniform, bytes;
+  int ret;
+
+  // Get any buffered writes onto the device before it goes away, and with
+  // a journal store the array so the next mount starts from it
+  lock_drums( 0, SMSA_DISK_ARRAY_SIZE - 1 );
+  if ( smsa_journal_enabled() ? checkpoint() : smsa_cache_flush() ) {
+    unlock_drums( 0, SMSA_DISK_ARRAY_SIZE - 1 );
+    return -1;
+  }
+
+  // Report how well the cache did, the device does not keep the array
+  // contents across an unmount so the cache goes with it
+  if ( smsa_cache_enabled() ) {
+    smsa_cache_stats( &hits, &misses, &writebacks );
+    logMessage( LOG_INFO_LEVEL, "Block cache hits %" PRIu64 ", misses %" PRIu64 ", write backs %" PRIu64,
+        hits, misses, writebacks );
+    smsa_cache_usage( &blocks, &uniform, &bytes );
+    logMessage( LOG_INFO_LEVEL, "Block cache held %u blocks (%u uniform) in %u bytes",
+        blocks, uniform, bytes );
+  }
+  smsa_cache_close();
+  if ( readahead_depth > 0 ) {
+    smsa_readahead_close();
+    smsa_readahead_stats( &prefetched, &hits, &wasted );
+    logMessage( LOG_INFO_LEVEL, "Read-ahead prefetched %" PRIu64 " blocks, hits %" PRIu64 ", wasted %" PRIu64,
+        prefetched, hits, wasted );
+  }
+
+  pthread_mutex_lock( &device_lock );
+  logMessage( LOG_INFO_LEVEL, "Driver issued %" PRIu64 " seeks",
+      stats.ops[SMSA_SEEK_DRUM] + stats.ops[SMSA_SEEK_BLOCK] );
+  ret = device_op( SMSA_UNMOUNT, 0, 0, NULL );
+  pthread_mutex_unlock( &device_lock );
+
+  // The map is stamped with the array file, save it once that is final
+  if ( !ret && ( written_path != NULL ) && smsa_written_save( written_path ) ) {
+    ret = -1;
+  }
+  smsa_written_close();
+
+  // The checkpoint left just the base record, which loads the stored array
+  if ( smsa_journal_close() ) {
+    ret = -1;
+  }
+  unlock_drums( 0, SMSA_DISK_ARRAY_SIZE - 1 );
+
+  return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_vcache_size
+// Description  : Set the capacity of the driver block cache, takes effect at
+//                the next mount
+//
+// Inputs       : lines - the number of blocks to cache (0 disables the cache)
+// Outputs      : 0 (always successful)
+
+int smsa_vcache_size( uint32_t lines ) {
+  cache_lines = lines;
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_vreadahead
+// Description  : Set the largest read-ahead window per drum, takes effect at
+//                the next mount
+//
+// Inputs       : blocks - the most blocks to prefetch at once (0 disables)
+// Outputs      : 0 (always successful)
+
+int smsa_vreadahead( uint32_t blocks ) {
+  readahead_depth = blocks;
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_vjournal
+// Description  : Set the write-ahead journal file, takes effect at the next
+//                mount.  The string must stay valid while it is in use.
+//
+// Inputs       : path - the journal file (NULL disables journaling)
+// Outputs      : 0 (always successful)
+
+int smsa_vjournal( const char *path ) {
+  journal_path = path;
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_vwritten
+// Description  : Set the written-block map file, takes effect at the next
+//                mount.  With no map in the file yet the array is only taken
+//                to be new if there is no SMSA_DISK_FILE, otherwise every
+//                block counts as written until its drum is formatted.  The
+//                string must stay valid while it is in use.
+//
+// Inputs       : path - the map file (NULL disables the map)
+// Outputs      : 0 (always successful)
+
+int smsa_vwritten( const char *path ) {
+  written_path = path;
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_vtrace
+// Description  : Start recording every device operation to a new trace, or
+//                stop recording
+//
+// Inputs       : path - the trace file (NULL stops recording)
+//                hashes - true to record a hash of each block moved
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_vtrace( const char *path, bool hashes ) {
+  int ret;
+
+  pthread_once( &locks_once, init_locks );
+  pthread_mutex_lock( &device_lock );
+  ret = ( path != NULL ) ? smsa_trace_open( path, hashes ) : smsa_trace_close();
+  pthread_mutex_unlock( &device_lock );
+
+  return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_vformat
+// Description  : Format a drum, zeroing it on the device.  Cached and
+//                prefetched copies of its blocks are replaced by zeros, and
+//                with a journal the zeroed blocks are journaled so a replay
+//                does not bring back what the format removed.
+//
+// Inputs       : drum - the drum to format
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_vformat( SMSA_DRUM_ID drum ) {
+  unsigned char zeros[SMSA_BLOCK_SIZE];
+  int block, ret = 0;
+
+  if ( drum >= SMSA_DISK_ARRAY_SIZE ) {
+    logMessage( LOG_ERROR_LEVEL, "Drum for format is out of range [%d]", drum );
+    return -1;
+  }
+  memset( zeros, 0x0, SMSA_BLOCK_SIZE );
+
+  lock_drums( drum, drum );
+  for ( block = 0; ( block < SMSA_MAX_BLOCK_ID ) && smsa_journal_enabled() && !ret; block++ ) {
+    ret = smsa_journal_append( drum, block, zeros );
+  }
+
+  // The device formats the drum the head is on
+  pthread_mutex_lock( &device_lock );
+  if ( !ret && ( ( head_known && ( head_drum == drum ) ) || !device_op( SMSA_SEEK_DRUM, drum, 0, NULL ) ) ) {
+    ret = device_op( SMSA_FORMAT_DRUM, drum, 0, NULL );
+  }
+  else {
+    ret = -1;
+  }
+  pthread_mutex_unlock( &device_lock );
+
+  for ( block = 0; ( block < SMSA_MAX_BLOCK_ID ) && !ret; block++ ) {
+    smsa_readahead_invalidate( drum, block );
+    if ( smsa_cache_peek( drum, block, NULL ) ) {
+      ret = smsa_cache_put( drum, block, zeros, false );
+    }
+  }
+  if ( !ret ) {
+    smsa_written_clear( drum );
+  }
+  unlock_drums( drum, drum );
+
+  if ( !ret ) {
+    ret = commit_writes();
+  }
+  return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_vwrite_mode
+// Description  : Select whether writes go straight to the device or are held
+//                in the block cache until a flush.  Write back needs the cache,
+//                without it writes always go through.
+//
+// Inputs       : mode - SMSA_WRITE_THROUGH or SMSA_WRITE_BACK
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_vwrite_mode( SMSA_WRITE_MODE mode ) {
+  int ret = 0;
+
+  // Going back to write through, nothing may stay buffered
+  lock_drums( 0, SMSA_DISK_ARRAY_SIZE - 1 );
+  if ( ( mode == SMSA_WRITE_THROUGH ) && smsa_cache_flush() ) {
+    ret = -1;
+  }
+  else {
+    write_mode = mode;
+  }
+  unlock_drums( 0, SMSA_DISK_ARRAY_SIZE - 1 );
+
+  return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_vflush
+// Description  : Write all buffered blocks to the device in drum/block order.
+//                With a journal its outstanding records are then committed;
+//                the array is only checkpointed at SMSA_JOURNAL_CHECKPOINT
+//                records and at unmount.
+//
+// Inputs       : none
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_vflush( void ) {
+  SMSA_DRUM_ID drum;
+  int ret = 0;
+
+  // One drum at a time, so the other drums stay usable meanwhile
+  for ( drum = 0; ( drum < SMSA_DISK_ARRAY_SIZE ) && !ret; drum++ ) {
+    lock_drums( drum, drum );
+    ret = smsa_cache_flush_drum( drum );
+    unlock_drums( drum, drum );
+  }
+
+  if ( !ret && smsa_journal_enabled() ) {
+    ret = smsa_journal_commit();
+  }
+  return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_vstats
+// Description  : Get the device operation counters since the last mount
+//
+// Inputs       : out - the place to put the counters
+// Outputs      : 0 (always successful)
+
+int smsa_vstats( SMSA_DRIVER_STATS *out ) {
+  lock_drums( 0, SMSA_DISK_ARRAY_SIZE - 1 );
+  pthread_mutex_lock( &device_lock );
+  *out = stats;
+  smsa_cache_stats( &out->cache_hits, &out->cache_misses, &out->cache_writebacks );
+  smsa_readahead_stats( &out->prefetch_blocks, &out->prefetch_hits, &out->prefetch_wasted );
+  smsa_journal_stats( &out->journal_records, &out->journal_commits );
+  out->zero_blocks = smsa_written_stats();
+  pthread_mutex_unlock( &device_lock );
+  unlock_drums( 0, SMSA_DISK_ARRAY_SIZE - 1 );
+  return 0;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -65,10 +401,16 @@ int smsa_vunmount( void )  {
 // Outputs      : -1 if failure or 0 if successful
 
 int smsa_vread( uint32_t addr, uint32_t len, unsigned char *buf ) {
-  if ( !valid_address( addr ) ) {
+  if ( !valid_address( addr, len ) ) {
     return -1;
   }
 
+  // Under the C-LOOK scheduler the call waits its turn in the async queue
+  int routed;
+  if ( smsa_async_route( SMSA_ASYNC_READ, addr, len, buf, &routed ) ) {
+    return( routed );
+  }
+
   // Initialize data
   bool firstBlock = true;
   unsigned char temp[SMSA_OFFSET_SIZE]; // temporary byte buffer
@@ -76,32 +418,68 @@ int smsa_vread( uint32_t addr, uint32_t len, unsigned char *buf ) {
   SMSA_DRUM_ID drum = get_drum_id( addr );
   SMSA_BLOCK_ID block = get_block_id( addr );
   SMSA_BLOCK_ID offset = get_offset( addr );
+  SMSA_DRUM_ID first = drum, last = last_drum( addr, len );
+  SMSA_BLOCK_ID start;
+  unsigned char *data = temp; // where the last block read went
+  int ret = 0;
+
+  lock_drums( first, last );
 
   // Loop through as many drums as necessary
   do {
-    smsa_operation( get_instruction( SMSA_SEEK_DRUM, drum, block ), NULL );
+    // A whole drum goes as one stream
+    if ( ( block == 0 ) && ( !firstBlock || ( offset == 0 ) ) && ( len - readBytes >= SMSA_DISK_SIZE ) ) {
+      ret = drum_transfer( drum, &buf[readBytes], false );
+      readBytes += SMSA_DISK_SIZE;
+      firstBlock = false;
+      drum++;
+      continue;
+    }
 
     // Loop through as many blocks as necessary
+    start = block;
     do {
-      smsa_operation( get_instruction( SMSA_SEEK_BLOCK, drum, block ), NULL );
-      smsa_operation( get_instruction( SMSA_DISK_READ, drum, block ), temp );
-      read_buf( len, offset, firstBlock, &readBytes, temp, buf );
+      if ( ( !firstBlock || ( offset == 0 ) ) && ( len - readBytes >= SMSA_BLOCK_SIZE ) ) {
+        // The whole block is wanted, read it straight into the caller's
+        // buffer
+        data = &buf[readBytes];
+        if ( read_block( drum, block, data ) ) {
+          ret = -1;
+          break;
+        }
+        readBytes += SMSA_BLOCK_SIZE;
+      }
+      else {
+        data = temp;
+        if ( read_block( drum, block, temp ) ) {
+          ret = -1;
+          break;
+        }
+        read_buf( len, offset, firstBlock, &readBytes, temp, buf );
+      }
       firstBlock = false;
       block++;
     } while ( ( readBytes < len ) && ( block < SMSA_MAX_BLOCK_ID ) );
+    if ( !ret ) {
+      read_ahead( drum, start, block - 1, data );
+    }
     
     drum++;
     block = 0;
-  } while ( ( readBytes < len ) && ( drum < SMSA_DISK_ARRAY_SIZE ) );
+  } while ( !ret && ( readBytes < len ) && ( drum < SMSA_DISK_ARRAY_SIZE ) );
 
-  return 0;
+  unlock_drums( first, last );
+  return( ret );
 }
   
 
 ////////////////////////////////////////////////////////////////////////////////
 //
 // Function     : smsa_vwrite
-// Description  : Write to the SMSA virtual address space
+// Description  : Write to the SMSA virtual address space.  With a journal
+//                the call waits for its records to be durable only after
+//                dropping its locks, so writers on other drums can join the
+//                same commit.
 //
 // Inputs       : addr - the address to write to
 //                len - the number of bytes to write
@@ -109,10 +487,16 @@ int smsa_vread( uint32_t addr, uint32_t len, unsigned char *buf ) {
 // Outputs      : -1 if failure or 0 if successful
 
 int smsa_vwrite( uint32_t addr, uint32_t len, unsigned char *buf )  {
-  if ( !valid_address( addr ) ) {
+  if ( !valid_address( addr, len ) ) {
     return -1;
   }
 
+  // Under the C-LOOK scheduler the call waits its turn in the async queue
+  int routed;
+  if ( smsa_async_route( SMSA_ASYNC_WRITE, addr, len, buf, &routed ) ) {
+    return( routed );
+  }
+
   // Initialize data
   bool firstBlock = true;
   unsigned char temp[SMSA_OFFSET_SIZE]; // temporary byte buffer
@@ -120,43 +504,803 @@ int smsa_vwrite( uint32_t addr, uint32_t len, unsigned char *buf )  {
   SMSA_DRUM_ID drum = get_drum_id( addr );
   SMSA_BLOCK_ID block = get_block_id( addr );
   SMSA_BLOCK_ID offset = get_offset( addr );
+  SMSA_DRUM_ID first = drum, last = last_drum( addr, len );
+  int ret = 0;
+
+  lock_drums( first, last );
   
   // Loop through as many drums as necessary
   do {
-    smsa_operation( get_instruction( SMSA_SEEK_DRUM, drum, block ), NULL );
+    // A whole drum goes as one stream
+    if ( ( block == 0 ) && ( !firstBlock || ( offset == 0 ) ) && ( len - writtenBytes >= SMSA_DISK_SIZE ) ) {
+      ret = drum_transfer( drum, &buf[writtenBytes], true );
+      writtenBytes += SMSA_DISK_SIZE;
+      firstBlock = false;
+      drum++;
+      continue;
+    }
 
     // Loop through as many blocks as necessary
     do {
-      // Read data already present into temporary buffer then seek back to
-      // start of block
-      smsa_operation( get_instruction( SMSA_SEEK_BLOCK, drum, block ), NULL );
-      smsa_operation( get_instruction( SMSA_DISK_READ, drum, block ), temp );
-      smsa_operation( get_instruction( SMSA_SEEK_DRUM, drum, block ), NULL );
-      smsa_operation( get_instruction( SMSA_SEEK_BLOCK, drum, block ), NULL );
-
-      write_buf( len, offset, firstBlock, &writtenBytes, temp, buf );
-      smsa_operation( get_instruction( SMSA_DISK_WRITE, drum, block), temp );
+      if ( ( !firstBlock || ( offset == 0 ) ) && ( len - writtenBytes >= SMSA_BLOCK_SIZE ) ) {
+        // The whole block is being replaced, write it straight from the
+        // caller's buffer
+        if ( write_block( drum, block, &buf[writtenBytes] ) ) {
+          ret = -1;
+          break;
+        }
+        writtenBytes += SMSA_BLOCK_SIZE;
+      }
+      else {
+        // Read data already present into temporary buffer, merge in the new
+        // bytes and write the block back
+        if ( read_block( drum, block, temp ) ) {
+          ret = -1;
+          break;
+        }
+        write_buf( len, offset, firstBlock, &writtenBytes, temp, buf );
+        if ( write_block( drum, block, temp ) ) {
+          ret = -1;
+          break;
+        }
+      }
       firstBlock = false;
       block++;
     } while ( ( writtenBytes < len ) && ( block < SMSA_MAX_BLOCK_ID ) );
 
     drum++;
     block = 0;
-  } while ( ( writtenBytes < len ) && ( drum < SMSA_DISK_ARRAY_SIZE ) );
+  } while ( !ret && ( writtenBytes < len ) && ( drum < SMSA_DISK_ARRAY_SIZE ) );
+
+  unlock_drums( first, last );
+  if ( !ret ) {
+    ret = commit_writes();
+  }
+  return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_vreadv
+// Description  : Read a set of segments from the SMSA virtual address space.
+//                Segments are sorted by address and merged where they touch
+//                or overlap, so each block is read once in one sweep.
+//
+// Inputs       : iov - the segments to read
+//                iovcnt - the number of segments
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_vreadv( SMSA_IOVEC *iov, int iovcnt ) {
+  return( vector_io( iov, iovcnt, false ) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_vwritev
+// Description  : Write a set of segments to the SMSA virtual address space.
+//                Segments are sorted and merged like smsa_vreadv; where they
+//                overlap the later segment in the array wins, as if they
+//                had been written one after the other.
+//
+// Inputs       : iov - the segments to write
+//                iovcnt - the number of segments
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_vwritev( SMSA_IOVEC *iov, int iovcnt ) {
+  return( vector_io( iov, iovcnt, true ) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_vread_drum
+// Description  : Read a whole drum with one seek, streaming its blocks in
+//                order
+//
+// Inputs       : drum - the drum to read
+//                buf - the SMSA_DISK_SIZE buffer to put the drum in
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_vread_drum( SMSA_DRUM_ID drum, unsigned char *buf ) {
+  int ret;
+
+  if ( drum >= SMSA_DISK_ARRAY_SIZE ) {
+    logMessage( LOG_ERROR_LEVEL, "Drum for read is out of range [%d]", drum );
+    return -1;
+  }
+
+  lock_drums( drum, drum );
+  ret = drum_transfer( drum, buf, false );
+  unlock_drums( drum, drum );
+
+  return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_vwrite_drum
+// Description  : Write a whole drum with one seek, streaming its blocks in
+//                order
+//
+// Inputs       : drum - the drum to write
+//                buf - the SMSA_DISK_SIZE buffer holding the drum
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_vwrite_drum( SMSA_DRUM_ID drum, unsigned char *buf ) {
+  int ret;
+
+  if ( drum >= SMSA_DISK_ARRAY_SIZE ) {
+    logMessage( LOG_ERROR_LEVEL, "Drum for write is out of range [%d]", drum );
+    return -1;
+  }
+
+  lock_drums( drum, drum );
+  ret = drum_transfer( drum, buf, true );
+  unlock_drums( drum, drum );
+  if ( !ret ) {
+    ret = commit_writes();
+  }
+
+  return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : read_block
+// Description  : Get the contents of a block, from the cache if it holds the
+//                block, then the read-ahead window, and from the device
+//                otherwise (filling the cache).  A block the written-block
+//                map says was never written is zeros, without the device.
+//                The caller holds the drum's lock.
+//
+// Inputs       : drum - the drum to read from
+//                block - the block to read
+//                temp - the SMSA_BLOCK_SIZE buffer to put the block in
+// Outputs      : -1 if failure or 0 if successful
+
+int read_block( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block, unsigned char *temp ) {
+  unsigned char *cached;
+
+  if ( smsa_cache_get( drum, block, temp ) ) {
+    return 0;
+  }
+
+  // Never written, there is nothing to read
+  if ( !smsa_written_test( drum, block ) ) {
+    memset( temp, 0x0, SMSA_BLOCK_SIZE );
+    smsa_written_zeroed( drum, 1 );
+    return 0;
+  }
+
+  if ( ( cached = smsa_readahead_get( drum, block ) ) != NULL ) {
+    memcpy( temp, cached, SMSA_BLOCK_SIZE );
+    return( smsa_cache_put( drum, block, temp, false ) );
+  }
+
+  pthread_mutex_lock( &device_lock );
+  if ( seek_to( drum, block ) || device_op( SMSA_DISK_READ, drum, block, temp ) ) {
+    pthread_mutex_unlock( &device_lock );
+    return -1;
+  }
+  pthread_mutex_unlock( &device_lock );
+
+  return( smsa_cache_put( drum, block, temp, false ) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : read_ahead
+// Description  : Tell the read-ahead window about the blocks a read took
+//                from a drum and prefetch what it asks for.  Blocks already
+//                in the cache are skipped.  The head is left just past the
+//                read, so a sequential stream is prefetched without
+//                seeking.  A failed prefetch read only cuts the window
+//                short.  The caller holds the drum's lock.
+//
+// Inputs       : drum - the drum read from
+//                first - the first block read
+//                last - the last block read
+//                data - the contents of the last block
+// Outputs      : none
+
+void read_ahead( SMSA_DRUM_ID drum, SMSA_BLOCK_ID first, SMSA_BLOCK_ID last, unsigned char *data ) {
+  SMSA_BLOCK_ID wanted[SMSA_MAX_BLOCK_ID], fetched[SMSA_MAX_BLOCK_ID];
+  uint32_t count, n, got = 0;
+
+  if ( ( count = smsa_readahead_access( drum, first, last, data, wanted ) ) == 0 ) {
+    return;
+  }
+
+  pthread_mutex_lock( &device_lock );
+  for ( n = 0; n < count; n++ ) {
+    if ( smsa_cache_peek( drum, wanted[n], NULL ) || !smsa_written_test( drum, wanted[n] ) ) {
+      continue;
+    }
+    if ( seek_to( drum, wanted[n] ) ||
+         device_op( SMSA_DISK_READ, drum, wanted[n], smsa_readahead_slot( drum, got ) ) ) {
+      break;
+    }
+    fetched[got++] = wanted[n];
+  }
+  pthread_mutex_unlock( &device_lock );
+
+  smsa_readahead_fill( drum, fetched, got );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : write_block
+// Description  : Write a block and update the cache.  In write back mode the
+//                block is only marked dirty in the cache.  The block is
+//                journaled first, the caller commits once it has unlocked.
+//                The caller holds the drum's lock.
+//
+// Inputs       : drum - the drum to write to
+//                block - the block to write
+//                temp - the SMSA_BLOCK_SIZE buffer holding the block
+// Outputs      : -1 if failure or 0 if successful
+
+int write_block( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block, unsigned char *temp ) {
+  if ( smsa_journal_enabled() && smsa_journal_append( drum, block, temp ) ) {
+    return -1;
+  }
+
+  smsa_written_set( drum, block );
+  smsa_readahead_invalidate( drum, block );
+  if ( ( write_mode == SMSA_WRITE_BACK ) && smsa_cache_enabled() ) {
+    return( smsa_cache_put( drum, block, temp, true ) );
+  }
+
+  if ( flush_block( drum, block, temp ) ) {
+    return -1;
+  }
+
+  return( smsa_cache_put( drum, block, temp, false ) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : flush_block
+// Description  : Write a block to the device, holding the device lock for
+//                the seek and the write.  Any prefetched copy is dropped.
+//                The caller holds the drum's lock.
+//
+// Inputs       : drum - the drum to write to
+//                block - the block to write
+//                data - the SMSA_BLOCK_SIZE buffer holding the block
+// Outputs      : -1 if failure or 0 if successful
+
+int flush_block( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block, unsigned char *data ) {
+  int ret = 0;
+
+  smsa_readahead_invalidate( drum, block );
+  pthread_mutex_lock( &device_lock );
+  if ( seek_to( drum, block ) || device_op( SMSA_DISK_WRITE, drum, block, data ) ) {
+    ret = -1;
+  }
+  pthread_mutex_unlock( &device_lock );
+
+  return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : seek_to
+// Description  : Position the device head over a block, only issuing the
+//                seeks that actually move it.  The caller holds the device
+//                lock.
+//
+// Inputs       : drum - the drum to seek to
+//                block - the block to seek to
+// Outputs      : -1 if failure or 0 if successful
+
+int seek_to( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block ) {
+  if ( !head_known || ( head_drum != drum ) ) {
+    if ( device_op( SMSA_SEEK_DRUM, drum, 0, NULL ) ) {
+      return -1;
+    }
+  }
+
+  if ( head_block != block ) {
+    if ( device_op( SMSA_SEEK_BLOCK, drum, block, NULL ) ) {
+      return -1;
+    }
+  }
 
   return 0;
 }
 
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : drum_transfer
+// Description  : Move a whole drum between the device and a buffer with a
+//                single seek to block 0, letting the device advance the
+//                head through the blocks.  Reads lay the cached copy of
+//                each block over what the device returned, so buffered
+//                writes are seen; the cache is not filled, so a sweep does
+//                not push out the blocks in use.  Writes go to the device
+//                even in write back mode, and refresh (and clean) the
+//                blocks the cache already holds.  Written blocks are
+//                journaled before the device sees them.  Reads stop after
+//                the last block ever written and zero the blocks never
+//                written.  The caller holds the drum's lock.
+//
+// Inputs       : drum - the drum to transfer
+//                buf - the SMSA_DISK_SIZE buffer
+//                write - true to write the drum, false to read it
+// Outputs      : -1 if failure or 0 if successful
+
+int drum_transfer( SMSA_DRUM_ID drum, unsigned char *buf, bool write ) {
+  SMSA_DISK_COMMAND opcode = write ? SMSA_DISK_WRITE : SMSA_DISK_READ;
+  uint32_t span = write ? SMSA_MAX_BLOCK_ID : smsa_written_span( drum );
+  int block, ret = 0;
+
+  for ( block = 0; write && ( block < SMSA_MAX_BLOCK_ID ) && smsa_journal_enabled(); block++ ) {
+    if ( smsa_journal_append( drum, block, &buf[block * SMSA_BLOCK_SIZE] ) ) {
+      return -1;
+    }
+  }
+
+  pthread_mutex_lock( &device_lock );
+  if ( ( span > 0 ) && seek_to( drum, 0 ) ) {
+    ret = -1;
+  }
+  for ( block = 0; ( block < span ) && !ret; block++ ) {
+    ret = device_op( opcode, drum, block, &buf[block * SMSA_BLOCK_SIZE] );
+  }
+  pthread_mutex_unlock( &device_lock );
+  if ( ret ) {
+    return -1;
+  }
+
+  for ( block = 0; block < SMSA_MAX_BLOCK_ID; block++ ) {
+    if ( write ) {
+      smsa_written_set( drum, block );
+      smsa_readahead_invalidate( drum, block );
+      if ( smsa_cache_peek( drum, block, NULL ) &&
+           smsa_cache_put( drum, block, &buf[block * SMSA_BLOCK_SIZE], false ) ) {
+        return -1;
+      }
+    }
+    else if ( !smsa_cache_peek( drum, block, &buf[block * SMSA_BLOCK_SIZE] ) &&
+              !smsa_written_test( drum, block ) ) {
+      memset( &buf[block * SMSA_BLOCK_SIZE], 0x0, SMSA_BLOCK_SIZE );
+      smsa_written_zeroed( drum, 1 );
+    }
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : replay_block
+// Description  : Write a block found in the journal to the device, the
+//                caller (smsa_vmount) holds every lock
+//
+// Inputs       : drum - the drum to write to
+//                block - the block to write
+//                data - the SMSA_BLOCK_SIZE contents
+// Outputs      : -1 if failure or 0 if successful
+
+int replay_block( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block, unsigned char *data ) {
+  if ( seek_to( drum, block ) || device_op( SMSA_DISK_WRITE, drum, block, data ) ) {
+    return -1;
+  }
+  smsa_written_set( drum, block );
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : load_array
+// Description  : Load the array stored by the last checkpoint, before the
+//                journal records after it are replayed.  The caller
+//                (smsa_vmount) holds every lock.
+//
+// Inputs       : none
+// Outputs      : -1 if failure or 0 if successful
+
+int load_array( void ) {
+  if ( SMSALoadArray() ) {
+    logMessage( LOG_ERROR_LEVEL, "Unable to load the array checkpointed in %s", SMSA_DISK_FILE );
+    return -1;
+  }
+  head_known = false;
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : commit_writes
+// Description  : Wait for the journal records of a write to be durable, and
+//                checkpoint once the journal has SMSA_JOURNAL_CHECKPOINT
+//                records.  The caller holds no drum locks.
+//
+// Inputs       : none
+// Outputs      : -1 if failure or 0 if successful
+
+int commit_writes( void ) {
+  int ret = 0;
+
+  if ( !smsa_journal_enabled() ) {
+    return 0;
+  }
+  if ( smsa_journal_commit() ) {
+    return -1;
+  }
+
+  // Another writer may have taken the checkpoint while we waited
+  if ( smsa_journal_size() >= SMSA_JOURNAL_CHECKPOINT ) {
+    lock_drums( 0, SMSA_DISK_ARRAY_SIZE - 1 );
+    if ( smsa_journal_size() >= SMSA_JOURNAL_CHECKPOINT ) {
+      ret = checkpoint();
+    }
+    unlock_drums( 0, SMSA_DISK_ARRAY_SIZE - 1 );
+  }
+  return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : checkpoint
+// Description  : Get every journaled block onto the array, store the array
+//                to SMSA_DISK_FILE and sync it, then empty the journal.
+//                The caller holds every drum lock.
+//
+// Inputs       : none
+// Outputs      : -1 if failure or 0 if successful
+
+int checkpoint( void ) {
+  int fd, ret = 0;
+
+  if ( smsa_journal_commit() || smsa_cache_flush() ) {
+    return -1;
+  }
+
+  pthread_mutex_lock( &device_lock );
+  if ( SMSAStoreArray() ) {
+    logMessage( LOG_ERROR_LEVEL, "Unable to store the array for a checkpoint" );
+    ret = -1;
+  }
+  pthread_mutex_unlock( &device_lock );
+
+  // The stored array has to be on disk before the journal lets go
+  if ( !ret ) {
+    if ( ( ( fd = open( SMSA_DISK_FILE, O_RDONLY ) ) < 0 ) || fsync( fd ) ) {
+      logMessage( LOG_ERROR_LEVEL, "Unable to sync %s for a checkpoint: %s", SMSA_DISK_FILE, strerror( errno ) );
+      ret = -1;
+    }
+    if ( fd >= 0 ) {
+      close( fd );
+    }
+  }
+
+  if ( !ret ) {
+    ret = smsa_journal_checkpoint();
+  }
+  return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : device_op
+// Description  : Issue an operation to the device, count it and follow
+//                where it leaves the head.  A drum seek resets the head to
+//                block 0 and every read or write advances it by one block.
+//                With a trace open the operation is recorded to it.  The
+//                caller holds the device lock.
+//
+// Inputs       : opcode - the operation to perform
+//                drum - the drum id for the instruction
+//                block - the block id for the instruction
+//                temp - the block buffer (NULL if the operation has none)
+// Outputs      : -1 if failure or 0 if successful
+
+int device_op( SMSA_DISK_COMMAND opcode, SMSA_DRUM_ID drum, SMSA_BLOCK_ID block, unsigned char *temp ) {
+  uint32_t instruction = get_instruction( opcode, drum, block );
+  uint64_t start = now_nsecs();
+  int ret = smsa_operation( instruction, temp );
+
+  stats.op_nsecs += now_nsecs() - start;
+  if ( smsa_trace_enabled() && smsa_trace_record( instruction, start, temp ) ) {
+    logMessage( LOG_ERROR_LEVEL, "Device trace stopped, a record could not be written" );
+  }
+  stats.ops[opcode]++;
+  if ( ret ) {
+    head_known = false;
+    return -1;
+  }
+
+  switch ( opcode ) {
+  case SMSA_SEEK_DRUM:
+    stats.seek_drums += ( drum > head_drum ) ? drum - head_drum : head_drum - drum;
+    head_known = true;
+    head_drum = drum;
+    head_block = 0;
+    break;
+
+  case SMSA_SEEK_BLOCK:
+    stats.seek_blocks += ( block > head_block ) ? block - head_block : head_block - block;
+    head_block = block;
+    break;
+
+  case SMSA_DISK_READ:
+    stats.bytes_read += SMSA_BLOCK_SIZE;
+    head_block++;
+    break;
+
+  case SMSA_DISK_WRITE:
+    stats.bytes_written += SMSA_BLOCK_SIZE;
+    head_block++;
+    break;
+
+  default:
+    // Mount, unmount and format all move the head, make the next access seek
+    head_known = false;
+    break;
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : vector_io
+// Description  : Sort the segments by address, merge them into contiguous
+//                runs and transfer each run through a staging buffer.  A
+//                set holding an empty or out of range segment is refused
+//                before anything moves.
+//
+// Inputs       : iov - the segments
+//                iovcnt - the number of segments
+//                write - true to write the segments, false to read them
+// Outputs      : -1 if failure or 0 if successful
+
+int vector_io( SMSA_IOVEC *iov, int iovcnt, bool write ) {
+  SMSA_SEGMENT_ORDER *order;
+  int first, last, ret = 0;
+  uint32_t end;
+
+  if ( iovcnt <= 0 ) {
+    return 0;
+  }
+
+  // Reject the whole request before touching the device
+  for ( first = 0; first < iovcnt; first++ ) {
+    if ( iov[first].len == 0 ) {
+      logMessage( LOG_ERROR_LEVEL, "Vector segment %d is empty (addr=%u)", first, iov[first].addr );
+      return -1;
+    }
+    if ( !valid_address( iov[first].addr, iov[first].len ) ) {
+      return -1;
+    }
+  }
+
+  if ( ( order = malloc( iovcnt * sizeof(SMSA_SEGMENT_ORDER) ) ) == NULL ) {
+    logMessage( LOG_ERROR_LEVEL, "Unable to allocate vector order [%d segments]", iovcnt );
+    return -1;
+  }
+  for ( first = 0; first < iovcnt; first++ ) {
+    order[first].addr = iov[first].addr;
+    order[first].index = first;
+  }
+  qsort( order, iovcnt, sizeof(SMSA_SEGMENT_ORDER), compare_segments );
+
+  // Walk the sorted segments, growing a run while the next one touches it
+  for ( first = 0; ( first < iovcnt ) && !ret; first = last ) {
+    end = order[first].addr + iov[order[first].index].len;
+    for ( last = first + 1; ( last < iovcnt ) && ( order[last].addr <= end ); last++ ) {
+      if ( order[last].addr + iov[order[last].index].len > end ) {
+        end = order[last].addr + iov[order[last].index].len;
+      }
+    }
+
+    ret = vector_run( iov, &order[first], last - first, order[first].addr, end, write );
+  }
+
+  free( order );
+  if ( write && !ret ) {
+    ret = commit_writes();
+  }
+  return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : vector_run
+// Description  : Transfer one contiguous run of segments.  Reads bring in
+//                every block of the run; writes only read the partial blocks
+//                at either end, lay the segments over them in array order
+//                and write every block back.  The drums of the run stay
+//                locked for the whole transfer.
+//
+// Inputs       : iov - all of the segments
+//                members - the sorted entries of the run's segments
+//                count - the number of segments in the run
+//                start - the first address of the run
+//                end - the address just past the run
+//                write - true to write the segments, false to read them
+// Outputs      : -1 if failure or 0 if successful
+
+int vector_run( SMSA_IOVEC *iov, SMSA_SEGMENT_ORDER *members, int count, uint32_t start, uint32_t end, bool write ) {
+  uint32_t first = start / SMSA_BLOCK_SIZE, last = ( end - 1 ) / SMSA_BLOCK_SIZE, n;
+  unsigned char *stage;
+  SMSA_IOVEC *seg;
+  int i, ret = 0;
+
+  if ( ( stage = malloc( ( last - first + 1 ) * SMSA_BLOCK_SIZE ) ) == NULL ) {
+    logMessage( LOG_ERROR_LEVEL, "Unable to allocate vector staging [%u blocks]", last - first + 1 );
+    return -1;
+  }
+  lock_drums( first >> 8, last >> 8 );
+
+  if ( write ) {
+    // Keep the bytes of the edge blocks that the run does not cover
+    if ( ( start % SMSA_BLOCK_SIZE ) &&
+         read_block( first >> 8, first & 0xff, stage ) ) {
+      ret = -1;
+    }
+    if ( !ret && ( end % SMSA_BLOCK_SIZE ) && ( ( last != first ) || !( start % SMSA_BLOCK_SIZE ) ) &&
+         read_block( last >> 8, last & 0xff, &stage[( last - first ) * SMSA_BLOCK_SIZE] ) ) {
+      ret = -1;
+    }
+
+    // Overlapping segments are applied in the order the caller gave them
+    qsort( members, count, sizeof(SMSA_SEGMENT_ORDER), compare_indices );
+    for ( i = 0; ( i < count ) && !ret; i++ ) {
+      seg = &iov[members[i].index];
+      memcpy( &stage[seg->addr - first * SMSA_BLOCK_SIZE], seg->buf, seg->len );
+    }
+
+    for ( n = first; ( n <= last ) && !ret; n++ ) {
+      ret = write_block( n >> 8, n & 0xff, &stage[( n - first ) * SMSA_BLOCK_SIZE] );
+    }
+  }
+  else {
+    for ( n = first; ( n <= last ) && !ret; n++ ) {
+      ret = read_block( n >> 8, n & 0xff, &stage[( n - first ) * SMSA_BLOCK_SIZE] );
+    }
+
+    for ( i = 0; ( i < count ) && !ret; i++ ) {
+      seg = &iov[members[i].index];
+      memcpy( seg->buf, &stage[seg->addr - first * SMSA_BLOCK_SIZE], seg->len );
+    }
+  }
+
+  unlock_drums( first >> 8, last >> 8 );
+  free( stage );
+  return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : compare_segments
+// Description  : qsort comparison ordering segments by address, ties keep
+//                array order
+//
+// Inputs       : a, b - pointers to the segment order entries
+// Outputs      : <0, 0 or >0 as a sorts before, with or after b
+
+int compare_segments( const void *a, const void *b ) {
+  const SMSA_SEGMENT_ORDER *sa = a, *sb = b;
+
+  if ( sa->addr != sb->addr ) {
+    return( ( sa->addr < sb->addr ) ? -1 : 1 );
+  }
+  return( sa->index - sb->index );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : compare_indices
+// Description  : qsort comparison ordering segments by array position
+//
+// Inputs       : a, b - pointers to the segment order entries
+// Outputs      : <0, 0 or >0 as a sorts before, with or after b
+
+int compare_indices( const void *a, const void *b ) {
+  return( ((const SMSA_SEGMENT_ORDER *)a)->index - ((const SMSA_SEGMENT_ORDER *)b)->index );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : init_locks
+// Description  : Create the drum and device locks, run once
+//
+// Inputs       : none
+// Outputs      : none
+
+void init_locks( void ) {
+  int drum;
+
+  for ( drum = 0; drum < SMSA_DISK_ARRAY_SIZE; drum++ ) {
+    pthread_mutex_init( &drum_locks[drum], NULL );
+  }
+  pthread_mutex_init( &device_lock, NULL );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : lock_drums
+// Description  : Lock a range of drums in ascending order.  Each drum lock
+//                covers the drum's cache partition, and the device lock the
+//                head and the counters, so calls for different drums only
+//                serialize on the device itself.  Drum locks are always
+//                taken first, in ascending order, then the device lock.
+//                The cache only tries a drum's lock, to take back a line
+//                the drum holds past its share.
+//
+// Inputs       : first - the first drum to lock
+//                last - the last drum to lock
+// Outputs      : none
+
+void lock_drums( SMSA_DRUM_ID first, SMSA_DRUM_ID last ) {
+  SMSA_DRUM_ID drum;
+
+  pthread_once( &locks_once, init_locks );
+  for ( drum = first; drum <= last; drum++ ) {
+    pthread_mutex_lock( &drum_locks[drum] );
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : unlock_drums
+// Description  : Unlock a range of drums
+//
+// Inputs       : first - the first drum to unlock
+//                last - the last drum to unlock
+// Outputs      : none
+
+void unlock_drums( SMSA_DRUM_ID first, SMSA_DRUM_ID last ) {
+  SMSA_DRUM_ID drum;
+
+  for ( drum = first; drum <= last; drum++ ) {
+    pthread_mutex_unlock( &drum_locks[drum] );
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : last_drum
+// Description  : Get the last drum a transfer touches
+//
+// Inputs       : addr - the first address of the transfer
+//                len - the number of bytes
+// Outputs      : the drum holding the last byte (at least one byte is
+//                always touched, the range was checked by valid_address)
+
+SMSA_DRUM_ID last_drum( uint32_t addr, uint32_t len ) {
+  return( get_drum_id( addr + ( ( len > 0 ) ? len - 1 : 0 ) ) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : now_nsecs
+// Description  : Read the monotonic clock
+//
+// Inputs       : none
+// Outputs      : the current time in nanoseconds
+
+uint64_t now_nsecs( void ) {
+  struct timespec ts;
+
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return( (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec );
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 // Function     : valid_address
-// Description  : Check that the given address is in the range of our device
+// Description  : Check that the given address, and every byte after it up
+//                to len, is in the range of our device
 //
 // Inputs       : addr - the address to check
+//                len - the number of bytes from addr
 // Outputs      : true if in range, false if not
-bool valid_address( uint32_t addr ) {
-  if ( addr > MAX_SMSA_VIRTUAL_ADDRESS) {
-    logMessage( SMSA_BAD_DRUM_ID, "Address for read is out of range");
+bool valid_address( uint32_t addr, uint32_t len ) {
+  if ( ( addr >= MAX_SMSA_VIRTUAL_ADDRESS ) || ( len > MAX_SMSA_VIRTUAL_ADDRESS - addr ) ) {
+    logMessage( LOG_ERROR_LEVEL, "Address is out of range (addr=%u, len=%u)", addr, len );
     return false;
   }
   else {
@@ -221,67 +1365,54 @@ uint32_t get_instruction ( SMSA_DISK_COMMAND opcode, SMSA_DRUM_ID drumId, SMSA_B
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : read
-// Description  : Read the bytes from the temporary buffer into the buffer//
-// Inputs       : len - 
-//                offset -
+// Function     : read_buf
+// Description  : Copy the wanted bytes of a block from the temporary buffer
+//                into the caller's buffer, for the partial blocks at the
+//                ends of a read
+//
+// Inputs       : len - the number of bytes in the whole read
+//                offset - the offset of the read within its first block
 //                firstBlock - checks if first block to account for offset
 //                readBytes - a reference to the number of bytes already read
 //                temp - the temporary buffer which stores the block data
-//                buf - 
-// Outputs      : -1 if failure or the drum id if successful
+//                buf - the caller's buffer
+// Outputs      : none
 
 void read_buf( uint32_t len, SMSA_BLOCK_ID offset, bool firstBlock, int* readBytes, unsigned char* temp, unsigned char* buf ) {
-  int i;
+  uint32_t start = firstBlock ? offset : 0;
+  uint32_t count = SMSA_BLOCK_SIZE - start;
 
-  if (firstBlock) {
-    i = offset;
-  }
-  else {
-    i = 0;
+  if ( count > len - *readBytes ) {
+    count = len - *readBytes;
   }
-
-  do {
-    int index = *readBytes;
-    buf[index] = temp[i];
-    (*readBytes)++;
-    i++;
-  } while( ( i < SMSA_OFFSET_SIZE ) && ( *readBytes < len ) );
-  assert(i <=256);
-
+  memcpy( &buf[*readBytes], &temp[start], count );
+  *readBytes += count;
 }
 
 
 ////////////////////////////////////////////////////////////////////////////////
 //
-// Function     : write
-// Description  : write the bytes given into the buffer
-// Inputs       : len - 
-//                offset -
+// Function     : write_buf
+// Description  : Copy the caller's bytes for a block into the temporary
+//                buffer holding it, for the partial blocks at the ends of a
+//                write
+//
+// Inputs       : len - the number of bytes in the whole write
+//                offset - the offset of the write within its first block
 //                firstBlock - checks if first block to account for offset
-//                readBytes - a reference to the number of bytes already read
+//                writtenBytes - a reference to the number of bytes already
+//                               written
 //                temp - the temporary buffer which stores the block data
-//                buf - 
-// Outputs      : -1 if failure or the drum id if successful
-
+//                buf - the caller's buffer
+// Outputs      : none
 
 void write_buf( uint32_t len, SMSA_BLOCK_ID offset, bool firstBlock, int* writtenBytes, unsigned char* temp, unsigned char* buf ) {
-  int i;
+  uint32_t start = firstBlock ? offset : 0;
+  uint32_t count = SMSA_BLOCK_SIZE - start;
 
-  if (firstBlock) {
-    i = offset;
+  if ( count > len - *writtenBytes ) {
+    count = len - *writtenBytes;
   }
-  else {
-    i = 0;
-  }
-
-  do {
-    int index = *writtenBytes;
-    temp[i] = buf[index];
-    (*writtenBytes)++;
-    i++;
-     
-  } while( ( i < SMSA_OFFSET_SIZE ) && ( *writtenBytes < len ) );
-
+  memcpy( &temp[start], &buf[*writtenBytes], count );
+  *writtenBytes += count;
 }
-
@@ -4,7 +4,8 @@
 ////////////////////////////////////////////////////////////////////////////////
 //
 //  File           : smsa_driver.h
-//  Description    : This is the driver for the SMSA simulator.
+//  Description    : This is the driver for the SMSA simulator.  All of the
+//                   interfaces may be called from several threads at once.
 //
 //   Author        : Patrick McDaniel
 //   Last Modified : Tue Sep 17 07:15:09 EDT 2013
@@ -21,6 +22,38 @@
 // Type Definitions
 typedef uint32_t SMSA_VIRTUAL_ADDRESS; // SMSA Driver Virtual Addresses
 
+// When driver writes reach the device
+typedef enum {
+	SMSA_WRITE_THROUGH	= 0,  // Every write goes to the device immediately
+	SMSA_WRITE_BACK		= 1,  // Writes are held in the cache until flushed
+} SMSA_WRITE_MODE;
+
+// Counters for what the driver sent to the device since the last mount
+typedef struct {
+	uint64_t ops[SMSA_MAX_COMMAND];  // Operations issued, per opcode
+	uint64_t seek_drums;             // Total drums moved by drum seeks
+	uint64_t seek_blocks;            // Total blocks moved by block seeks
+	uint64_t bytes_read;             // Bytes read from the device
+	uint64_t bytes_written;          // Bytes written to the device
+	uint64_t op_nsecs;               // Wall time spent in smsa_operation
+	uint64_t cache_hits;             // Blocks served from the cache
+	uint64_t cache_misses;           // Blocks not found in the cache
+	uint64_t cache_writebacks;       // Dirty blocks written back
+	uint64_t prefetch_blocks;        // Blocks read ahead of a stream
+	uint64_t prefetch_hits;          // Prefetched blocks later read
+	uint64_t prefetch_wasted;        // Prefetched blocks never read
+	uint64_t journal_records;        // Blocks appended to the journal
+	uint64_t journal_commits;        // Journal syncs covering them
+	uint64_t zero_blocks;            // Never-written blocks read as zeros
+} SMSA_DRIVER_STATS;
+
+// A segment of a vectored read or write
+typedef struct {
+	SMSA_VIRTUAL_ADDRESS addr;  // Virtual address of the segment
+	uint32_t len;               // Number of bytes in the segment
+	unsigned char *buf;         // Where the bytes come from or go to
+} SMSA_IOVEC;
+
 
 // Interfaces
 int smsa_vmount( void );
@@ -35,4 +68,43 @@ int smsa_vread( SMSA_VIRTUAL_ADDRESS addr, uint32_t len, unsigned char *buf );
 int smsa_vwrite( SMSA_VIRTUAL_ADDRESS addr, uint32_t len, unsigned char *buf );
 	// Write to the SMSA virtual address space
 
+int smsa_vread_drum( SMSA_DRUM_ID drum, unsigned char *buf );
+	// Read a whole drum (SMSA_DISK_SIZE bytes) as one sequential stream
+
+int smsa_vwrite_drum( SMSA_DRUM_ID drum, unsigned char *buf );
+	// Write a whole drum (SMSA_DISK_SIZE bytes) as one sequential stream
+
+int smsa_vreadv( SMSA_IOVEC *iov, int iovcnt );
+	// Read a set of segments from the SMSA virtual address space
+
+int smsa_vwritev( SMSA_IOVEC *iov, int iovcnt );
+	// Write a set of segments to the SMSA virtual address space
+
+int smsa_vcache_size( uint32_t lines );
+	// Set the block cache capacity used from the next mount (0 disables)
+
+int smsa_vreadahead( uint32_t blocks );
+	// Set the largest read-ahead window per drum used from the next mount (0 disables)
+
+int smsa_vjournal( const char *path );
+	// Set the write-ahead journal file used from the next mount (NULL disables)
+
+int smsa_vwritten( const char *path );
+	// Set the written-block map file used from the next mount (NULL disables)
+
+int smsa_vformat( SMSA_DRUM_ID drum );
+	// Format (zero) a drum
+
+int smsa_vtrace( const char *path, bool hashes );
+	// Record every device operation to a trace file (NULL stops)
+
+int smsa_vwrite_mode( SMSA_WRITE_MODE mode );
+	// Select write through or write back behaviour
+
+int smsa_vflush( void );
+	// Write all buffered blocks to the device (and checkpoint the journal)
+
+int smsa_vstats( SMSA_DRIVER_STATS *stats );
+	// Get the device operation counters since the last mount
+
 #endif
@@ -0,0 +1,991 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : smsa_drvtest.c
+//  Description   : This is the UNIT TEST of the SMSA driver features.  Each
+//                  test mounts and unmounts the array itself, and checks
+//                  what the driver returns against a copy of what it was
+//                  given.
+//
+//   Author :
+//   Last Modified :
+//
+
+// Include Files
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// Project Includes
+#include <smsa_drvtest.h>
+#include <smsa_driver.h>
+#include <smsa_async.h>
+#include <smsa_cache.h>
+#include <smsa_journal.h>
+#include <smsa_written.h>
+#include <smsa_trace.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+// Defines
+#define SMSA_TEST_DRUMS 4                                 // Drums the tests use
+#define SMSA_TEST_SPAN ( SMSA_TEST_DRUMS * SMSA_DISK_SIZE ) // Bytes the tests use
+#define SMSA_TEST_DEPTH 16                                // Async requests in flight
+#define SMSA_TEST_OPS 20000                               // Async requests made
+#define SMSA_TEST_CACHE 160                               // Cache capacity of the cache test
+#define SMSA_TEST_QUEUED 5                                // Requests the C-LOOK test queues
+#define SMSA_TEST_SEGMENTS 3                              // Segments of a vector test call
+#define SMSA_TEST_REGION ( 8 * SMSA_BLOCK_SIZE )          // Bytes the vector test checks
+#define SMSA_TEST_WRITES 6000                             // Writes before the crash
+#define SMSA_TEST_JOURNAL "smsa_test_journal.dat"         // Journal of the crash test
+#define SMSA_TEST_SAVED "smsa_test_data.dat"              // SMSA_DISK_FILE kept meanwhile
+#define SMSA_TEST_WRITTEN "smsa_test_written.dat"         // Map of the written-block test
+#define SMSA_TEST_TRACE "smsa_test_trace.trc"             // Trace of the trace test
+#define SMSA_TEST_TRACED 4                                // Blocks the trace test writes
+
+//
+// Functional Prototypes
+
+int range_test_reject( uint32_t addr, uint32_t len );
+int vector_test_write( SMSA_IOVEC *iov, int count, bool valid, uint64_t blocks );
+int vector_test_check( SMSA_IOVEC *iov, int count );
+int cache_test_pass( SMSA_DRUM_ID drum, uint32_t blocks, bool write, uint64_t misses );
+int async_test_call( SMSA_ASYNC_OP op );
+int async_test_check( SMSA_ASYNC_REQUEST *req, unsigned char *expect );
+int clook_test_order( SMSA_ASYNC_SCHEDULER sched, const int *expect );
+void clook_test_hold( SMSA_ASYNC_REQUEST *req );
+void clook_test_note( SMSA_ASYNC_REQUEST *req );
+int written_test_read( uint32_t addr, unsigned char *expect, bool device );
+int journal_test_crash( void );
+void journal_test_write( int i, uint32_t *addr, uint32_t *len, unsigned char *fill );
+
+//
+// Global data
+static unsigned char test_shadow[SMSA_TEST_SPAN];  // What the array should hold
+static int test_gate[2][2];                        // Pipes to and from a held request
+static int test_order[SMSA_TEST_QUEUED];           // Requests in the order they ran
+static int test_ran;                               // Number of them that have run
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_driver_unit_test
+// Description  : Run every driver UNIT test
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int smsa_driver_unit_test( void ) {
+
+	// Local variables
+	int err = 0;
+
+	logMessage( LOG_INFO_LEVEL, "DRIVER UNIT TEST Beginning ..." );
+	err |= smsa_range_unit_test();
+	err |= smsa_vector_unit_test();
+	err |= smsa_async_unit_test();
+	err |= smsa_cache_unit_test();
+	err |= smsa_clook_unit_test();
+	err |= smsa_written_unit_test();
+	err |= smsa_trace_unit_test();
+	err |= smsa_journal_unit_test();
+
+	if ( err ) {
+		logMessage( LOG_ERROR_LEVEL, "DRIVER UNIT TEST FAILED." );
+		return( -1 );
+	}
+	logMessage( LOG_INFO_LEVEL, "DRIVER UNIT TEST Successful." );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_range_unit_test
+// Description  : Check the driver refuses transfers starting at or running
+//                past the end of the address space, and still moves the
+//                last block of the array
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int smsa_range_unit_test( void ) {
+
+	// Local variables
+	unsigned char pattern[SMSA_BLOCK_SIZE], buf[SMSA_BLOCK_SIZE];
+	uint32_t last = MAX_SMSA_VIRTUAL_ADDRESS - SMSA_BLOCK_SIZE;
+	int err = 0;
+
+	memset( pattern, 0x5a, SMSA_BLOCK_SIZE );
+	if ( smsa_vmount() ) {
+		logMessage( LOG_ERROR_LEVEL, "RANGE UNIT TEST unable to mount" );
+		return( -1 );
+	}
+
+	err |= range_test_reject( MAX_SMSA_VIRTUAL_ADDRESS, SMSA_BLOCK_SIZE );
+	err |= range_test_reject( last, SMSA_MAXIMUM_RDWR_SIZE );
+	err |= range_test_reject( last + 1, SMSA_BLOCK_SIZE );
+	if ( smsa_vwrite( last, SMSA_BLOCK_SIZE, pattern ) || smsa_vread( last, SMSA_BLOCK_SIZE, buf ) ||
+			memcmp( buf, pattern, SMSA_BLOCK_SIZE ) ) {
+		logMessage( LOG_ERROR_LEVEL, "RANGE UNIT TEST lost the last block (addr=%u)", last );
+		err = -1;
+	}
+	err |= smsa_vunmount();
+
+	if ( err ) {
+		logMessage( LOG_ERROR_LEVEL, "RANGE UNIT TEST FAILED." );
+		return( -1 );
+	}
+	logMessage( LOG_INFO_LEVEL, "RANGE UNIT TEST Successful." );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : range_test_reject
+// Description  : Check a read, a write and a one-segment vector read of a
+//                range outside the address space all fail
+//
+// Inputs       : addr - the first address of the range
+//                len - the number of bytes
+// Outputs      : 0 if successful, -1 if failure
+
+int range_test_reject( uint32_t addr, uint32_t len ) {
+
+	// Local variables
+	static unsigned char buf[SMSA_MAXIMUM_RDWR_SIZE];
+	SMSA_IOVEC iov;
+
+	iov.addr = addr;
+	iov.len = len;
+	iov.buf = buf;
+	if ( !smsa_vread( addr, len, buf ) || !smsa_vwrite( addr, len, buf ) || !smsa_vreadv( &iov, 1 ) ) {
+		logMessage( LOG_ERROR_LEVEL, "RANGE UNIT TEST took an out of range transfer (addr=%u, len=%u)", addr, len );
+		return( -1 );
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_vector_unit_test
+// Description  : Write segment sets over the end of drum 0 and the start of
+//                drum 1 and check what the array holds after each, and how
+//                many blocks went to the device.  Overlapping segments must
+//                leave the one latest in the array, touching segments must
+//                merge into one run (across a block and a drum boundary),
+//                and a set with an empty or out of range segment must be
+//                refused whole.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int smsa_vector_unit_test( void ) {
+
+	// Local variables
+	static unsigned char bufs[SMSA_TEST_SEGMENTS][SMSA_MAXIMUM_RDWR_SIZE];
+	const uint32_t base = SMSA_DISK_SIZE - SMSA_TEST_REGION/2;
+	const uint32_t addrs[4][SMSA_TEST_SEGMENTS] = {
+		{ base + 100, base, base + 50 },                    // Overlapping, out of order
+		{ SMSA_DISK_SIZE - 100, SMSA_DISK_SIZE - 400, SMSA_DISK_SIZE + 600 },  // Touching, then apart
+		{ base, base + 300, base + 600 },                   // One empty
+		{ base, MAX_SMSA_VIRTUAL_ADDRESS - 100, base + 600 } };  // One past the end
+	const uint32_t lens[4][SMSA_TEST_SEGMENTS] = {
+		{ 300, 600, 100 }, { 300, 300, 100 }, { 100, 0, 100 }, { 100, 200, 100 } };
+	const bool valid[4] = { true, true, false, false };
+	const uint64_t blocks[4] = { 3, 4, 0, 0 };
+	SMSA_IOVEC iov[SMSA_TEST_SEGMENTS];
+	int i, set, err = 0;
+
+	if ( smsa_vmount() ) {
+		logMessage( LOG_ERROR_LEVEL, "VECTOR UNIT TEST unable to mount" );
+		return( -1 );
+	}
+	memset( &test_shadow[base], 0x0, SMSA_TEST_REGION );
+	err |= smsa_vwrite( base, SMSA_TEST_REGION, &test_shadow[base] );
+
+	for ( set=0; (set<4) && !err; set++ ) {
+		for ( i=0; i<SMSA_TEST_SEGMENTS; i++ ) {
+			iov[i].addr = addrs[set][i];
+			iov[i].len = lens[set][i];
+			iov[i].buf = bufs[i];
+			memset( bufs[i], set * SMSA_TEST_SEGMENTS + i + 1, SMSA_MAXIMUM_RDWR_SIZE );
+		}
+		err |= vector_test_write( iov, SMSA_TEST_SEGMENTS, valid[set], blocks[set] );
+	}
+	err |= smsa_vunmount();
+
+	if ( err ) {
+		logMessage( LOG_ERROR_LEVEL, "VECTOR UNIT TEST FAILED." );
+		return( -1 );
+	}
+	logMessage( LOG_INFO_LEVEL, "VECTOR UNIT TEST Successful." );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : vector_test_write
+// Description  : Write a segment set, check it succeeded or was refused as
+//                expected and wrote the expected number of blocks, then
+//                check the array and a vector read of the same segments
+//
+// Inputs       : iov - the segments
+//                count - the number of segments
+//                valid - true if the write must succeed, false if refused
+//                blocks - the number of blocks the device must be sent
+// Outputs      : 0 if successful, -1 if failure
+
+int vector_test_write( SMSA_IOVEC *iov, int count, bool valid, uint64_t blocks ) {
+
+	// Local variables
+	SMSA_DRIVER_STATS before, after;
+	uint64_t written;
+	int i;
+
+	smsa_vstats( &before );
+	if ( (smsa_vwritev( iov, count ) == 0) != valid ) {
+		logMessage( LOG_ERROR_LEVEL, "VECTOR UNIT TEST write %s (addr=%u)",
+			valid ? "failed" : "was not refused", iov[0].addr );
+		return( -1 );
+	}
+	smsa_vstats( &after );
+
+	written = after.ops[SMSA_DISK_WRITE] - before.ops[SMSA_DISK_WRITE];
+	if ( written != blocks ) {
+		logMessage( LOG_ERROR_LEVEL, "VECTOR UNIT TEST wrote %" PRIu64 " blocks, %" PRIu64 " expected (addr=%u)",
+			written, blocks, iov[0].addr );
+		return( -1 );
+	}
+
+	// Later segments land over earlier ones
+	for ( i=0; (i<count) && valid; i++ ) {
+		memcpy( &test_shadow[iov[i].addr], iov[i].buf, iov[i].len );
+	}
+	return( vector_test_check( iov, valid ? count : 0 ) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : vector_test_check
+// Description  : Check the vector test region holds what the shadow does,
+//                and a vector read of the segments returns it too
+//
+// Inputs       : iov - the segments to read back
+//                count - the number of segments (0 for none)
+// Outputs      : 0 if successful, -1 if failure
+
+int vector_test_check( SMSA_IOVEC *iov, int count ) {
+
+	// Local variables
+	static unsigned char bufs[SMSA_TEST_SEGMENTS][SMSA_MAXIMUM_RDWR_SIZE];
+	unsigned char region[SMSA_TEST_REGION];
+	const uint32_t base = SMSA_DISK_SIZE - SMSA_TEST_REGION/2;
+	SMSA_IOVEC back[SMSA_TEST_SEGMENTS];
+	int i;
+
+	if ( smsa_vread( base, SMSA_TEST_REGION, region ) || memcmp( region, &test_shadow[base], SMSA_TEST_REGION ) ) {
+		logMessage( LOG_ERROR_LEVEL, "VECTOR UNIT TEST array holds the wrong bytes (addr=%u)", base );
+		return( -1 );
+	}
+
+	for ( i=0; i<count; i++ ) {
+		back[i] = iov[i];
+		back[i].buf = bufs[i];
+	}
+	if ( (count > 0) && smsa_vreadv( back, count ) ) {
+		logMessage( LOG_ERROR_LEVEL, "VECTOR UNIT TEST vector read failed" );
+		return( -1 );
+	}
+	for ( i=0; i<count; i++ ) {
+		if ( memcmp( back[i].buf, &test_shadow[back[i].addr], back[i].len ) ) {
+			logMessage( LOG_ERROR_LEVEL, "VECTOR UNIT TEST vector read wrong bytes (addr=%u, len=%u)",
+				back[i].addr, back[i].len );
+			return( -1 );
+		}
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_async_unit_test
+// Description  : Run random reads and writes over a few drums through the
+//                async queue, many in flight at once and often overlapping,
+//                with a flush now and then.  Each read must return what the
+//                writes submitted before it left there.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int smsa_async_unit_test( void ) {
+
+	// Local variables
+	static unsigned char bufs[SMSA_TEST_DEPTH][SMSA_MAXIMUM_RDWR_SIZE];
+	static unsigned char expect[SMSA_TEST_DEPTH][SMSA_MAXIMUM_RDWR_SIZE];
+	SMSA_ASYNC_REQUEST reqs[SMSA_TEST_DEPTH], *req;
+	uint32_t addr, len;
+	int i, slot, err = 0;
+
+	memset( reqs, 0x0, sizeof(reqs) );
+	if ( smsa_async_start() || async_test_call(SMSA_ASYNC_MOUNT) ) {
+		logMessage( LOG_ERROR_LEVEL, "ASYNC UNIT TEST unable to mount" );
+		smsa_async_stop();
+		return( -1 );
+	}
+
+	// Start from zeros, written straight through the driver
+	memset( test_shadow, 0x0, SMSA_TEST_SPAN );
+	for ( addr=0; addr<SMSA_TEST_SPAN; addr+=SMSA_MAXIMUM_RDWR_SIZE ) {
+		err |= smsa_vwrite( addr, SMSA_MAXIMUM_RDWR_SIZE, test_shadow );
+	}
+
+	for ( i=0; (i<SMSA_TEST_OPS) && !err; i++ ) {
+		slot = i % SMSA_TEST_DEPTH;
+		req = &reqs[slot];
+		if ( req->state != SMSA_ASYNC_IDLE ) {
+			err |= async_test_check( req, expect[slot] );
+		}
+		if ( (i % 1000) == 999 ) {
+			err |= async_test_call( SMSA_ASYNC_FLUSH );
+		}
+
+		// Short requests over a small region, so they overlap often.  Large
+		// ranges from getRandomValue can overshoot max, so bound the address.
+		len = getRandomValue( 1, SMSA_MAXIMUM_RDWR_SIZE );
+		addr = getRandomValue( 0, SMSA_TEST_SPAN ) % ( SMSA_TEST_SPAN - len + 1 );
+		req->addr = addr;
+		req->len = len;
+		req->buf = bufs[slot];
+		if ( getRandomValue(0, 1) ) {
+			req->op = SMSA_ASYNC_WRITE;
+			memset( req->buf, getRandomValue(0, 255), len );
+			memcpy( &test_shadow[addr], req->buf, len );
+		} else {
+			req->op = SMSA_ASYNC_READ;
+			memcpy( expect[slot], &test_shadow[addr], len );
+		}
+		err |= smsa_async_submit( req );
+	}
+
+	for ( slot=0; slot<SMSA_TEST_DEPTH; slot++ ) {
+		if ( reqs[slot].state != SMSA_ASYNC_IDLE ) {
+			err |= async_test_check( &reqs[slot], expect[slot] );
+		}
+	}
+	err |= async_test_call( SMSA_ASYNC_UNMOUNT );
+	smsa_async_stop();
+
+	if ( err ) {
+		logMessage( LOG_ERROR_LEVEL, "ASYNC UNIT TEST FAILED." );
+		return( -1 );
+	}
+	logMessage( LOG_INFO_LEVEL, "ASYNC UNIT TEST Successful." );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_cache_unit_test
+// Description  : Fill a small cache from one drum and check the whole
+//                working set, far over one drum's even share, is read back
+//                from the cache.  A second drum then writes a few blocks,
+//                which must take lines back from the first and hit too.
+//                The cache size goes back to the default afterwards.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int smsa_cache_unit_test( void ) {
+
+	// Local variables
+	int err = 0;
+
+	smsa_vcache_size( SMSA_TEST_CACHE );
+	if ( smsa_vmount() ) {
+		logMessage( LOG_ERROR_LEVEL, "CACHE UNIT TEST unable to mount" );
+		err = -1;
+	} else {
+		err |= cache_test_pass( 2, SMSA_TEST_CACHE, true, 0 );
+		err |= cache_test_pass( 2, SMSA_TEST_CACHE, false, 0 );
+		err |= cache_test_pass( 3, 8, true, 0 );
+		err |= cache_test_pass( 3, 8, false, 0 );
+		err |= smsa_vunmount();
+	}
+	smsa_vcache_size( SMSA_DEFAULT_CACHE_LINES );
+
+	if ( err ) {
+		logMessage( LOG_ERROR_LEVEL, "CACHE UNIT TEST FAILED." );
+		return( -1 );
+	}
+	logMessage( LOG_INFO_LEVEL, "CACHE UNIT TEST Successful." );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : cache_test_pass
+// Description  : Write or read back the first blocks of a drum, one block
+//                at a time, each block a different (not uniform) pattern,
+//                and check how many cache misses the pass took
+//
+// Inputs       : drum - the drum
+//                blocks - the number of blocks from block 0
+//                write - true to write the blocks, false to read them back
+//                misses - the cache misses the pass may take
+// Outputs      : 0 if successful, -1 if failure
+
+int cache_test_pass( SMSA_DRUM_ID drum, uint32_t blocks, bool write, uint64_t misses ) {
+
+	// Local variables
+	unsigned char pattern[SMSA_BLOCK_SIZE], buf[SMSA_BLOCK_SIZE];
+	SMSA_DRIVER_STATS before, after;
+	uint32_t addr, block, i;
+
+	smsa_vstats( &before );
+	for ( block=0; block<blocks; block++ ) {
+		addr = drum * SMSA_DISK_SIZE + block * SMSA_BLOCK_SIZE;
+		for ( i=0; i<SMSA_BLOCK_SIZE; i++ ) {
+			pattern[i] = (unsigned char)( i + block + drum );
+		}
+		if ( write ? smsa_vwrite( addr, SMSA_BLOCK_SIZE, pattern ) :
+				( smsa_vread( addr, SMSA_BLOCK_SIZE, buf ) || memcmp( buf, pattern, SMSA_BLOCK_SIZE ) ) ) {
+			logMessage( LOG_ERROR_LEVEL, "CACHE UNIT TEST %s failed (addr=%u)", write ? "write" : "read", addr );
+			return( -1 );
+		}
+	}
+	smsa_vstats( &after );
+
+	if ( after.cache_misses - before.cache_misses > misses ) {
+		logMessage( LOG_ERROR_LEVEL, "CACHE UNIT TEST drum %d took %" PRIu64 " misses over %u blocks",
+			drum, after.cache_misses - before.cache_misses, blocks );
+		return( -1 );
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_clook_unit_test
+// Description  : Check the order the C-LOOK scheduler runs a known queue in,
+//                and that FIFO keeps it in submission order, then run the
+//                random overlap test under C-LOOK with a short deadline so
+//                requests also run out of turn.  Its direct writes must be
+//                queued too.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int smsa_clook_unit_test( void ) {
+
+	// Local variables
+	const int fifo[SMSA_TEST_QUEUED] = { 0, 1, 2, 3, 4 };
+	const int clook[SMSA_TEST_QUEUED] = { 1, 3, 2, 0, 4 };
+	SMSA_ASYNC_STATS stats;
+	int err = 0;
+
+	err |= clook_test_order( SMSA_ASYNC_FIFO, fifo );
+	err |= clook_test_order( SMSA_ASYNC_CLOOK, clook );
+
+	// The counters outlive the worker, every request must have gone through
+	// them, the zero fill the async test writes directly too
+	if ( !err ) {
+		smsa_async_scheduler( SMSA_ASYNC_CLOOK, 1000 );
+		err |= smsa_async_unit_test();
+		smsa_async_stats( &stats );
+		logMessage( LOG_INFO_LEVEL, "CLOOK UNIT TEST ran %" PRIu64 " requests, %" PRIu64 " past their deadline",
+			stats.requests, stats.expired );
+		if ( stats.requests != SMSA_TEST_OPS + SMSA_TEST_SPAN/SMSA_MAXIMUM_RDWR_SIZE ) {
+			logMessage( LOG_ERROR_LEVEL, "CLOOK UNIT TEST queued %" PRIu64 " of %u requests",
+				stats.requests, SMSA_TEST_OPS + SMSA_TEST_SPAN/SMSA_MAXIMUM_RDWR_SIZE );
+			err = -1;
+		}
+	}
+	smsa_async_scheduler( SMSA_ASYNC_FIFO, SMSA_ASYNC_DEADLINE );
+
+	if ( err ) {
+		logMessage( LOG_ERROR_LEVEL, "CLOOK UNIT TEST FAILED." );
+		return( -1 );
+	}
+	logMessage( LOG_INFO_LEVEL, "CLOOK UNIT TEST Successful." );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : clook_test_order
+// Description  : Hold the worker on a request at block 0 while five more
+//                are queued, then check the order they run in.  Request 0
+//                writes blocks 40-41 and request 4 reads blocks 39-40, so
+//                C-LOOK must run it after request 0 although it starts lower.
+//
+// Inputs       : sched - the scheduler to use
+//                expect - the requests in the order they should run
+// Outputs      : 0 if successful, -1 if failure
+
+int clook_test_order( SMSA_ASYNC_SCHEDULER sched, const int *expect ) {
+
+	// Local variables
+	const uint32_t blocks[SMSA_TEST_QUEUED] = { 40, 10, 30, 20, 39 };
+	static int index[SMSA_TEST_QUEUED] = { 0, 1, 2, 3, 4 };
+	const SMSA_ASYNC_OP ops[SMSA_TEST_QUEUED] = { SMSA_ASYNC_WRITE, SMSA_ASYNC_READ,
+		SMSA_ASYNC_READ, SMSA_ASYNC_WRITE, SMSA_ASYNC_READ };
+	static unsigned char bufs[SMSA_TEST_QUEUED+1][2*SMSA_BLOCK_SIZE];
+	SMSA_ASYNC_REQUEST reqs[SMSA_TEST_QUEUED+1];
+	char c = 0;
+	int i, err = 0;
+
+	memset( reqs, 0x0, sizeof(reqs) );
+	test_ran = 0;
+	if ( pipe(test_gate[0]) || pipe(test_gate[1]) ) {
+		return( -1 );
+	}
+	if ( smsa_async_scheduler(sched, 10000000) || smsa_async_start() || async_test_call(SMSA_ASYNC_MOUNT) ) {
+		logMessage( LOG_ERROR_LEVEL, "CLOOK UNIT TEST unable to mount" );
+		err = -1;
+	} else {
+
+		// Wait for the worker to take the held request, then queue the rest
+		reqs[SMSA_TEST_QUEUED].op = SMSA_ASYNC_READ;
+		reqs[SMSA_TEST_QUEUED].len = SMSA_BLOCK_SIZE;
+		reqs[SMSA_TEST_QUEUED].buf = bufs[SMSA_TEST_QUEUED];
+		reqs[SMSA_TEST_QUEUED].callback = clook_test_hold;
+		err |= smsa_async_submit( &reqs[SMSA_TEST_QUEUED] );
+		err |= ( read( test_gate[1][0], &c, 1 ) != 1 );
+		for ( i=0; i<SMSA_TEST_QUEUED; i++ ) {
+			reqs[i].op = ops[i];
+			reqs[i].addr = blocks[i] * SMSA_BLOCK_SIZE;
+			reqs[i].len = 2 * SMSA_BLOCK_SIZE;
+			reqs[i].buf = bufs[i];
+			reqs[i].callback = clook_test_note;
+			reqs[i].arg = &index[i];
+			err |= smsa_async_submit( &reqs[i] );
+		}
+		err |= ( write( test_gate[0][1], &c, 1 ) != 1 );
+		for ( i=0; i<=SMSA_TEST_QUEUED; i++ ) {
+			err |= smsa_async_wait( &reqs[i] );
+		}
+		err |= async_test_call( SMSA_ASYNC_UNMOUNT );
+	}
+	smsa_async_stop();
+	for ( i=0; i<4; i++ ) {
+		close( test_gate[i/2][i%2] );
+	}
+
+	for ( i=0; (i<SMSA_TEST_QUEUED) && !err; i++ ) {
+		if ( test_order[i] != expect[i] ) {
+			logMessage( LOG_ERROR_LEVEL, "CLOOK UNIT TEST %s ran request %d where %d was due",
+				(sched == SMSA_ASYNC_CLOOK) ? "C-LOOK" : "FIFO", test_order[i], expect[i] );
+			err = -1;
+		}
+	}
+	return( err ? -1 : 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : clook_test_hold
+// Description  : Completion callback that holds the worker until the test
+//                has queued its requests
+//
+// Inputs       : req - the request (unused)
+// Outputs      : none
+
+void clook_test_hold( SMSA_ASYNC_REQUEST *req ) {
+
+	// Local variables
+	char c = 0;
+
+	if ( (write( test_gate[1][1], &c, 1 ) != 1) || (read( test_gate[0][0], &c, 1 ) != 1) ) {
+		logMessage( LOG_ERROR_LEVEL, "CLOOK UNIT TEST lost the held request" );
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : clook_test_note
+// Description  : Completion callback noting the order requests run in
+//
+// Inputs       : req - the request, its arg points at its index
+// Outputs      : none
+
+void clook_test_note( SMSA_ASYNC_REQUEST *req ) {
+	if ( test_ran < SMSA_TEST_QUEUED ) {
+		test_order[test_ran++] = *(int *)req->arg;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_written_unit_test
+// Description  : Check blocks never written, or formatted since, read as
+//                zeros without a device read, and that the map kept across
+//                an unmount still tells written blocks from the rest.  With
+//                no map saved only a missing SMSA_DISK_FILE means a new
+//                array, so that file is set aside for that part.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int smsa_written_unit_test( void ) {
+
+	// Local variables
+	unsigned char pattern[SMSA_BLOCK_SIZE], zeros[SMSA_BLOCK_SIZE];
+	uint32_t addr = SMSA_DISK_SIZE;  // First block of drum 1
+	int saved, err = 0;
+	bool present;
+
+	memset( pattern, 0xa5, SMSA_BLOCK_SIZE );
+	memset( zeros, 0x0, SMSA_BLOCK_SIZE );
+	unlink( SMSA_TEST_WRITTEN );
+	smsa_vwritten( SMSA_TEST_WRITTEN );
+
+	// With no map saved an array file may hold anything, until formatted
+	present = ( access( SMSA_DISK_FILE, F_OK ) == 0 );
+	if ( smsa_vmount() ) {
+		logMessage( LOG_ERROR_LEVEL, "WRITTEN UNIT TEST unable to mount" );
+		err = -1;
+	} else {
+		err |= written_test_read( addr, NULL, present );
+		err |= smsa_vformat( 1 );
+		err |= written_test_read( addr, zeros, false );
+		err |= smsa_vwrite( addr, SMSA_BLOCK_SIZE, pattern );
+		err |= written_test_read( addr, pattern, false );
+		err |= smsa_vformat( 1 );
+		err |= written_test_read( addr, zeros, false );
+		err |= smsa_vwrite( addr, SMSA_BLOCK_SIZE, pattern );
+		err |= smsa_vunmount();
+	}
+
+	// The saved map sends only the written block to the device, the cache
+	// went with the unmount
+	if ( !err && smsa_vmount() ) {
+		logMessage( LOG_ERROR_LEVEL, "WRITTEN UNIT TEST unable to remount" );
+		err = -1;
+	} else if ( !err ) {
+		err |= written_test_read( addr, NULL, true );
+		err |= written_test_read( addr + SMSA_BLOCK_SIZE, zeros, false );
+		err |= smsa_vunmount();
+	}
+
+	// With neither a map nor an array file the array is new
+	unlink( SMSA_TEST_WRITTEN );
+	saved = ( rename( SMSA_DISK_FILE, SMSA_TEST_SAVED ) == 0 );
+	if ( !err && smsa_vmount() ) {
+		logMessage( LOG_ERROR_LEVEL, "WRITTEN UNIT TEST unable to mount a new array" );
+		err = -1;
+	} else if ( !err ) {
+		err |= written_test_read( addr, zeros, false );
+		err |= smsa_vunmount();
+	}
+	if ( saved ) {
+		rename( SMSA_TEST_SAVED, SMSA_DISK_FILE );
+	}
+
+	smsa_vwritten( NULL );
+	unlink( SMSA_TEST_WRITTEN );
+
+	if ( err ) {
+		logMessage( LOG_ERROR_LEVEL, "WRITTEN UNIT TEST FAILED." );
+		return( -1 );
+	}
+	logMessage( LOG_INFO_LEVEL, "WRITTEN UNIT TEST Successful." );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : written_test_read
+// Description  : Read a block and check what it held and whether the device
+//                was read for it
+//
+// Inputs       : addr - the address of the block
+//                expect - what the block should hold (NULL not to check)
+//                device - true if the device must be read, false if not
+// Outputs      : 0 if successful, -1 if failure
+
+int written_test_read( uint32_t addr, unsigned char *expect, bool device ) {
+
+	// Local variables
+	unsigned char buf[SMSA_BLOCK_SIZE];
+	SMSA_DRIVER_STATS before, after;
+
+	smsa_vstats( &before );
+	if ( smsa_vread( addr, SMSA_BLOCK_SIZE, buf ) ) {
+		logMessage( LOG_ERROR_LEVEL, "WRITTEN UNIT TEST read failed (addr=%u)", addr );
+		return( -1 );
+	}
+	smsa_vstats( &after );
+
+	if ( (expect != NULL) && memcmp(buf, expect, SMSA_BLOCK_SIZE) ) {
+		logMessage( LOG_ERROR_LEVEL, "WRITTEN UNIT TEST read wrong contents (addr=%u)", addr );
+		return( -1 );
+	}
+	if ( (after.ops[SMSA_DISK_READ] > before.ops[SMSA_DISK_READ]) != device ) {
+		logMessage( LOG_ERROR_LEVEL, "WRITTEN UNIT TEST device read %s (addr=%u)",
+			device ? "missing" : "not needed", addr );
+		return( -1 );
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_trace_unit_test
+// Description  : Record a trace with hashes over a mount, a few block writes
+//                and an unmount, then read it back.  It must hold as many of
+//                each operation as the driver counted, and every write the
+//                hash of the block written.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int smsa_trace_unit_test( void ) {
+
+	// Local variables
+	unsigned char pattern[SMSA_TEST_TRACED * SMSA_BLOCK_SIZE];
+	uint64_t counted[SMSA_MAX_COMMAND], hash;
+	SMSA_DRIVER_STATS stats;
+	SMSA_TRACE_READER tr;
+	SMSA_TRACE_RECORD rec;
+	uint32_t op;
+	int i, ret, err = 0;
+
+	memset( pattern, 0x3c, sizeof(pattern) );
+	hash = smsa_trace_hash( pattern );
+	if ( smsa_vtrace(SMSA_TEST_TRACE, true) || smsa_vmount() ) {
+		logMessage( LOG_ERROR_LEVEL, "TRACE UNIT TEST unable to start" );
+		smsa_vtrace( NULL, false );
+		unlink( SMSA_TEST_TRACE );
+		return( -1 );
+	}
+	err |= smsa_vwrite( 2*SMSA_DISK_SIZE, SMSA_TEST_TRACED*SMSA_BLOCK_SIZE, pattern );
+	err |= smsa_vunmount();
+	err |= smsa_vtrace( NULL, false );
+	smsa_vstats( &stats );
+
+	// Read it back, counting each operation
+	memset( counted, 0x0, sizeof(counted) );
+	if ( err || smsa_trace_read_open(SMSA_TEST_TRACE, &tr) ) {
+		err = -1;
+	} else {
+		while ( (ret = smsa_trace_next( &tr, &rec )) == 1 ) {
+			op = rec.instruction >> 26;
+			if ( (op >= SMSA_MAX_COMMAND) ||
+					((op == SMSA_DISK_WRITE) && (rec.hash != hash)) ||
+					((op != SMSA_DISK_WRITE) && (op != SMSA_DISK_READ) && (rec.hash != 0)) ) {
+				logMessage( LOG_ERROR_LEVEL, "TRACE UNIT TEST bad record (%s, hash %016" PRIx64 ")",
+					smsa_trace_op_name(op), rec.hash );
+				err = -1;
+				break;
+			}
+			counted[op]++;
+		}
+		err |= ret;
+		smsa_trace_read_close( &tr );
+	}
+	unlink( SMSA_TEST_TRACE );
+
+	for ( i=0; (i<SMSA_MAX_COMMAND) && !err; i++ ) {
+		if ( counted[i] != stats.ops[i] ) {
+			logMessage( LOG_ERROR_LEVEL, "TRACE UNIT TEST holds %" PRIu64 " %s, the driver made %" PRIu64,
+				counted[i], smsa_trace_op_name(i), stats.ops[i] );
+			err = -1;
+		}
+	}
+	if ( !err && (counted[SMSA_DISK_WRITE] != SMSA_TEST_TRACED) ) {
+		logMessage( LOG_ERROR_LEVEL, "TRACE UNIT TEST holds %" PRIu64 " writes", counted[SMSA_DISK_WRITE] );
+		err = -1;
+	}
+
+	if ( err ) {
+		logMessage( LOG_ERROR_LEVEL, "TRACE UNIT TEST FAILED." );
+		return( -1 );
+	}
+	logMessage( LOG_INFO_LEVEL, "TRACE UNIT TEST Successful." );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_journal_unit_test
+// Description  : Crash a child process part way through a run of journaled
+//                write back writes, with checkpoints taken along the way,
+//                then mount with the journal and check the array holds
+//                every write, again after a clean unmount and remount.  The
+//                checkpoints store the array over SMSA_DISK_FILE, so the
+//                file there is set aside meanwhile.
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int smsa_journal_unit_test( void ) {
+
+	// Local variables
+	unsigned char buf[SMSA_MAXIMUM_RDWR_SIZE], fill;
+	uint32_t addr, len;
+	int i, pass, saved, err = 0;
+
+	saved = ( rename( SMSA_DISK_FILE, SMSA_TEST_SAVED ) == 0 );
+	unlink( SMSA_TEST_JOURNAL );
+	smsa_vjournal( SMSA_TEST_JOURNAL );
+
+	// What the array should hold once the journal is replayed
+	memset( test_shadow, 0x0, SMSA_TEST_SPAN );
+	for ( i=0; i<SMSA_TEST_WRITES; i++ ) {
+		journal_test_write( i, &addr, &len, &fill );
+		memset( &test_shadow[addr], fill, len );
+	}
+
+	// The first mount recovers from the crash, the second from the unmount
+	if ( journal_test_crash() ) {
+		err = -1;
+	}
+	for ( pass=0; (pass<2) && !err; pass++ ) {
+		if ( smsa_vmount() ) {
+			logMessage( LOG_ERROR_LEVEL, "JOURNAL UNIT TEST unable to mount (pass %d)", pass );
+			err = -1;
+			break;
+		}
+		for ( addr=0; (addr<SMSA_TEST_SPAN) && !err; addr+=SMSA_MAXIMUM_RDWR_SIZE ) {
+			if ( smsa_vread( addr, SMSA_MAXIMUM_RDWR_SIZE, buf ) ||
+					memcmp( buf, &test_shadow[addr], SMSA_MAXIMUM_RDWR_SIZE ) ) {
+				logMessage( LOG_ERROR_LEVEL, "JOURNAL UNIT TEST %s lost a write (addr=%u)",
+						(pass == 0) ? "replay" : "unmount", addr );
+				err = -1;
+			}
+		}
+		err |= smsa_vunmount();
+	}
+
+	smsa_vjournal( NULL );
+	unlink( SMSA_TEST_JOURNAL );
+	if ( saved ) {
+		rename( SMSA_TEST_SAVED, SMSA_DISK_FILE );
+	}
+
+	if ( err ) {
+		logMessage( LOG_ERROR_LEVEL, "JOURNAL UNIT TEST FAILED." );
+		return( -1 );
+	}
+	logMessage( LOG_INFO_LEVEL, "JOURNAL UNIT TEST Successful." );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : journal_test_crash
+// Description  : Make the crash test writes in a child process, which exits
+//                without unmounting.  The journal must never reach
+//                SMSA_JOURNAL_CHECKPOINT records between writes.
+//
+// Inputs       : none
+// Outputs      : 0 if the child made every write, -1 otherwise
+
+int journal_test_crash( void ) {
+
+	// Local variables
+	unsigned char buf[SMSA_MAXIMUM_RDWR_SIZE], fill;
+	uint32_t addr, len;
+	int i, status;
+	pid_t pid;
+
+	fflush( NULL );
+	if ( (pid = fork()) < 0 ) {
+		return( -1 );
+	}
+	if ( pid == 0 ) {
+		memset( buf, 0x0, SMSA_MAXIMUM_RDWR_SIZE );
+		if ( smsa_vwrite_mode(SMSA_WRITE_BACK) || smsa_vmount() ) {
+			_exit( 1 );
+		}
+		for ( addr=0; addr<SMSA_TEST_SPAN; addr+=SMSA_MAXIMUM_RDWR_SIZE ) {
+			if ( smsa_vwrite(addr, SMSA_MAXIMUM_RDWR_SIZE, buf) ) {
+				_exit( 1 );
+			}
+		}
+		for ( i=0; i<SMSA_TEST_WRITES; i++ ) {
+			journal_test_write( i, &addr, &len, &fill );
+			memset( buf, fill, len );
+			if ( smsa_vwrite(addr, len, buf) || (smsa_journal_size() >= SMSA_JOURNAL_CHECKPOINT) ||
+					((i == SMSA_TEST_WRITES/2) && smsa_vflush()) ) {
+				_exit( 1 );
+			}
+		}
+		_exit( 0 );
+	}
+
+	if ( (waitpid( pid, &status, 0 ) != pid) || !WIFEXITED(status) || (WEXITSTATUS(status) != 0) ) {
+		logMessage( LOG_ERROR_LEVEL, "JOURNAL UNIT TEST writer failed before the crash" );
+		return( -1 );
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : journal_test_write
+// Description  : Get the i-th write of the crash test, the same in the child
+//                making it and the parent checking it
+//
+// Inputs       : i - the write
+//                addr - place to put the address written
+//                len - place to put the bytes written
+//                fill - place to put the byte written
+// Outputs      : none
+
+void journal_test_write( int i, uint32_t *addr, uint32_t *len, unsigned char *fill ) {
+	*len = 1 + ( (uint32_t)i * 37 ) % SMSA_MAXIMUM_RDWR_SIZE;
+	*addr = ( (uint32_t)i * 40503 ) % ( SMSA_TEST_SPAN - *len );
+	*fill = (unsigned char)( i + 1 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : async_test_call
+// Description  : Submit an operation with no data and wait for it
+//
+// Inputs       : op - the operation
+// Outputs      : the result of the operation
+
+int async_test_call( SMSA_ASYNC_OP op ) {
+
+	// Local variables
+	SMSA_ASYNC_REQUEST req;
+
+	memset( &req, 0x0, sizeof(req) );
+	req.op = op;
+	if ( smsa_async_submit( &req ) ) {
+		return( -1 );
+	}
+	return( smsa_async_wait( &req ) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : async_test_check
+// Description  : Wait for a request and check a read got what was expected
+//
+// Inputs       : req - the request
+//                expect - what a read should have returned
+// Outputs      : 0 if successful, -1 if failure
+
+int async_test_check( SMSA_ASYNC_REQUEST *req, unsigned char *expect ) {
+
+	// Local variables
+	int err;
+
+	err = smsa_async_wait( req );
+	req->state = SMSA_ASYNC_IDLE;
+	if ( err ) {
+		logMessage( LOG_ERROR_LEVEL, "ASYNC UNIT TEST request failed (addr=%u, len=%u)", req->addr, req->len );
+		return( -1 );
+	}
+	if ( (req->op == SMSA_ASYNC_READ) && memcmp(req->buf, expect, req->len) ) {
+		logMessage( LOG_ERROR_LEVEL, "ASYNC UNIT TEST read out of order (addr=%u, len=%u)", req->addr, req->len );
+		return( -1 );
+	}
+	return( 0 );
+}
@@ -0,0 +1,51 @@
+#ifndef SMSA_DRVTEST_INCLUDED
+#define SMSA_DRVTEST_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : smsa_drvtest.h
+//  Description   : This is the UNIT TEST of the SMSA driver features, run
+//                  by smsasim -t.
+//
+//   Author :
+//   Last Modified :
+//
+
+// Include Files
+
+// Project Includes
+#include <smsa.h>
+
+// Defines
+
+//
+// Functional Prototypes
+
+int smsa_driver_unit_test( void );
+	// Run every driver UNIT test, -1 if any failed
+
+int smsa_range_unit_test( void );
+	// Check transfers past the end of the address space are refused
+
+int smsa_vector_unit_test( void );
+	// Check vectored writes merge touching segments and let later ones win
+
+int smsa_async_unit_test( void );
+	// Check the async queue keeps overlapping requests in submission order
+
+int smsa_cache_unit_test( void );
+	// Check one drum can use the whole cache, and another take lines back
+
+int smsa_clook_unit_test( void );
+	// Check the order C-LOOK runs requests in, and that it keeps overlaps ordered
+
+int smsa_written_unit_test( void );
+	// Check never-written blocks read as zeros without the device
+
+int smsa_trace_unit_test( void );
+	// Check a recorded trace holds every device operation and block hash
+
+int smsa_journal_unit_test( void );
+	// Check the journal brings back the writes of a process that crashed
+
+#endif
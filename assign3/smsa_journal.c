@@ -0,0 +1,404 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : smsa_journal.c
+//  Description    : This is the write-ahead journal of the SMSA driver.
+//                   Appended records collect in a buffer.  A writer waiting
+//                   for its records either finds a commit running, and waits
+//                   for the one after it, or becomes the committer: it swaps
+//                   in the spare buffer so appends carry on, writes out and
+//                   syncs everything collected, then wakes the waiters.
+//                   A checkpoint overwrites the first record with the base
+//                   record before cutting the file back to it, so a crash
+//                   part way leaves either the old records or the new base.
+//
+//   Author        :
+//   Last Modified :
+//
+
+// Include Files
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// Project Include Files
+#include <smsa_journal.h>
+#include <cmpsc311_log.h>
+
+// Defines
+#define SMSA_JOURNAL_MAGIC 0x534a524e      // "SJRN"
+#define SMSA_JOURNAL_BUFFER 64             // Records each buffer starts with
+#define SMSA_JOURNAL_BLOCK 0               // Record kind: the contents of a block
+#define SMSA_JOURNAL_BASE 1                // Record kind: the array was stored here
+
+//
+// Type Definitions
+
+// One record in the journal file
+typedef struct {
+  uint32_t magic;                          // SMSA_JOURNAL_MAGIC
+  uint32_t seq;                            // Position in the file, from 1
+  uint8_t drum;                            // Drum of the block
+  uint8_t kind;                            // SMSA_JOURNAL_BLOCK or SMSA_JOURNAL_BASE
+  uint16_t block;                          // Block in the drum
+  uint32_t sum;                            // Checksum of the rest of the record
+  unsigned char data[SMSA_BLOCK_SIZE];     // Contents of the block
+} SMSA_JOURNAL_RECORD;
+
+// A buffer of records waiting to be written
+typedef struct {
+  SMSA_JOURNAL_RECORD *records;
+  uint32_t count, size;
+} SMSA_JOURNAL_BUFFER_T;
+
+// Functional Prototypes
+uint32_t journal_sum( SMSA_JOURNAL_RECORD *rec );
+int journal_write( SMSA_JOURNAL_BUFFER_T *buf );
+
+//
+// Global data
+static int journal_fd = -1;
+static pthread_mutex_t journal_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t journal_synced = PTHREAD_COND_INITIALIZER; // a commit finished
+static SMSA_JOURNAL_BUFFER_T journal_bufs[2];
+static SMSA_JOURNAL_BUFFER_T *journal_active = &journal_bufs[0];  // takes appends
+static SMSA_JOURNAL_BUFFER_T *journal_spare = &journal_bufs[1];   // being written
+static uint64_t journal_appended = 0;      // records appended since open
+static uint64_t journal_durable = 0;       // records known to be on disk
+static uint64_t journal_commits = 0;       // fdatasyncs since open
+static uint32_t journal_seq = 0;           // last record in the file
+static bool journal_committing = false;
+static bool journal_failed = false;
+
+// Interfaces
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_journal_open
+// Description  : Open (creating) the journal and apply the records it holds
+//                in order, after loading the stored array if the journal
+//                starts with a base record.  Reading stops at the first
+//                record that is torn or out of sequence, and the file is cut
+//                back to the good records so new ones follow them.
+//
+// Inputs       : path - the journal file
+//                load - called first if the journal starts from a checkpoint
+//                replay - called with each block record found
+// Outputs      : the number of records replayed, -1 if failure
+
+int smsa_journal_open( const char *path, SMSA_JOURNAL_LOAD load, SMSA_JOURNAL_REPLAY replay ) {
+  SMSA_JOURNAL_RECORD rec;
+  int count = 0, replayed = 0;
+  ssize_t n;
+
+  smsa_journal_close();
+  if ( ( journal_fd = open( path, O_RDWR|O_CREAT, 0644 ) ) < 0 ) {
+    logMessage( LOG_ERROR_LEVEL, "Unable to open journal [%s]: %s", path, strerror( errno ) );
+    return -1;
+  }
+
+  while ( ( ( n = read( journal_fd, &rec, sizeof(rec) ) ) == sizeof(rec) ) &&
+          ( rec.magic == SMSA_JOURNAL_MAGIC ) && ( rec.seq == count + 1 ) &&
+          ( rec.sum == journal_sum( &rec ) ) && ( rec.drum < SMSA_DISK_ARRAY_SIZE ) &&
+          ( rec.block < SMSA_MAX_BLOCK_ID ) &&
+          ( ( rec.kind == SMSA_JOURNAL_BLOCK ) || ( ( rec.kind == SMSA_JOURNAL_BASE ) && ( count == 0 ) ) ) ) {
+    if ( ( rec.kind == SMSA_JOURNAL_BASE ) ? load() : replay( rec.drum, rec.block, rec.data ) ) {
+      logMessage( LOG_ERROR_LEVEL, "Journal replay failed at record %d", count + 1 );
+      close( journal_fd );
+      journal_fd = -1;
+      return -1;
+    }
+    replayed += ( rec.kind == SMSA_JOURNAL_BLOCK );
+    count++;
+  }
+  if ( ( ftruncate( journal_fd, (off_t)count * sizeof(rec) ) ) ||
+       ( lseek( journal_fd, (off_t)count * sizeof(rec), SEEK_SET ) < 0 ) ) {
+    logMessage( LOG_ERROR_LEVEL, "Unable to trim journal [%s]: %s", path, strerror( errno ) );
+    close( journal_fd );
+    journal_fd = -1;
+    return -1;
+  }
+
+  journal_seq = count;
+  journal_appended = journal_durable = journal_commits = 0;
+  journal_failed = false;
+  return( replayed );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_journal_close
+// Description  : Commit what is outstanding and close the journal.  The
+//                records stay, so the next open replays them over the array
+//                stored by the last checkpoint.  The counters are kept until
+//                the next open.
+//
+// Inputs       : none
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_journal_close( void ) {
+  int ret = 0;
+
+  if ( journal_fd < 0 ) {
+    return 0;
+  }
+  if ( smsa_journal_commit() ) {
+    ret = -1;
+  }
+  close( journal_fd );
+  journal_fd = -1;
+  free( journal_bufs[0].records );
+  free( journal_bufs[1].records );
+  memset( journal_bufs, 0x0, sizeof(journal_bufs) );
+
+  return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_journal_enabled
+// Description  : Check whether a journal is open
+//
+// Inputs       : none
+// Outputs      : true if writes are being journaled
+
+bool smsa_journal_enabled( void ) {
+  return( journal_fd >= 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_journal_append
+// Description  : Add a record for a block to the active buffer, it is not
+//                durable until a commit
+//
+// Inputs       : drum - the drum of the block
+//                block - the block in the drum
+//                data - the SMSA_BLOCK_SIZE contents being written
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_journal_append( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block, unsigned char *data ) {
+  SMSA_JOURNAL_BUFFER_T *buf;
+  SMSA_JOURNAL_RECORD *rec, *grown;
+  uint32_t size;
+
+  pthread_mutex_lock( &journal_lock );
+  buf = journal_active;
+  if ( buf->count == buf->size ) {
+    size = ( buf->size == 0 ) ? SMSA_JOURNAL_BUFFER : buf->size * 2;
+    if ( ( grown = realloc( buf->records, size * sizeof(SMSA_JOURNAL_RECORD) ) ) == NULL ) {
+      pthread_mutex_unlock( &journal_lock );
+      logMessage( LOG_ERROR_LEVEL, "Unable to grow journal buffer [%u records]", size );
+      return -1;
+    }
+    buf->records = grown;
+    buf->size = size;
+  }
+
+  rec = &buf->records[buf->count++];
+  rec->magic = SMSA_JOURNAL_MAGIC;
+  rec->seq = ++journal_seq;
+  rec->drum = drum;
+  rec->kind = SMSA_JOURNAL_BLOCK;
+  rec->block = block;
+  memcpy( rec->data, data, SMSA_BLOCK_SIZE );
+  rec->sum = journal_sum( rec );
+  journal_appended++;
+  pthread_mutex_unlock( &journal_lock );
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_journal_commit
+// Description  : Wait until every record appended before the call is on
+//                disk, committing them (and whatever else has collected)
+//                if no commit is running
+//
+// Inputs       : none
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_journal_commit( void ) {
+  SMSA_JOURNAL_BUFFER_T *buf;
+  uint64_t target, upto;
+  int ret;
+
+  pthread_mutex_lock( &journal_lock );
+  target = journal_appended;
+  while ( ( journal_durable < target ) && !journal_failed ) {
+    if ( journal_committing ) {
+      pthread_cond_wait( &journal_synced, &journal_lock );
+      continue;
+    }
+
+    // Take everything collected and let appends go to the spare buffer
+    journal_committing = true;
+    buf = journal_active;
+    journal_active = journal_spare;
+    journal_spare = buf;
+    upto = journal_appended;
+    pthread_mutex_unlock( &journal_lock );
+
+    ret = journal_write( buf );
+
+    pthread_mutex_lock( &journal_lock );
+    buf->count = 0;
+    journal_commits++;
+    journal_committing = false;
+    if ( ret ) {
+      journal_failed = true;
+    }
+    else {
+      journal_durable = upto;
+    }
+    pthread_cond_broadcast( &journal_synced );
+  }
+  ret = journal_failed ? -1 : 0;
+  pthread_mutex_unlock( &journal_lock );
+
+  return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_journal_checkpoint
+// Description  : Start the journal over from a base record.  Call it once
+//                every block journaled has reached the array and the array
+//                has been stored; the caller keeps new records out meanwhile.
+//
+// Inputs       : none
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_journal_checkpoint( void ) {
+  SMSA_JOURNAL_RECORD rec;
+  int ret = 0;
+
+  if ( journal_fd < 0 ) {
+    return 0;
+  }
+  if ( smsa_journal_commit() ) {
+    return -1;
+  }
+
+  memset( &rec, 0x0, sizeof(rec) );
+  rec.magic = SMSA_JOURNAL_MAGIC;
+  rec.seq = 1;
+  rec.kind = SMSA_JOURNAL_BASE;
+  rec.sum = journal_sum( &rec );
+
+  // The base goes over the first record before the rest is cut away
+  pthread_mutex_lock( &journal_lock );
+  while ( journal_committing ) {
+    pthread_cond_wait( &journal_synced, &journal_lock );
+  }
+  if ( ( pwrite( journal_fd, &rec, sizeof(rec), 0 ) != sizeof(rec) ) || fdatasync( journal_fd ) ||
+       ftruncate( journal_fd, sizeof(rec) ) || ( lseek( journal_fd, sizeof(rec), SEEK_SET ) < 0 ) ||
+       fdatasync( journal_fd ) ) {
+    logMessage( LOG_ERROR_LEVEL, "Unable to checkpoint journal: %s", strerror( errno ) );
+    journal_failed = true;
+    ret = -1;
+  }
+  else {
+    journal_seq = 1;
+  }
+  pthread_mutex_unlock( &journal_lock );
+
+  return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_journal_size
+// Description  : Get the number of records in the journal file, counting
+//                those still being committed
+//
+// Inputs       : none
+// Outputs      : the number of records
+
+uint32_t smsa_journal_size( void ) {
+  uint32_t size;
+
+  pthread_mutex_lock( &journal_lock );
+  size = journal_seq;
+  pthread_mutex_unlock( &journal_lock );
+
+  return( size );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_journal_stats
+// Description  : Get the records appended and the commits (fdatasyncs) made
+//                since the journal was opened
+//
+// Inputs       : records - place to put the number of records
+//                commits - place to put the number of commits
+// Outputs      : none
+
+void smsa_journal_stats( uint64_t *records, uint64_t *commits ) {
+  pthread_mutex_lock( &journal_lock );
+  *records = journal_appended;
+  *commits = journal_commits;
+  pthread_mutex_unlock( &journal_lock );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : journal_sum
+// Description  : Checksum a record (FNV-1a over everything but the sum)
+//
+// Inputs       : rec - the record
+// Outputs      : the checksum
+
+uint32_t journal_sum( SMSA_JOURNAL_RECORD *rec ) {
+  unsigned char *p = (unsigned char *)rec;
+  uint32_t sum = 2166136261u;
+  size_t i;
+
+  for ( i = 0; i < sizeof(SMSA_JOURNAL_RECORD); i++ ) {
+    if ( ( i < offsetof(SMSA_JOURNAL_RECORD, sum) ) ||
+         ( i >= offsetof(SMSA_JOURNAL_RECORD, sum) + sizeof(rec->sum) ) ) {
+      sum = ( sum ^ p[i] ) * 16777619u;
+    }
+  }
+
+  return( sum );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : journal_write
+// Description  : Append a buffer of records to the file and sync it
+//
+// Inputs       : buf - the records to write
+// Outputs      : -1 if failure or 0 if successful
+
+int journal_write( SMSA_JOURNAL_BUFFER_T *buf ) {
+  unsigned char *p = (unsigned char *)buf->records;
+  size_t len = buf->count * sizeof(SMSA_JOURNAL_RECORD);
+  ssize_t n;
+
+  while ( len > 0 ) {
+    if ( ( n = write( journal_fd, p, len ) ) < 0 ) {
+      if ( errno == EINTR ) {
+        continue;
+      }
+      logMessage( LOG_ERROR_LEVEL, "Unable to write journal: %s", strerror( errno ) );
+      return -1;
+    }
+    p += n;
+    len -= n;
+  }
+  if ( fdatasync( journal_fd ) ) {
+    logMessage( LOG_ERROR_LEVEL, "Unable to sync journal: %s", strerror( errno ) );
+    return -1;
+  }
+
+  return 0;
+}
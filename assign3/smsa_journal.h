@@ -0,0 +1,71 @@
+#ifndef SMSA_JOURNAL_INCLUDED
+#define SMSA_JOURNAL_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : smsa_journal.h
+//  Description    : This is the write-ahead journal of the SMSA driver.
+//                   Every block written is appended to the journal file as
+//                   a checksummed record, and a write is acknowledged once
+//                   its records are on disk.  Records appended while a
+//                   commit is in progress are made durable together by the
+//                   next one, so concurrent writers share each fdatasync
+//                   (group commit).  A checkpoint, taken once the array has
+//                   been stored to SMSA_DISK_FILE, starts the file over with
+//                   a single base record.  At mount a base record has the
+//                   stored array loaded, the records after it are replayed
+//                   onto the array.  A clean unmount takes a checkpoint, so
+//                   the next mount loads the array it stored.
+//
+//   Author        :
+//   Last Modified :
+//
+
+// Include Files
+#include <stdint.h>
+#include <stdbool.h>
+
+// Project Include Files
+#include <smsa.h>
+
+// Defines
+#define SMSA_JOURNAL_FILE "smsa_journal.dat" // Default journal, next to SMSA_DISK_FILE
+#define SMSA_JOURNAL_CHECKPOINT 4096 // Records that bring a checkpoint (about the array's size)
+
+//
+// Type Definitions
+
+// Called at open to apply each record found in the journal
+typedef int (*SMSA_JOURNAL_REPLAY)( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block, unsigned char *data );
+
+// Called at open, before any replay, when the journal starts from a checkpoint
+typedef int (*SMSA_JOURNAL_LOAD)( void );
+
+//
+// Interfaces
+
+int smsa_journal_open( const char *path, SMSA_JOURNAL_LOAD load, SMSA_JOURNAL_REPLAY replay );
+	// Open the journal, replaying its records, returns the number replayed (-1 on failure)
+
+int smsa_journal_close( void );
+	// Commit outstanding records and close the journal, keeping them
+
+bool smsa_journal_enabled( void );
+	// Is a journal open?
+
+int smsa_journal_append( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block, unsigned char *data );
+	// Add a record for a block about to be written
+
+int smsa_journal_commit( void );
+	// Wait until every record appended so far is on disk
+
+int smsa_journal_checkpoint( void );
+	// Drop every record, the array they were written to has been stored
+
+uint32_t smsa_journal_size( void );
+	// Get the number of records in the journal file
+
+void smsa_journal_stats( uint64_t *records, uint64_t *commits );
+	// Get the records appended and the fdatasyncs made since open
+
+#endif
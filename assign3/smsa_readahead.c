@@ -0,0 +1,331 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : smsa_readahead.c
+//  Description    : This is the read-ahead window used by the SMSA driver.
+//                   Each drum has its own stream detector and window, so
+//                   callers holding a drum's lock can use it without
+//                   touching the other drums.
+//
+//   Author        :
+//   Last Modified :
+//
+
+// Include Files
+#include <stdlib.h>
+#include <string.h>
+
+// Project Include Files
+#include <smsa_readahead.h>
+#include <cmpsc311_log.h>
+
+// Defines
+
+//
+// Type Definitions
+
+// The stream detector, window and counters of one drum
+typedef struct {
+  unsigned char *data;                  // max_depth + 1 block buffers
+  SMSA_BLOCK_ID block[SMSA_MAX_BLOCK_ID + 1]; // Block held in each slot
+  bool valid[SMSA_MAX_BLOCK_ID + 1];    // Slot still matches the device
+  bool used[SMSA_MAX_BLOCK_ID + 1];     // Slot has been read from
+  uint32_t count;                       // Slots in the window
+  uint32_t depth;                       // Blocks to prefetch next time
+  bool missed;                          // Did a block of this read miss?
+  bool seen;                            // Has the drum been read yet?
+  SMSA_BLOCK_ID first, last;            // Blocks of the last read
+  int stride;                           // Distance between the last two reads
+  uint32_t run;                         // Reads in a row following the stream
+  uint64_t prefetched, hits, wasted;
+} SMSA_READAHEAD_WINDOW;
+
+// Functional Prototypes
+uint32_t readahead_retire( SMSA_READAHEAD_WINDOW *win );
+
+//
+// Global data
+static SMSA_READAHEAD_WINDOW readahead_drums[SMSA_DISK_ARRAY_SIZE];
+static uint32_t readahead_max = 0;  // largest window, 0 when disabled
+
+// Interfaces
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_readahead_init
+// Description  : Create a window of up to max_depth blocks for each drum,
+//                plus a slot for the last block read
+//
+// Inputs       : max_depth - the largest window in blocks (0 disables)
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_readahead_init( uint32_t max_depth ) {
+  SMSA_READAHEAD_WINDOW *win;
+  int drum;
+
+  smsa_readahead_close();
+  for ( drum = 0; drum < SMSA_DISK_ARRAY_SIZE; drum++ ) {
+    readahead_drums[drum].prefetched = 0;
+    readahead_drums[drum].hits = readahead_drums[drum].wasted = 0;
+  }
+  if ( max_depth == 0 ) {
+    return 0;
+  }
+  if ( max_depth > SMSA_MAX_BLOCK_ID ) {
+    max_depth = SMSA_MAX_BLOCK_ID;
+  }
+
+  for ( drum = 0; drum < SMSA_DISK_ARRAY_SIZE; drum++ ) {
+    win = &readahead_drums[drum];
+    if ( ( win->data = malloc( ( max_depth + 1 ) * SMSA_BLOCK_SIZE ) ) == NULL ) {
+      logMessage( LOG_ERROR_LEVEL, "Unable to allocate read-ahead window [%u blocks]", max_depth );
+      smsa_readahead_close();
+      return -1;
+    }
+    win->depth = ( max_depth < SMSA_READAHEAD_MIN_DEPTH ) ? max_depth : SMSA_READAHEAD_MIN_DEPTH;
+  }
+  readahead_max = max_depth;
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_readahead_close
+// Description  : Release the windows, blocks never read count as wasted.
+//                The counters are kept until the next init.
+//
+// Inputs       : none
+// Outputs      : none
+
+void smsa_readahead_close( void ) {
+  SMSA_READAHEAD_WINDOW *win, saved;
+  int drum;
+
+  for ( drum = 0; drum < SMSA_DISK_ARRAY_SIZE; drum++ ) {
+    win = &readahead_drums[drum];
+    win->wasted += readahead_retire( win );
+    saved = *win;
+    free( win->data );
+    memset( win, 0x0, sizeof(SMSA_READAHEAD_WINDOW) );
+    win->prefetched = saved.prefetched;
+    win->hits = saved.hits;
+    win->wasted = saved.wasted;
+  }
+  readahead_max = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_readahead_get
+// Description  : Look up a block in the drum's window, a block that is not
+//                there will be read from the device
+//
+// Inputs       : drum - the drum of the block
+//                block - the block within the drum
+// Outputs      : pointer to the prefetched block data or NULL if not held
+
+unsigned char * smsa_readahead_get( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block ) {
+  SMSA_READAHEAD_WINDOW *win = &readahead_drums[drum];
+  uint32_t slot;
+
+  for ( slot = 0; slot < win->count; slot++ ) {
+    if ( ( win->block[slot] == block ) && win->valid[slot] ) {
+      if ( !win->used[slot] ) {
+        win->used[slot] = true;
+        win->hits++;
+      }
+      return( &win->data[slot * SMSA_BLOCK_SIZE] );
+    }
+  }
+  win->missed = true;
+
+  return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_readahead_access
+// Description  : Note a read of a run of blocks.  A read continues the
+//                stream if it starts in or just after the block the last
+//                read ended in (sequential), or the same distance after the
+//                last read's start as that read was after the one before
+//                (strided).  From the third read in a stream, a read that
+//                missed the window or took its last block starts a new
+//                window: the old one is retired (adapting the depth) and
+//                the blocks the next reads of the stream would touch, up to
+//                the end of the drum, are returned to fetch.  The last block
+//                read heads the new window, since the next read in a
+//                stream of small reads usually starts in it.
+//
+// Inputs       : drum - the drum read from
+//                first - the first block read
+//                last - the last block read
+//                data - the contents of the last block
+//                blocks - place for the blocks to prefetch (max_depth long)
+// Outputs      : the number of blocks to prefetch
+
+uint32_t smsa_readahead_access( SMSA_DRUM_ID drum, SMSA_BLOCK_ID first, SMSA_BLOCK_ID last, unsigned char *data, SMSA_BLOCK_ID *blocks ) {
+  SMSA_READAHEAD_WINDOW *win = &readahead_drums[drum];
+  int stride = (int)first - (int)win->first;
+  uint32_t n, wasted, emptied, next, len = last - first + 1;
+  bool missed = win->missed, sequential, consumed;
+
+  win->missed = false;
+  if ( readahead_max == 0 ) {
+    return 0;
+  }
+
+  // Follow the stream
+  sequential = win->seen && ( first >= win->last ) && ( first <= win->last + 1 );
+  if ( sequential || ( win->seen && ( stride == win->stride ) && ( stride > 0 ) &&
+       ( stride <= SMSA_READAHEAD_MAX_STRIDE ) ) ) {
+    win->run++;
+  }
+  else {
+    win->run = 0;
+  }
+  win->stride = stride;
+  win->seen = true;
+  win->first = first;
+  win->last = last;
+
+  consumed = ( win->count > 0 ) && ( win->block[win->count - 1] >= first ) &&
+    ( win->block[win->count - 1] <= last );
+  if ( ( win->run < 2 ) || !( missed || consumed ) ) {
+    return 0;
+  }
+
+  // Shrink after waste, grow when a whole window was read
+  emptied = win->count;
+  wasted = readahead_retire( win );
+  win->wasted += wasted;
+  if ( wasted > 0 ) {
+    win->depth = ( win->depth / 2 < SMSA_READAHEAD_MIN_DEPTH ) ? SMSA_READAHEAD_MIN_DEPTH : win->depth / 2;
+  }
+  else if ( emptied > 1 ) {
+    win->depth = ( win->depth * 2 > readahead_max ) ? readahead_max : win->depth * 2;
+  }
+  if ( win->depth > readahead_max ) {
+    win->depth = readahead_max;
+  }
+  memcpy( win->data, data, SMSA_BLOCK_SIZE );
+  win->block[0] = last;
+  win->valid[0] = win->used[0] = true;
+  win->count = 1;
+
+  // The blocks after this read, or those of the next reads at the stride
+  n = 0;
+  for ( next = last + 1; sequential && ( n < win->depth ) && ( next < SMSA_MAX_BLOCK_ID ); next++ ) {
+    blocks[n++] = next;
+  }
+  for ( next = first + stride; !sequential && ( n < win->depth ) && ( next < SMSA_MAX_BLOCK_ID ); next++ ) {
+    if ( ( next > last ) && ( ( next - first ) % stride < len ) ) {
+      blocks[n++] = next;
+    }
+  }
+
+  return( n );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_readahead_slot
+// Description  : Get the buffer a prefetched block is read into, after the
+//                slot holding the last block read
+//
+// Inputs       : drum - the drum being prefetched
+//                slot - the position of the block in the list to prefetch
+// Outputs      : pointer to the SMSA_BLOCK_SIZE slot buffer
+
+unsigned char * smsa_readahead_slot( SMSA_DRUM_ID drum, uint32_t slot ) {
+  return( &readahead_drums[drum].data[( slot + 1 ) * SMSA_BLOCK_SIZE] );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_readahead_fill
+// Description  : Install the blocks read into the slots as the drum's window
+//
+// Inputs       : drum - the drum being prefetched
+//                blocks - the block read into each slot
+//                count - the number of slots filled
+// Outputs      : none
+
+void smsa_readahead_fill( SMSA_DRUM_ID drum, SMSA_BLOCK_ID *blocks, uint32_t count ) {
+  SMSA_READAHEAD_WINDOW *win = &readahead_drums[drum];
+  uint32_t slot;
+
+  for ( slot = 0; slot < count; slot++ ) {
+    win->block[slot + 1] = blocks[slot];
+    win->valid[slot + 1] = true;
+    win->used[slot + 1] = false;
+  }
+  win->count = count + 1;
+  win->prefetched += count;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_readahead_invalidate
+// Description  : Drop a block from the drum's window, its contents are about
+//                to change on the device
+//
+// Inputs       : drum - the drum of the block
+//                block - the block within the drum
+// Outputs      : none
+
+void smsa_readahead_invalidate( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block ) {
+  SMSA_READAHEAD_WINDOW *win = &readahead_drums[drum];
+  uint32_t slot;
+
+  for ( slot = 0; slot < win->count; slot++ ) {
+    if ( win->block[slot] == block ) {
+      win->valid[slot] = false;
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_readahead_stats
+// Description  : Get the prefetched, hit and wasted block counts since init,
+//                summed over the drums.  Blocks still in a window are not
+//                yet counted as wasted.
+//
+// Inputs       : prefetched - place to put the number of blocks prefetched
+//                hits - place to put the number of prefetched blocks read
+//                wasted - place to put the number never read
+// Outputs      : none
+
+void smsa_readahead_stats( uint64_t *prefetched, uint64_t *hits, uint64_t *wasted ) {
+  int drum;
+
+  *prefetched = *hits = *wasted = 0;
+  for ( drum = 0; drum < SMSA_DISK_ARRAY_SIZE; drum++ ) {
+    *prefetched += readahead_drums[drum].prefetched;
+    *hits += readahead_drums[drum].hits;
+    *wasted += readahead_drums[drum].wasted;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : readahead_retire
+// Description  : Empty a window
+//
+// Inputs       : win - the drum's window
+// Outputs      : the number of blocks in it that were never read (blocks
+//                dropped by a write are not counted)
+
+uint32_t readahead_retire( SMSA_READAHEAD_WINDOW *win ) {
+  uint32_t slot, wasted = 0;
+
+  for ( slot = 0; slot < win->count; slot++ ) {
+    if ( win->valid[slot] && !win->used[slot] ) {
+      wasted++;
+    }
+  }
+  win->count = 0;
+
+  return( wasted );
+}
@@ -0,0 +1,60 @@
+#ifndef SMSA_READAHEAD_INCLUDED
+#define SMSA_READAHEAD_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : smsa_readahead.h
+//  Description    : This is the read-ahead window used by the SMSA driver.
+//                   Each drum watches the reads it is asked for, looking
+//                   for a forward stream from one read to the next
+//                   (sequential or a fixed stride) and, once one is seen,
+//                   the driver reads the next blocks of the stream into the
+//                   drum's window while the head is already there.  The
+//                   depth doubles while windows are used up and halves when
+//                   prefetched blocks go unused.  Like the cache, calls for
+//                   the same drum must not run concurrently.
+//
+//   Author        :
+//   Last Modified :
+//
+
+// Include Files
+#include <stdint.h>
+#include <stdbool.h>
+
+// Project Include Files
+#include <smsa.h>
+
+// Defines
+#define SMSA_DEFAULT_READAHEAD 32  // Default largest window in blocks
+#define SMSA_READAHEAD_MIN_DEPTH 4 // Smallest (and first) window in blocks
+#define SMSA_READAHEAD_MAX_STRIDE 8 // Largest stride followed, in blocks
+
+//
+// Interfaces
+
+int smsa_readahead_init( uint32_t max_depth );
+	// Create the windows, up to max_depth blocks each (0 disables read-ahead)
+
+void smsa_readahead_close( void );
+	// Release the windows (counters are kept, unused blocks count as wasted)
+
+unsigned char * smsa_readahead_get( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block );
+	// Return the prefetched contents of a block, or NULL if not in the window
+
+uint32_t smsa_readahead_access( SMSA_DRUM_ID drum, SMSA_BLOCK_ID first, SMSA_BLOCK_ID last, unsigned char *data, SMSA_BLOCK_ID *blocks );
+	// Note a read of a run of blocks, returns the number of blocks to prefetch
+
+unsigned char * smsa_readahead_slot( SMSA_DRUM_ID drum, uint32_t slot );
+	// The buffer to read the given prefetched block into
+
+void smsa_readahead_fill( SMSA_DRUM_ID drum, SMSA_BLOCK_ID *blocks, uint32_t count );
+	// Install the first count blocks read into the slots in the new window
+
+void smsa_readahead_invalidate( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block );
+	// Drop a block from the window because it is being written
+
+void smsa_readahead_stats( uint64_t *prefetched, uint64_t *hits, uint64_t *wasted );
+	// Get the prefetched, hit and wasted block counts since init
+
+#endif
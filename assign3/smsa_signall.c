@@ -0,0 +1,251 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : smsa_signall.c
+//  Description    : This is the parallel block signature sweep for the SMSA
+//                   tools.  The array is read through the driver one drum at
+//                   a time, a pool of threads (or the calling thread alone)
+//                   hashes the blocks as their drum arrives and the calling
+//                   thread logs the signatures in drum/block order.
+//
+//   Author        :
+//   Last Modified :
+//
+
+// Include Files
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <gcrypt.h>
+
+// Project Include Files
+#include <smsa_signall.h>
+#include <smsa_driver.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+// Defines
+#define SMSA_SIGNALL_BLOCKS ( SMSA_DISK_ARRAY_SIZE * SMSA_MAX_BLOCK_ID )
+#define SMSA_SIGNALL_STRLEN 80  // CMPSC311_HASH_LENGTH*4 for SHA1, as SMSABlockSign
+
+//
+// Type Definitions
+
+// The state shared by the sweep and its hashing threads
+typedef struct {
+  unsigned char *array;             // The contents of every block, drum by drum
+  char (*sigs)[SMSA_SIGNALL_STRLEN]; // The signature string of every block
+  bool *signed_blocks;              // Which signature strings are ready
+  int ready;                        // Blocks read in so far
+  int next;                         // Next block to hand to a thread
+  pthread_mutex_t lock;
+  pthread_cond_t changed;           // More blocks read in or signed
+} SMSA_SIGNALL_SWEEP;
+
+// Functional Prototypes
+void * signall_worker( void *arg );
+int signall_serial( void );
+void signall_device( int first );
+void signall_hash( unsigned char *block, char *str );
+
+// Interfaces
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_signall
+// Description  : Sign every block of the mounted array.  The libcmpsc311
+//                signature helper shares one hash handle between callers, so
+//                the blocks are hashed with gcrypt directly using the same
+//                algorithm, and the result formatted with bufToString
+//                exactly as SMSABlockSign does.  Buffered writes must be
+//                flushed first, the signatures are of the blocks as the
+//                driver reads them.
+//
+// Inputs       : threads - the number of hashing threads (0 hashes on the
+//                calling thread)
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_signall( int threads ) {
+  pthread_t tids[SMSA_SIGNALL_MAX_THREADS];
+  SMSA_SIGNALL_SWEEP sweep;
+  int started = 0, drum, block, ret = 0;
+
+  if ( threads <= 0 ) {
+    return( signall_serial() );
+  }
+  if ( threads > SMSA_SIGNALL_MAX_THREADS ) {
+    threads = SMSA_SIGNALL_MAX_THREADS;
+  }
+
+  sweep.array = malloc( SMSA_SIGNALL_BLOCKS * SMSA_BLOCK_SIZE );
+  sweep.sigs = malloc( SMSA_SIGNALL_BLOCKS * SMSA_SIGNALL_STRLEN );
+  sweep.signed_blocks = calloc( SMSA_SIGNALL_BLOCKS, sizeof(bool) );
+  if ( ( sweep.array == NULL ) || ( sweep.sigs == NULL ) || ( sweep.signed_blocks == NULL ) ) {
+    logMessage( LOG_ERROR_LEVEL, "Unable to allocate signature sweep, signing serially" );
+    free( sweep.array );
+    free( sweep.sigs );
+    free( sweep.signed_blocks );
+    return( signall_serial() );
+  }
+  sweep.ready = sweep.next = 0;
+  pthread_mutex_init( &sweep.lock, NULL );
+  pthread_cond_init( &sweep.changed, NULL );
+
+  // The helper would do this on its first call, the threads need it first
+  gcry_check_version( NULL );
+  for ( started = 0; started < threads; started++ ) {
+    if ( pthread_create( &tids[started], NULL, signall_worker, &sweep ) ) {
+      break;
+    }
+  }
+
+  // Read the drums in order, releasing each to the threads as it arrives
+  for ( drum = 0; ( drum < SMSA_DISK_ARRAY_SIZE ) && !ret; drum++ ) {
+    ret = smsa_vread_drum( drum, &sweep.array[drum * SMSA_DISK_SIZE] );
+
+    pthread_mutex_lock( &sweep.lock );
+    sweep.ready = ret ? SMSA_SIGNALL_BLOCKS : ( drum + 1 ) * SMSA_MAX_BLOCK_ID;
+    if ( ret || ( started == 0 ) ) {
+      // Nothing left for the threads to do (or no threads to do it)
+      sweep.next = SMSA_SIGNALL_BLOCKS;
+    }
+    pthread_cond_broadcast( &sweep.changed );
+    pthread_mutex_unlock( &sweep.lock );
+  }
+
+  // Log the signatures in order as the threads finish them
+  for ( block = 0; ( block < SMSA_SIGNALL_BLOCKS ) && !ret && ( started > 0 ); block++ ) {
+    pthread_mutex_lock( &sweep.lock );
+    while ( !sweep.signed_blocks[block] ) {
+      pthread_cond_wait( &sweep.changed, &sweep.lock );
+    }
+    pthread_mutex_unlock( &sweep.lock );
+
+    logMessage( LOG_OUTPUT_LEVEL, "SIG(drum,block) %2d %3d : %s",
+        block / SMSA_MAX_BLOCK_ID, block % SMSA_MAX_BLOCK_ID, sweep.sigs[block] );
+  }
+
+  while ( started > 0 ) {
+    pthread_join( tids[--started], NULL );
+  }
+  pthread_cond_destroy( &sweep.changed );
+  pthread_mutex_destroy( &sweep.lock );
+  free( sweep.array );
+  free( sweep.sigs );
+  free( sweep.signed_blocks );
+
+  // If the pool or the reads failed, fall back to the device's own signing
+  if ( ret || ( block < SMSA_SIGNALL_BLOCKS ) ) {
+    logMessage( LOG_WARNING_LEVEL, "Parallel signature sweep failed, signing on the device" );
+    signall_device( 0 );
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : signall_worker
+// Description  : Hash blocks as they are read in, until every block has
+//                been handed out
+//
+// Inputs       : arg - the sweep
+// Outputs      : NULL
+
+void * signall_worker( void *arg ) {
+  SMSA_SIGNALL_SWEEP *sweep = arg;
+  int block;
+
+  while ( true ) {
+    pthread_mutex_lock( &sweep->lock );
+    while ( ( sweep->next >= sweep->ready ) && ( sweep->next < SMSA_SIGNALL_BLOCKS ) ) {
+      pthread_cond_wait( &sweep->changed, &sweep->lock );
+    }
+    if ( sweep->next >= SMSA_SIGNALL_BLOCKS ) {
+      pthread_mutex_unlock( &sweep->lock );
+      break;
+    }
+    block = sweep->next++;
+    pthread_mutex_unlock( &sweep->lock );
+
+    signall_hash( &sweep->array[block * SMSA_BLOCK_SIZE], sweep->sigs[block] );
+
+    pthread_mutex_lock( &sweep->lock );
+    sweep->signed_blocks[block] = true;
+    pthread_cond_broadcast( &sweep->changed );
+    pthread_mutex_unlock( &sweep->lock );
+  }
+
+  return NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : signall_serial
+// Description  : Sign every block on the calling thread, reading the array a
+//                drum at a time.  If a read fails the rest of the array is
+//                signed on the device.
+//
+// Inputs       : none
+// Outputs      : 0 (always successful, as the original loop)
+
+int signall_serial( void ) {
+  char str[SMSA_SIGNALL_STRLEN];
+  unsigned char *data;
+  int drum, block;
+
+  if ( ( data = malloc( SMSA_DISK_SIZE ) ) == NULL ) {
+    logMessage( LOG_ERROR_LEVEL, "Unable to allocate signature sweep, signing on the device" );
+    signall_device( 0 );
+    return 0;
+  }
+
+  gcry_check_version( NULL );
+  for ( drum = 0; drum < SMSA_DISK_ARRAY_SIZE; drum++ ) {
+    if ( smsa_vread_drum( drum, data ) ) {
+      logMessage( LOG_WARNING_LEVEL, "Signature sweep read failed, signing on the device" );
+      signall_device( drum );
+      break;
+    }
+    for ( block = 0; block < SMSA_MAX_BLOCK_ID; block++ ) {
+      signall_hash( &data[block * SMSA_BLOCK_SIZE], str );
+      logMessage( LOG_OUTPUT_LEVEL, "SIG(drum,block) %2d %3d : %s", drum, block, str );
+    }
+  }
+  free( data );
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : signall_device
+// Description  : Sign blocks one at a time on the device
+//
+// Inputs       : first - the first drum to sign, the rest follow
+// Outputs      : none
+
+void signall_device( int first ) {
+  int drum, block;
+
+  for ( drum = first; drum < SMSA_DISK_ARRAY_SIZE; drum++ ) {
+    for ( block = 0; block < SMSA_MAX_BLOCK_ID; block++ ) {
+      SMSABlockSign( drum, block );
+    }
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : signall_hash
+// Description  : Get the signature string of a block, as SMSABlockSign logs it
+//
+// Inputs       : block - the SMSA_BLOCK_SIZE block
+//                str - the SMSA_SIGNALL_STRLEN place to put the string
+// Outputs      : none
+
+void signall_hash( unsigned char *block, char *str ) {
+  unsigned char sig[SMSA_SIGNALL_STRLEN];
+
+  gcry_md_hash_buffer( CMPSC311_HASH_TYPE, sig, block, SMSA_BLOCK_SIZE );
+  bufToString( sig, CMPSC311_HASH_LENGTH, (unsigned char *)str, SMSA_SIGNALL_STRLEN );
+}
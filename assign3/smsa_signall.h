@@ -0,0 +1,30 @@
+#ifndef SMSA_SIGNALL_INCLUDED
+#define SMSA_SIGNALL_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : smsa_signall.h
+//  Description    : This is the parallel block signature sweep for the SMSA
+//                   tools.  It logs the same SIG(drum,block) lines, in the
+//                   same order, as calling SMSABlockSign on every block.
+//
+//   Author        :
+//   Last Modified :
+//
+
+// Include Files
+
+// Project Include Files
+#include <smsa.h>
+
+// Defines
+#define SMSA_SIGNALL_MAX_THREADS 64 // Most hashing threads in the pool
+
+//
+// Interfaces
+
+int smsa_signall( int threads );
+	// Sign every block of the mounted array using a pool of hashing threads
+	// (0 threads hashes on the calling thread)
+
+#endif
@@ -9,7 +9,9 @@
 
 // Include Files
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
@@ -20,32 +22,58 @@
 // Project Includes
 #include <smsa.h>
 #include <smsa_unittest.h>
+#include <smsa_drvtest.h>
 #include <smsa_driver.h>
+#include <smsa_journal.h>
+#include <smsa_written.h>
+#include <smsa_workload.h>
+#include <smsa_signall.h>
+#include <smsa_trace.h>
 #include <cmpsc311_log.h>
+#include <cmpsc311_alog.h>
 #include <cmpsc311_util.h>
 
 // Defines
-#define SMSA_ARGUMENTS "huvl:"
+#define SMSA_COMBINE_SIZE 16384 // Largest combined write, under a drum so it stays cached
+#define SMSA_ARGUMENTS "hutval:c:wp:r:jzT:HW"
 #define USAGE \
-	"USAGE: smsa [-h] [-u] [-v] [-l <logfile>] <workload-file>\n" \
+	"USAGE: smsa [-h] [-u] [-t] [-v] [-a] [-l <logfile>] [-c <blocks>] [-w] [-p <threads>] [-r <blocks>] [-j] [-z] [-T <tracefile>] [-H] [-W] <workload-file>\n" \
 	"\n" \
 	"where:\n" \
 	"    -h - help mode (display this message)\n" \
 	"    -u - run the SMSA unit test\n" \
+	"    -t - run the driver unit tests (exits -1 if one fails)\n" \
 	"    -v - verbose output\n" \
+	"    -a - write the log from a background thread (asynchronous)\n" \
 	"    -l - write log messages to the filename <logfile>\n" \
+	"    -c - size of the driver block cache in blocks (0 disables)\n" \
+	"    -w - buffer writes in the driver cache (write back)\n" \
+	"    -p - hash SIGNALL block signatures on <threads> threads\n" \
+	"    -r - largest driver read-ahead window in blocks (0 disables)\n" \
+	"    -j - journal writes to " SMSA_JOURNAL_FILE ", replaying it at mount\n" \
+	"    -z - read never-written blocks as zeros, keeping the map in " SMSA_WRITTEN_FILE "\n" \
+	"    -T - record every device operation to the trace <tracefile>\n" \
+	"    -H - add a hash of each block read or written to the trace\n" \
+	"    -W - combine contiguous WRITEs into one driver call\n" \
 	"\n" \
-	"    <workload-file> - file contain the workload to simulate\n" \
+	"    <workload-file> - file contain the workload to simulate (text or binary)\n" \
 	"\n" \
 
 //
 // Global Data
 int verbose;
+int signall_threads = 0;
+int combine_writes = 0;
+unsigned char combine_buf[SMSA_COMBINE_SIZE]; // Pending combined WRITE bytes
+uint32_t combine_addr, combine_len = 0;        // Where they go (none if len 0)
 
 //
 // Functional Prototypes
 
 int simulate_SMSA( char *wload );
+int combine_write( uint32_t addr, uint32_t len, uint32_t ch );
+int combine_flush( void );
+void log_driver_stats( void );
 
 //
 // Functions
@@ -62,7 +90,8 @@ int simulate_SMSA( char *wload );
 int main( int argc, char *argv[] )
 {
 	// Local variables
-	int ch, verbose = 0, log_initialized = 0, unit_test = 0;
+	int ch, verbose = 0, log_initialized = 0, unit_test = 0, driver_test = 0, async_log = 0, trace_hashes = 0;
+	char *trace_file = NULL;
 
 	// Process the command line parameters
 	while ((ch = getopt(argc, argv, SMSA_ARGUMENTS)) != -1) {
@@ -80,11 +109,55 @@ int main( int argc, char *argv[] )
 			unit_test = 1;
 			break;
 
+		case 't': // Run the driver unit tests
+			driver_test = 1;
+			break;
+
+		case 'a': // Asynchronous logging
+			async_log = 1;
+			break;
+
 		case 'l': // Set the log filename
 			initializeLogWithFilename( optarg );
 			log_initialized = 1;
 			break;
 
+		case 'c': // Set the driver cache size
+			smsa_vcache_size( strtoul(optarg, NULL, 10) );
+			break;
+
+		case 'w': // Write back mode
+			smsa_vwrite_mode( SMSA_WRITE_BACK );
+			break;
+
+		case 'p': // Parallel signature sweeps
+			signall_threads = atoi( optarg );
+			break;
+
+		case 'r': // Set the driver read-ahead depth
+			smsa_vreadahead( strtoul(optarg, NULL, 10) );
+			break;
+
+		case 'j': // Write-ahead journal
+			smsa_vjournal( SMSA_JOURNAL_FILE );
+			break;
+
+		case 'z': // Written-block map
+			smsa_vwritten( SMSA_WRITTEN_FILE );
+			break;
+
+		case 'T': // Record a device operation trace
+			trace_file = optarg;
+			break;
+
+		case 'H': // Hash the blocks in the trace
+			trace_hashes = 1;
+			break;
+
+		case 'W': // Write combining
+			combine_writes = 1;
+			break;
+
 		default:  // Default (unknown)
 			fprintf( stderr, "Unknown command line option (%c), aborting.\n", ch );
 			return( -1 );
@@ -98,6 +171,15 @@ int main( int argc, char *argv[] )
 	if ( verbose ) {
 		enableLogLevels( LOG_INFO_LEVEL );
 	}
+	if ( async_log && enableAsyncLog() ) {
+		logMessage( LOG_WARNING_LEVEL, "Unable to start the asynchronous log, logging synchronously" );
+	}
+
+	// If running the driver UNIT tests
+	if ( driver_test ) {
+		enableLogLevels( LOG_INFO_LEVEL );
+		return( smsa_driver_unit_test() );
+	}
 
 	// If running the UNIT test
 	if ( unit_test ) {
@@ -118,6 +200,10 @@ int main( int argc, char *argv[] )
 		}
 
 		// Run the simulation
+		if ( (trace_file != NULL) && smsa_vtrace( trace_file, trace_hashes ) ) {
+			fprintf( stderr, "Unable to record the trace [%s], aborting.\n", trace_file );
+			return( -1 );
+		}
 		if ( simulate_SMSA(argv[optind]) == 0 ) {
 
 			// Program completed successfully
@@ -129,6 +215,9 @@ int main( int argc, char *argv[] )
 			logMessage( LOG_INFO_LEVEL, "SMSA simulation failed.\n\n" );
 
 		}
+		if ( (trace_file != NULL) && smsa_vtrace(NULL, 0) ) {
+			logMessage( LOG_ERROR_LEVEL, "Trace [%s] is incomplete, a record could not be written.", trace_file );
+		}
 	}
 
 	// Return successfully
@@ -146,113 +235,215 @@ int main( int argc, char *argv[] )
 int simulate_SMSA( char *wload ) {
 
 	// Local variables
-	char line[256], cmd[32];
 	unsigned char buf[SMSA_MAXIMUM_RDWR_SIZE], sig[CMPSC311_HASH_LENGTH], sigstr[CMPSC311_HASH_LENGTH*4];
-	FILE *fhandle = NULL;
+	SMSA_WORKLOAD_FILE wf;
+	SMSA_WORKLOAD_CMD cmd;
 	uint32_t addr, len, ch, slen;
-	int i, j, err;
+	int err, more;
 
-	// Open the workload file
-	if ( (fhandle=fopen(wload, "r")) == NULL ) {
-		logMessage( LOG_ERROR_LEVEL, "Failure opening the workload file [%s], error: %s.\n",
-			wload, strerror(errno) );
+	// Map the workload file, commands are parsed in place as we go
+	if ( smsa_workload_open(wload, &wf) ) {
 		return( -1 );
 	}
 
 	// While file not done
-	while (!feof(fhandle)) {
+	while ( (more = smsa_workload_next(&wf, &cmd)) == 1 ) {
+		addr = cmd.addr;
+		len = cmd.len;
+		ch = cmd.ch;
+
+		// Combined writes go out before any other command, keeping the
+		// device seeing the workload's order
+		if ( (cmd.op != SMSA_WL_WRITE) && (err = combine_flush()) ) {
+			logMessage( LOG_ERROR_LEVEL, "Virtual array failed, aborting [%d]", err );
+			smsa_workload_close( &wf );
+			return( -1 );
+		}
 
-		// Get the line and bail out on fail
-		if ( fgets(line, 256, fhandle) != NULL ) {
+		switch ( cmd.op ) {
+		case SMSA_WL_MOUNT:
+			logMessage( LOG_INFO_LEVEL, "Calling virtual driver mount ");
+			err = smsa_vmount();
+			break;
 
-			// Check for mount
-			if ( strncmp(SMSA_WORKLOAD_MOUNT,line,strlen(SMSA_WORKLOAD_MOUNT)) == 0 ) {
-				logMessage( LOG_INFO_LEVEL, "Calling virtual driver mount ");
-				err = smsa_vmount();
-			}
+		case SMSA_WL_UNMOUNT:
+			logMessage( LOG_INFO_LEVEL, "Calling virtual driver unmount ");
+			err = smsa_vunmount();
+			break;
+
+		case SMSA_WL_SIGNALL:
+			logMessage( LOG_INFO_LEVEL, "Computing signatures on the array.");
 
-			// Check for mount
-			else if ( strncmp(SMSA_WORKLOAD_UNMOUNT,line,strlen(SMSA_WORKLOAD_UNMOUNT)) == 0 ) {
-				logMessage( LOG_INFO_LEVEL, "Calling virtual driver unmount ");
-				err = smsa_vunmount();
+			// The signatures are taken from the device, so buffered writes
+			// have to get there first
+			if ( (err = smsa_vflush()) ) {
+				logMessage( LOG_ERROR_LEVEL, "Virtual array flush failed, aborting [%d]", err );
+				smsa_workload_close( &wf );
+				return( -1 );
 			}
 
-			// Check for mount
-			else if ( strncmp(SMSA_WORKLOAD_SIGNALL,line,strlen(SMSA_WORKLOAD_SIGNALL)) == 0 ) {
-				logMessage( LOG_INFO_LEVEL, "Computing signatures on the array.");
+			// Now just test the disk block signature generation
+			smsa_signall( signall_threads );
+			break;
 
-				// Now just test the disk block signature generation
-				for ( i=0; i<SMSA_DISK_ARRAY_SIZE; i++ ) {
-					for ( j=0; j<SMSA_MAX_BLOCK_ID; j++ ) {
-						SMSABlockSign( i, j );
-					}
-				}
-			}
+		case SMSA_WL_READ:
+			logMessage( LOG_INFO_LEVEL, "Calling virtual driver read (addr=%x, len=%u)", addr, len);
 
-			else {
+			// Do the read, fingerprint the returned buffer so we can validate
+			if ( !(err = smsa_vread( addr, len, buf )) ) {
 
-				// Parse out the command
-				if ( sscanf( line, "%7s %7u %4u %3u", cmd, &addr, &len, &ch ) != 4 ) {
-					logMessage( LOG_ERROR_LEVEL, "Error parsing virtual command [%s\n]", line );
-					fclose( fhandle );
+				// Setup and do signature
+				slen = CMPSC311_HASH_LENGTH;
+				memset( sig, 0x0, slen );
+				if ( generate_md5_signature( buf, len, sig, &slen) ) {
+					logMessage( LOG_ERROR_LEVEL, "SIM Signature failed (%u)", addr );
+					smsa_workload_close( &wf );
 					return( -1 );
 				}
 
-				// Check for read
-				if ( strncmp(SMSA_WORKLOAD_READ, cmd, strlen(SMSA_WORKLOAD_READ)) == 0 ) {
-					logMessage( LOG_INFO_LEVEL, "Calling virtual driver read (addr=%x, len=%u)", addr, len);
-
-					// Do the read, fingerprint the returned buffer so we can validate
-					if ( !(err = smsa_vread( addr, len, buf )) ) {
-
-						// Setup and do signature
-						slen = CMPSC311_HASH_LENGTH;
-						memset( sig, 0x0, slen );
-						if ( generate_md5_signature( buf, len, sig, &slen) ) {
-							logMessage( LOG_ERROR_LEVEL, "SIM Signature failed (%lu)", addr );
-							return( -1 );
-						}
-
-						// Log the signature
-						bufToString( sig, slen, sigstr, CMPSC311_HASH_LENGTH*4 );
-						logMessage( LOG_INFO_LEVEL, "READ SIG : %lu len %lu - %s", addr, len, sigstr );
-
-					} else {
-						// Print out error
-						logMessage( LOG_ERROR_LEVEL, "Read failed (%lu,len=%lu)", addr, len );
-					}
-				}
+				// Log the signature
+				bufToString( sig, slen, sigstr, CMPSC311_HASH_LENGTH*4 );
+				logMessage( LOG_INFO_LEVEL, "READ SIG : %u len %u - %s", addr, len, sigstr );
 
-				// Check for write
-				else if ( strncmp(SMSA_WORKLOAD_WRITE, cmd, strlen(SMSA_WORKLOAD_WRITE)) == 0 ) {
+			} else {
+				// Print out error
+				logMessage( LOG_ERROR_LEVEL, "Read failed (%u,len=%u)", addr, len );
+			}
+			break;
 
-					// Now setup the buffer and make the call
-					logMessage( LOG_INFO_LEVEL, "Calling virtual driver write (addr=%x, len=%u, ch=%u)", addr, len, ch);
-					memset( buf, ch, len );
-					err = smsa_vwrite( addr, len, buf );
-				}
+		case SMSA_WL_WRITE:
+			// Now setup the buffer and make the call
+			logMessage( LOG_INFO_LEVEL, "Calling virtual driver write (addr=%x, len=%u, ch=%u)", addr, len, ch);
+			if ( combine_writes ) {
+				err = combine_write( addr, len, ch );
+				break;
+			}
+			memset( buf, ch, len );
+			err = smsa_vwrite( addr, len, buf );
+			break;
+		}
+
+		// Check for the virtual level failing
+		if ( err ) {
+			logMessage( LOG_ERROR_LEVEL, "Virtual array failed, aborting [%d]", err );
+			smsa_workload_close( &wf );
+			return( -1 );
+		}
+	}
 
-				else {
+	// Unmap the workload file, bail out if a line could not be parsed
+	smsa_workload_close( &wf );
+	if ( combine_flush() ) {
+		logMessage( LOG_ERROR_LEVEL, "Virtual array failed, aborting [-1]" );
+		return( -1 );
+	}
+	if ( more ) {
+		return( -1 );
+	}
+	log_driver_stats();
 
-					// WTF? I don't know what this is
-					logMessage( LOG_ERROR_LEVEL, "Unknown virtual command, aborting [%s]", cmd );
-					fclose( fhandle );
-					return( -1 );
-				}
-			}
+	// Return successfully
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : combine_write
+// Description  : Add a WRITE to the pending combined write.  One that starts
+//                inside or right after it is merged in (later bytes over
+//                earlier ones); any other, or one that would make it longer
+//                than SMSA_COMBINE_SIZE, sends the pending write first.
+//                Whole drums are streamed past the driver cache, so the
+//                limit keeps combined writes cached as the single ones are.
+//                A WRITE longer than the limit is sent alone, in pieces.
+//
+// Inputs       : addr - the address of the WRITE
+//                len - the number of bytes
+//                ch - the byte written
+// Outputs      : 0 if successful, -1 if failure
+
+int combine_write( uint32_t addr, uint32_t len, uint32_t ch ) {
 
-			// Check for the virtual level failing
-			if ( err ) {
-				logMessage( LOG_ERROR_LEVEL, "Virtual array failed, aborting [%d]", err );
-				fclose( fhandle );
+	// Local variables
+	uint32_t done, piece;
+
+	if ( len > SMSA_COMBINE_SIZE ) {
+		if ( combine_flush() ) {
+			return( -1 );
+		}
+		memset( combine_buf, ch, SMSA_COMBINE_SIZE );
+		for ( done=0; done<len; done+=piece ) {
+			piece = ( len-done > SMSA_COMBINE_SIZE ) ? SMSA_COMBINE_SIZE : len-done;
+			if ( smsa_vwrite( addr+done, piece, combine_buf ) ) {
 				return( -1 );
 			}
 		}
+		return( 0 );
 	}
-  
-	// Close the workload file
-	fclose( fhandle );
 
-	// Return successfully
+	if ( combine_len && ((addr < combine_addr) || (addr > combine_addr + combine_len) ||
+			(addr + len - combine_addr > SMSA_COMBINE_SIZE)) && combine_flush() ) {
+		return( -1 );
+	}
+	if ( combine_len == 0 ) {
+		combine_addr = addr;
+	}
+	memset( &combine_buf[addr - combine_addr], ch, len );
+	if ( addr + len - combine_addr > combine_len ) {
+		combine_len = addr + len - combine_addr;
+	}
 	return( 0 );
 }
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : combine_flush
+// Description  : Send the pending combined write to the driver
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int combine_flush( void ) {
+
+	// Local variables
+	uint32_t len = combine_len;
+
+	if ( len == 0 ) {
+		return( 0 );
+	}
+	combine_len = 0;
+	logMessage( LOG_INFO_LEVEL, "Combined write (addr=%x, len=%u)", combine_addr, len );
+	return( smsa_vwrite( combine_addr, len, combine_buf ) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : log_driver_stats
+// Description  : Log what the driver sent to the device during the run
+//
+// Inputs       : none
+// Outputs      : none
+
+void log_driver_stats( void ) {
+
+	// Local variables
+	SMSA_DRIVER_STATS stats;
+	int i;
+
+	smsa_vstats( &stats );
+	for ( i=0; i<SMSA_MAX_COMMAND; i++ ) {
+		logMessage( LOG_INFO_LEVEL, "Driver ops %-11s : %" PRIu64, smsa_trace_op_name(i), stats.ops[i] );
+	}
+	logMessage( LOG_INFO_LEVEL, "Driver seek distance : %" PRIu64 " drums, %" PRIu64 " blocks",
+		stats.seek_drums, stats.seek_blocks );
+	logMessage( LOG_INFO_LEVEL, "Driver bytes : %" PRIu64 " read, %" PRIu64 " written",
+		stats.bytes_read, stats.bytes_written );
+	logMessage( LOG_INFO_LEVEL, "Driver device time : %.3f ms", stats.op_nsecs/1000000.0 );
+	logMessage( LOG_INFO_LEVEL, "Driver cache : %" PRIu64 " hits, %" PRIu64 " misses, %" PRIu64 " write backs",
+		stats.cache_hits, stats.cache_misses, stats.cache_writebacks );
+	logMessage( LOG_INFO_LEVEL, "Driver read-ahead : %" PRIu64 " prefetched, %" PRIu64 " hits, %" PRIu64 " wasted",
+		stats.prefetch_blocks, stats.prefetch_hits, stats.prefetch_wasted );
+	logMessage( LOG_INFO_LEVEL, "Driver journal : %" PRIu64 " records, %" PRIu64 " commits",
+		stats.journal_records, stats.journal_commits );
+	logMessage( LOG_INFO_LEVEL, "Driver unwritten blocks read as zeros : %" PRIu64, stats.zero_blocks );
+}
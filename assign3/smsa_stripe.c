@@ -0,0 +1,652 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : smsa_stripe.c
+//  Description    : This is the striping (RAID-0) layer over the SMSA driver.
+//                   Stripe unit u of the striped space is unit u / N of
+//                   member u % N, so the part of a transfer that falls on one
+//                   member is a single run of that member's addresses.  A
+//                   transfer sends every member its run before waiting on
+//                   any of them.  Each member's run is staged in memory
+//                   shared with the member, so only the requests and
+//                   results go over its socket.  Members are forked at
+//                   open, so open the
+//                   stripe set before starting any other threads.  A
+//                   member whose socket fails mid-request is stopped for
+//                   good (its array was only in its memory), and every
+//                   later request touching it fails.
+//
+//   Author        :
+//   Last Modified :
+//
+
+// Include Files
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+// Project Include Files
+#include <smsa_stripe.h>
+#include <cmpsc311_log.h>
+
+// Defines
+#define SMSA_STRIPE_PATH_SIZE 1024
+
+//
+// Type Definitions
+
+// The requests a member serves
+typedef enum {
+  STRIPE_MOUNT   = 0,
+  STRIPE_UNMOUNT = 1,
+  STRIPE_READ    = 2,
+  STRIPE_WRITE   = 3,
+  STRIPE_FLUSH   = 4,
+  STRIPE_EXIT    = 5,
+} SMSA_STRIPE_OP;
+
+// A request sent to a member, its bytes are in the member's stage
+typedef struct {
+  uint32_t op;                // SMSA_STRIPE_OP
+  uint32_t addr;              // Member address of the run
+  uint32_t len;               // Bytes in the run
+} SMSA_STRIPE_REQUEST;
+
+// One member array as seen from the caller
+typedef struct {
+  pid_t pid;                  // The member process
+  int fd;                     // The caller's end of the member's socket
+  unsigned char *stage;       // The member's run (shared with the member)
+  uint32_t addr;              // Member address of the run
+  uint32_t len;               // Bytes in the run
+  bool lost;                  // Stopped after a failed send or receive
+} SMSA_STRIPE_MEMBER;
+
+// Functional Prototypes
+int stripe_transfer( SMSA_STRIPE_ADDRESS addr, uint32_t len, unsigned char *buf, bool write );
+void stripe_split( SMSA_STRIPE_ADDRESS addr, uint32_t len, unsigned char *buf, bool gather );
+int stripe_broadcast( SMSA_STRIPE_OP op );
+int stripe_request( int member, SMSA_STRIPE_OP op );
+int stripe_reply( int member, SMSA_STRIPE_OP op );
+void stripe_lose( int member );
+void stripe_serve( int fd, const char *path, unsigned char *array );
+int stripe_load( const char *path, unsigned char *array );
+int stripe_store( const char *path, unsigned char *array );
+int stripe_send( int fd, void *data, uint32_t len );
+int stripe_recv( int fd, void *data, uint32_t len );
+
+//
+// Global data
+static SMSA_STRIPE_MEMBER stripe_members[SMSA_STRIPE_MAX_MEMBERS];
+static int stripe_count = 0;    // members, 0 when the set is not open
+static uint32_t stripe_unit = 0;
+static pthread_mutex_t stripe_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Interfaces
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_stripe_open
+// Description  : Fork a process for each member array, sharing a stage of
+//                a whole array with it.  Member m keeps its array in
+//                dir/smsa_member<m>.dat.
+//
+// Inputs       : members - the number of member arrays
+//                unit - the stripe unit in bytes (a power of two from
+//                       SMSA_BLOCK_SIZE to a whole array)
+//                dir - the directory of the backing files, NULL for none
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_stripe_open( int members, uint32_t unit, const char *dir ) {
+  char path[SMSA_STRIPE_PATH_SIZE];
+  int m, i, fds[2];
+
+  if ( stripe_count > 0 ) {
+    logMessage( LOG_ERROR_LEVEL, "Stripe set is already open" );
+    return -1;
+  }
+  if ( ( members < 1 ) || ( members > SMSA_STRIPE_MAX_MEMBERS ) ) {
+    logMessage( LOG_ERROR_LEVEL, "Bad stripe member count [%d]", members );
+    return -1;
+  }
+  if ( ( unit < SMSA_BLOCK_SIZE ) || ( unit > MAX_SMSA_VIRTUAL_ADDRESS ) || ( unit & ( unit - 1 ) ) ) {
+    logMessage( LOG_ERROR_LEVEL, "Bad stripe unit [%u]", unit );
+    return -1;
+  }
+  if ( ( dir != NULL ) && mkdir( dir, 0755 ) && ( errno != EEXIST ) ) {
+    logMessage( LOG_ERROR_LEVEL, "Unable to create stripe directory [%s]", dir );
+    return -1;
+  }
+
+  for ( m = 0; m < members; m++ ) {
+    if ( ( stripe_members[m].stage = mmap( NULL, MAX_SMSA_VIRTUAL_ADDRESS, PROT_READ | PROT_WRITE,
+                                           MAP_SHARED | MAP_ANONYMOUS, -1, 0 ) ) == MAP_FAILED ) {
+      logMessage( LOG_ERROR_LEVEL, "Unable to map stripe member buffer [%s]", strerror( errno ) );
+      break;
+    }
+    if ( socketpair( AF_UNIX, SOCK_STREAM, 0, fds ) ) {
+      logMessage( LOG_ERROR_LEVEL, "Unable to create stripe member socket [%s]", strerror( errno ) );
+      munmap( stripe_members[m].stage, MAX_SMSA_VIRTUAL_ADDRESS );
+      break;
+    }
+    if ( dir != NULL ) {
+      snprintf( path, SMSA_STRIPE_PATH_SIZE, "%s/smsa_member%d.dat", dir, m );
+    }
+
+    if ( ( stripe_members[m].pid = fork() ) == 0 ) {
+      // The member only needs its own end of its own socket, and its stage
+      for ( i = 0; i < m; i++ ) {
+        close( stripe_members[i].fd );
+        munmap( stripe_members[i].stage, MAX_SMSA_VIRTUAL_ADDRESS );
+      }
+      close( fds[0] );
+      stripe_serve( fds[1], ( dir != NULL ) ? path : NULL, stripe_members[m].stage );
+      _exit( 0 );
+    }
+    stripe_members[m].lost = false;
+    close( fds[1] );
+    if ( stripe_members[m].pid < 0 ) {
+      logMessage( LOG_ERROR_LEVEL, "Unable to start stripe member [%s]", strerror( errno ) );
+      close( fds[0] );
+      munmap( stripe_members[m].stage, MAX_SMSA_VIRTUAL_ADDRESS );
+      break;
+    }
+    stripe_members[m].fd = fds[0];
+    stripe_count = m + 1;
+  }
+  stripe_unit = unit;
+
+  if ( stripe_count < members ) {
+    smsa_stripe_close();
+    return -1;
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_stripe_close
+// Description  : Tell the member processes to exit and wait for them
+//
+// Inputs       : none
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_stripe_close( void ) {
+  int m, status, ret = 0;
+
+  pthread_mutex_lock( &stripe_lock );
+  for ( m = 0; m < stripe_count; m++ ) {
+    if ( stripe_members[m].lost ) {
+      // Already stopped and waited for
+      munmap( stripe_members[m].stage, MAX_SMSA_VIRTUAL_ADDRESS );
+      ret = -1;
+      continue;
+    }
+    stripe_request( m, STRIPE_EXIT );
+    close( stripe_members[m].fd );
+    if ( ( waitpid( stripe_members[m].pid, &status, 0 ) < 0 ) ||
+         !WIFEXITED( status ) || ( WEXITSTATUS( status ) != 0 ) ) {
+      logMessage( LOG_ERROR_LEVEL, "Stripe member %d did not exit cleanly", m );
+      ret = -1;
+    }
+    munmap( stripe_members[m].stage, MAX_SMSA_VIRTUAL_ADDRESS );
+  }
+  stripe_count = 0;
+  pthread_mutex_unlock( &stripe_lock );
+
+  return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_stripe_size
+// Description  : Get the size of the striped address space
+//
+// Inputs       : none
+// Outputs      : the number of bytes (0 when the set is not open)
+
+uint32_t smsa_stripe_size( void ) {
+  return( stripe_count * MAX_SMSA_VIRTUAL_ADDRESS );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_stripe_vmount
+// Description  : Mount every member array
+//
+// Inputs       : none
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_stripe_vmount( void ) {
+  return( stripe_broadcast( STRIPE_MOUNT ) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_stripe_vunmount
+// Description  : Unmount every member array
+//
+// Inputs       : none
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_stripe_vunmount( void ) {
+  return( stripe_broadcast( STRIPE_UNMOUNT ) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_stripe_vread
+// Description  : Read from the striped address space
+//
+// Inputs       : addr - the address to read from
+//                len - the number of bytes to read
+//                buf - the place to put the bytes
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_stripe_vread( SMSA_STRIPE_ADDRESS addr, uint32_t len, unsigned char *buf ) {
+  return( stripe_transfer( addr, len, buf, false ) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_stripe_vwrite
+// Description  : Write to the striped address space
+//
+// Inputs       : addr - the address to write to
+//                len - the number of bytes to write
+//                buf - the bytes to write
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_stripe_vwrite( SMSA_STRIPE_ADDRESS addr, uint32_t len, unsigned char *buf ) {
+  return( stripe_transfer( addr, len, buf, true ) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_stripe_vflush
+// Description  : Flush the buffered writes of every member array
+//
+// Inputs       : none
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_stripe_vflush( void ) {
+  return( stripe_broadcast( STRIPE_FLUSH ) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : stripe_transfer
+// Description  : Split a transfer into the members' runs, start every run
+//                and then collect the results
+//
+// Inputs       : addr - the striped address of the transfer
+//                len - the number of bytes
+//                buf - the caller's bytes
+//                write - true to write, false to read
+// Outputs      : -1 if failure or 0 if successful
+
+int stripe_transfer( SMSA_STRIPE_ADDRESS addr, uint32_t len, unsigned char *buf, bool write ) {
+  SMSA_STRIPE_OP op = write ? STRIPE_WRITE : STRIPE_READ;
+  int m, ret = 0;
+
+  pthread_mutex_lock( &stripe_lock );
+  if ( ( stripe_count == 0 ) || ( addr > smsa_stripe_size() ) || ( len > smsa_stripe_size() - addr ) ) {
+    logMessage( LOG_ERROR_LEVEL, "Stripe transfer is out of range [addr=%u, len=%u]", addr, len );
+    pthread_mutex_unlock( &stripe_lock );
+    return -1;
+  }
+
+  stripe_split( addr, len, buf, write );
+  for ( m = 0; m < stripe_count; m++ ) {
+    if ( ( stripe_members[m].len > 0 ) && stripe_request( m, op ) ) {
+      ret = -1;
+      stripe_members[m].len = 0;
+    }
+  }
+  for ( m = 0; m < stripe_count; m++ ) {
+    if ( ( stripe_members[m].len > 0 ) && stripe_reply( m, op ) ) {
+      ret = -1;
+    }
+  }
+  if ( !write && ( ret == 0 ) ) {
+    stripe_split( addr, len, buf, false );
+  }
+  pthread_mutex_unlock( &stripe_lock );
+
+  return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : stripe_split
+// Description  : Walk a transfer unit by unit, setting each member's run and
+//                moving the bytes between the caller's buffer and the
+//                members' stage buffers
+//
+// Inputs       : addr - the striped address of the transfer
+//                len - the number of bytes
+//                buf - the caller's bytes
+//                gather - true to copy into the stage buffers, false to
+//                         copy out of them
+// Outputs      : none
+
+void stripe_split( SMSA_STRIPE_ADDRESS addr, uint32_t len, unsigned char *buf, bool gather ) {
+  SMSA_STRIPE_MEMBER *mem;
+  uint32_t pos, unit, off, n, end = addr + len;
+  int m;
+
+  for ( m = 0; m < stripe_count; m++ ) {
+    stripe_members[m].len = 0;
+  }
+
+  for ( pos = addr; pos < end; pos += n ) {
+    unit = pos / stripe_unit;
+    off = pos % stripe_unit;
+    n = ( stripe_unit - off < end - pos ) ? stripe_unit - off : end - pos;
+    mem = &stripe_members[unit % stripe_count];
+    if ( mem->len == 0 ) {
+      mem->addr = ( unit / stripe_count ) * stripe_unit + off;
+    }
+    if ( gather ) {
+      memcpy( &mem->stage[mem->len], &buf[pos - addr], n );
+    }
+    else {
+      memcpy( &buf[pos - addr], &mem->stage[mem->len], n );
+    }
+    mem->len += n;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : stripe_broadcast
+// Description  : Send a request to every member, then wait for them all
+//
+// Inputs       : op - the request
+// Outputs      : -1 if any member failed or 0 if successful
+
+int stripe_broadcast( SMSA_STRIPE_OP op ) {
+  bool sent[SMSA_STRIPE_MAX_MEMBERS];
+  int m, ret = 0;
+
+  pthread_mutex_lock( &stripe_lock );
+  if ( stripe_count == 0 ) {
+    logMessage( LOG_ERROR_LEVEL, "Stripe set is not open" );
+    pthread_mutex_unlock( &stripe_lock );
+    return -1;
+  }
+  for ( m = 0; m < stripe_count; m++ ) {
+    stripe_members[m].addr = stripe_members[m].len = 0;
+    if ( !( sent[m] = ( stripe_request( m, op ) == 0 ) ) ) {
+      ret = -1;
+    }
+  }
+  for ( m = 0; m < stripe_count; m++ ) {
+    if ( sent[m] && stripe_reply( m, op ) ) {
+      ret = -1;
+    }
+  }
+  pthread_mutex_unlock( &stripe_lock );
+
+  return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : stripe_request
+// Description  : Send a request for the member's run, a write's bytes are
+//                already in its stage.  A send that fails loses the member,
+//                as it may have taken part of the request.
+//
+// Inputs       : member - the member to send to
+//                op - the request
+// Outputs      : -1 if failure or 0 if successful
+
+int stripe_request( int member, SMSA_STRIPE_OP op ) {
+  SMSA_STRIPE_MEMBER *mem = &stripe_members[member];
+  SMSA_STRIPE_REQUEST req = { op, mem->addr, mem->len };
+
+  if ( mem->lost ) {
+    logMessage( LOG_ERROR_LEVEL, "Stripe member %d was lost earlier", member );
+    return -1;
+  }
+  if ( stripe_send( mem->fd, &req, sizeof(req) ) ) {
+    logMessage( LOG_ERROR_LEVEL, "Unable to send to stripe member %d", member );
+    stripe_lose( member );
+    return -1;
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : stripe_reply
+// Description  : Wait for a member to finish a request, a read's bytes are
+//                then in its stage.  A receive that fails loses the member,
+//                as the reply may still come.
+//
+// Inputs       : member - the member to wait for
+//                op - the request it is working on
+// Outputs      : -1 if the request failed or 0 if successful
+
+int stripe_reply( int member, SMSA_STRIPE_OP op ) {
+  SMSA_STRIPE_MEMBER *mem = &stripe_members[member];
+  int32_t result;
+
+  if ( stripe_recv( mem->fd, &result, sizeof(result) ) ) {
+    logMessage( LOG_ERROR_LEVEL, "Lost contact with stripe member %d", member );
+    stripe_lose( member );
+    return -1;
+  }
+
+  return( result ? -1 : 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : stripe_lose
+// Description  : Stop a member whose socket is out of step with the requests
+//                sent to it, so nothing later reads a stale reply.  Its array
+//                cannot be recovered, so it is not restarted.  The caller
+//                holds the stripe lock.
+//
+// Inputs       : member - the member
+// Outputs      : none
+
+void stripe_lose( int member ) {
+  SMSA_STRIPE_MEMBER *mem = &stripe_members[member];
+
+  close( mem->fd );
+  kill( mem->pid, SIGKILL );
+  waitpid( mem->pid, NULL, 0 );
+  mem->fd = -1;
+  mem->lost = true;
+  logMessage( LOG_ERROR_LEVEL, "Stripe member %d stopped, its requests will fail", member );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : stripe_serve
+// Description  : The body of a member process, run the requests from the
+//                caller against this process's driver until told to exit
+//                (or the caller goes away)
+//
+// Inputs       : fd - the member's end of its socket
+//                path - the member's backing file, NULL for none
+//                array - the stage shared with the caller, a whole array
+// Outputs      : none
+
+void stripe_serve( int fd, const char *path, unsigned char *array ) {
+  SMSA_STRIPE_REQUEST req;
+  int32_t result;
+  int drum;
+
+  // The members would all share one journal and map file, they keep their own
+  smsa_vjournal( NULL );
+  smsa_vwritten( NULL );
+
+  while ( ( stripe_recv( fd, &req, sizeof(req) ) == 0 ) && ( req.op != STRIPE_EXIT ) ) {
+    result = 0;
+    switch ( req.op ) {
+    case STRIPE_MOUNT:
+      result = smsa_vmount();
+      if ( ( result == 0 ) && ( path != NULL ) && ( stripe_load( path, array ) == 1 ) ) {
+        for ( drum = 0; ( drum < SMSA_DISK_ARRAY_SIZE ) && ( result == 0 ); drum++ ) {
+          result = smsa_vwrite_drum( drum, &array[drum * SMSA_DISK_SIZE] );
+        }
+      }
+      break;
+
+    case STRIPE_UNMOUNT:
+      for ( drum = 0; ( path != NULL ) && ( drum < SMSA_DISK_ARRAY_SIZE ) && ( result == 0 ); drum++ ) {
+        result = smsa_vread_drum( drum, &array[drum * SMSA_DISK_SIZE] );
+      }
+      if ( ( result == 0 ) && ( path != NULL ) ) {
+        result = stripe_store( path, array );
+      }
+      if ( smsa_vunmount() ) {
+        result = -1;
+      }
+      break;
+
+    case STRIPE_READ:
+      result = smsa_vread( req.addr, req.len, array );
+      break;
+
+    case STRIPE_WRITE:
+      result = smsa_vwrite( req.addr, req.len, array );
+      break;
+
+    case STRIPE_FLUSH:
+      result = smsa_vflush();
+      break;
+    }
+
+    if ( stripe_send( fd, &result, sizeof(result) ) ) {
+      break;
+    }
+  }
+
+  close( fd );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : stripe_load
+// Description  : Read a member's backing file (the whole array, drum by
+//                drum, like smsa_data.dat)
+//
+// Inputs       : path - the backing file
+//                array - the MAX_SMSA_VIRTUAL_ADDRESS buffer to fill
+// Outputs      : 1 if loaded, 0 if there is no file yet, -1 if failure
+
+int stripe_load( const char *path, unsigned char *array ) {
+  FILE *fh;
+  size_t n;
+
+  if ( ( fh = fopen( path, "r" ) ) == NULL ) {
+    return( ( errno == ENOENT ) ? 0 : -1 );
+  }
+  n = fread( array, 1, MAX_SMSA_VIRTUAL_ADDRESS, fh );
+  fclose( fh );
+  if ( n != MAX_SMSA_VIRTUAL_ADDRESS ) {
+    logMessage( LOG_ERROR_LEVEL, "Stripe member file is short, ignoring it [%s]", path );
+    return 0;
+  }
+
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : stripe_store
+// Description  : Write a member's array to its backing file
+//
+// Inputs       : path - the backing file
+//                array - the MAX_SMSA_VIRTUAL_ADDRESS bytes of the array
+// Outputs      : -1 if failure or 0 if successful
+
+int stripe_store( const char *path, unsigned char *array ) {
+  FILE *fh;
+  size_t n;
+
+  if ( ( fh = fopen( path, "w" ) ) == NULL ) {
+    logMessage( LOG_ERROR_LEVEL, "Unable to open stripe member file [%s]", path );
+    return -1;
+  }
+  n = fwrite( array, 1, MAX_SMSA_VIRTUAL_ADDRESS, fh );
+  if ( fclose( fh ) || ( n != MAX_SMSA_VIRTUAL_ADDRESS ) ) {
+    logMessage( LOG_ERROR_LEVEL, "Unable to write stripe member file [%s]", path );
+    return -1;
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : stripe_send
+// Description  : Write all of a buffer to a member socket (a member that
+//                has gone away is an error, not a SIGPIPE)
+//
+// Inputs       : fd - the socket to write to
+//                data - the bytes
+//                len - the number of bytes
+// Outputs      : -1 if failure or 0 if successful
+
+int stripe_send( int fd, void *data, uint32_t len ) {
+  unsigned char *p = data;
+  ssize_t n;
+
+  while ( len > 0 ) {
+    if ( ( n = send( fd, p, len, MSG_NOSIGNAL ) ) < 0 ) {
+      if ( errno == EINTR ) {
+        continue;
+      }
+      return -1;
+    }
+    p += n;
+    len -= n;
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : stripe_recv
+// Description  : Read a whole buffer from a member socket
+//
+// Inputs       : fd - the socket to read from
+//                data - the place to put the bytes
+//                len - the number of bytes
+// Outputs      : -1 if failure (or the other end closed first) or 0 if successful
+
+int stripe_recv( int fd, void *data, uint32_t len ) {
+  unsigned char *p = data;
+  ssize_t n;
+
+  while ( len > 0 ) {
+    if ( ( n = read( fd, p, len ) ) <= 0 ) {
+      if ( ( n < 0 ) && ( errno == EINTR ) ) {
+        continue;
+      }
+      return -1;
+    }
+    p += n;
+    len -= n;
+  }
+
+  return 0;
+}
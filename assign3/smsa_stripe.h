@@ -0,0 +1,62 @@
+#ifndef SMSA_STRIPE_INCLUDED
+#define SMSA_STRIPE_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : smsa_stripe.h
+//  Description    : This is the striping (RAID-0) layer over the SMSA driver.
+//                   It presents one virtual address space of N arrays, cut
+//                   into stripe units dealt round robin to the members.  The
+//                   device library holds a single array per process, so each
+//                   member is a child process running its own driver, fed
+//                   requests over a socket; the members of a transfer work on
+//                   their pieces at the same time.  A member keeps its array
+//                   in its own backing file (same format as smsa_data.dat),
+//                   loaded at mount and stored at unmount.
+//
+//   Author        :
+//   Last Modified :
+//
+
+// Include Files
+#include <stdint.h>
+
+// Project Include Files
+#include <smsa_driver.h>
+
+// Defines
+#define SMSA_STRIPE_MAX_MEMBERS 16      // Most arrays in a stripe set
+#define SMSA_STRIPE_DEFAULT_UNIT 4096   // Default stripe unit in bytes
+
+//
+// Type Definitions
+typedef uint32_t SMSA_STRIPE_ADDRESS; // Address in the striped space
+
+//
+// Interfaces
+
+int smsa_stripe_open( int members, uint32_t unit, const char *dir );
+	// Start the member processes, backing files go in dir (NULL for none)
+
+int smsa_stripe_close( void );
+	// Stop the member processes (unmount first)
+
+uint32_t smsa_stripe_size( void );
+	// Number of bytes in the striped address space
+
+int smsa_stripe_vmount( void );
+	// Mount every member array, loading its backing file
+
+int smsa_stripe_vunmount( void );
+	// Store every member array to its backing file and unmount it
+
+int smsa_stripe_vread( SMSA_STRIPE_ADDRESS addr, uint32_t len, unsigned char *buf );
+	// Read from the striped address space
+
+int smsa_stripe_vwrite( SMSA_STRIPE_ADDRESS addr, uint32_t len, unsigned char *buf );
+	// Write to the striped address space
+
+int smsa_stripe_vflush( void );
+	// Write all buffered blocks of every member to its device
+
+#endif
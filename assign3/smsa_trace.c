@@ -0,0 +1,302 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : smsa_trace.c
+//  Description    : This is the operation trace of the SMSA tools.  Records
+//                   are buffered by stdio and reach the file in large
+//                   writes; the recorder is called with the driver's device
+//                   lock held, so records are never interleaved.
+//
+//   Author        :
+//   Last Modified :
+//
+
+// Include Files
+#include <string.h>
+#include <errno.h>
+
+// Project Include Files
+#include <smsa_trace.h>
+#include <cmpsc311_log.h>
+
+// Defines
+#define SMSA_TRACE_BUFFER 65536 // Bytes buffered before a write
+
+//
+// Functional Prototypes
+
+void put_le( unsigned char *p, uint64_t val, int bytes );
+uint64_t get_le( const unsigned char *p, int bytes );
+
+//
+// Global data
+static FILE *trace_file = NULL;
+static bool trace_hashes = false;
+static uint64_t trace_start;     // nsecs of the first record
+static uint64_t trace_usecs;     // time of the last record written
+static bool trace_failed = false; // recording stopped on a failed record
+static const char *trace_op_names[SMSA_MAX_COMMAND] = { "MOUNT", "UNMOUNT", "SEEK_DRUM",
+  "SEEK_BLOCK", "DISK_READ", "DISK_WRITE", "GET_STATE", "FORMAT_DRUM", "BLOCK_SIGN" };
+
+// Interfaces
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_trace_open
+// Description  : Start recording to a new trace, replacing any file there
+//
+// Inputs       : path - the trace file
+//                hashes - true to hash the block of each read and write
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_trace_open( const char *path, bool hashes ) {
+  unsigned char header[SMSA_TRACE_HEADER_SIZE];
+
+  smsa_trace_close();
+  if ( ( trace_file = fopen( path, "wb" ) ) == NULL ) {
+    logMessage( LOG_ERROR_LEVEL, "Unable to create trace [%s]: %s", path, strerror( errno ) );
+    return -1;
+  }
+  setvbuf( trace_file, NULL, _IOFBF, SMSA_TRACE_BUFFER );
+
+  memset( header, 0x0, sizeof(header) );
+  memcpy( header, SMSA_TRACE_MAGIC, SMSA_TRACE_MAGIC_SIZE );
+  put_le( &header[SMSA_TRACE_MAGIC_SIZE], hashes ? SMSA_TRACE_HASHES : 0, 4 );
+  if ( fwrite( header, sizeof(header), 1, trace_file ) != 1 ) {
+    logMessage( LOG_ERROR_LEVEL, "Unable to write trace [%s]: %s", path, strerror( errno ) );
+    fclose( trace_file );
+    trace_file = NULL;
+    return -1;
+  }
+
+  trace_hashes = hashes;
+  trace_start = trace_usecs = 0;
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_trace_close
+// Description  : Stop recording, writing out what is buffered.  Fails if
+//                recording already stopped on a failed record, so the
+//                caller learns the trace is incomplete.
+//
+// Inputs       : none
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_trace_close( void ) {
+  int ret = trace_failed ? -1 : 0;
+
+  trace_failed = false;
+  if ( trace_file == NULL ) {
+    return( ret );
+  }
+  if ( fclose( trace_file ) ) {
+    logMessage( LOG_ERROR_LEVEL, "Unable to close trace: %s", strerror( errno ) );
+    ret = -1;
+  }
+  trace_file = NULL;
+
+  return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_trace_enabled
+// Description  : Check whether a trace is being recorded
+//
+// Inputs       : none
+// Outputs      : true if recording
+
+bool smsa_trace_enabled( void ) {
+  return( trace_file != NULL );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_trace_record
+// Description  : Append an operation to the trace.  Times are kept as the
+//                microseconds since the previous record; a gap too long for
+//                the field is cut short, moving the later records earlier.
+//                A record that cannot be written ends the trace there.
+//
+// Inputs       : instruction - the encoded operation
+//                nsecs - when the operation was made (monotonic nanoseconds)
+//                block - the block read or written, NULL if none
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_trace_record( uint32_t instruction, uint64_t nsecs, unsigned char *block ) {
+  unsigned char rec[SMSA_TRACE_RECORD_SIZE + SMSA_TRACE_HASH_SIZE];
+  uint64_t usecs, delta;
+
+  if ( trace_file == NULL ) {
+    return 0;
+  }
+  if ( trace_start == 0 ) {
+    trace_start = nsecs;
+  }
+
+  usecs = ( nsecs - trace_start ) / 1000;
+  delta = ( usecs > trace_usecs ) ? usecs - trace_usecs : 0;
+  if ( delta > UINT32_MAX ) {
+    delta = UINT32_MAX;
+  }
+  trace_usecs += delta;
+
+  put_le( rec, instruction, 4 );
+  put_le( &rec[4], delta, 4 );
+  if ( trace_hashes ) {
+    put_le( &rec[SMSA_TRACE_RECORD_SIZE], ( block != NULL ) ? smsa_trace_hash( block ) : 0, 8 );
+  }
+  if ( fwrite( rec, SMSA_TRACE_RECORD_SIZE + ( trace_hashes ? SMSA_TRACE_HASH_SIZE : 0 ), 1, trace_file ) != 1 ) {
+    logMessage( LOG_ERROR_LEVEL, "Unable to write trace record: %s", strerror( errno ) );
+    fclose( trace_file );
+    trace_file = NULL;
+    trace_failed = true;
+    return -1;
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_trace_hash
+// Description  : Hash a block (64 bit FNV-1a)
+//
+// Inputs       : block - the SMSA_BLOCK_SIZE block
+// Outputs      : the hash
+
+uint64_t smsa_trace_hash( unsigned char *block ) {
+  uint64_t hash = 14695981039346656037ULL;
+  int i;
+
+  for ( i = 0; i < SMSA_BLOCK_SIZE; i++ ) {
+    hash = ( hash ^ block[i] ) * 1099511628211ULL;
+  }
+
+  return( hash );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_trace_op_name
+// Description  : Name a device opcode the way traces print it
+//
+// Inputs       : op - the opcode
+// Outputs      : the name, "UNKNOWN" if it is out of range
+
+const char * smsa_trace_op_name( uint32_t op ) {
+  return( ( op < SMSA_MAX_COMMAND ) ? trace_op_names[op] : "UNKNOWN" );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_trace_read_open
+// Description  : Open a trace and check its header
+//
+// Inputs       : path - the trace file
+//                tr - the reader to fill in
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_trace_read_open( const char *path, SMSA_TRACE_READER *tr ) {
+  unsigned char header[SMSA_TRACE_HEADER_SIZE];
+
+  memset( tr, 0x0, sizeof(SMSA_TRACE_READER) );
+  if ( ( tr->file = fopen( path, "rb" ) ) == NULL ) {
+    logMessage( LOG_ERROR_LEVEL, "Unable to open trace [%s]: %s", path, strerror( errno ) );
+    return -1;
+  }
+  setvbuf( tr->file, NULL, _IOFBF, SMSA_TRACE_BUFFER );
+
+  if ( ( fread( header, sizeof(header), 1, tr->file ) != 1 ) ||
+       memcmp( header, SMSA_TRACE_MAGIC, SMSA_TRACE_MAGIC_SIZE ) ) {
+    logMessage( LOG_ERROR_LEVEL, "File is not an SMSA trace [%s]", path );
+    smsa_trace_read_close( tr );
+    return -1;
+  }
+  tr->hashes = ( get_le( &header[SMSA_TRACE_MAGIC_SIZE], 4 ) & SMSA_TRACE_HASHES ) != 0;
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_trace_next
+// Description  : Read the next record of a trace
+//
+// Inputs       : tr - the trace being read
+//                rec - the place to put the record
+// Outputs      : 1 if a record was read, 0 at the end, -1 if it is truncated
+
+int smsa_trace_next( SMSA_TRACE_READER *tr, SMSA_TRACE_RECORD *rec ) {
+  unsigned char raw[SMSA_TRACE_RECORD_SIZE + SMSA_TRACE_HASH_SIZE];
+  size_t size = SMSA_TRACE_RECORD_SIZE + ( tr->hashes ? SMSA_TRACE_HASH_SIZE : 0 ), got;
+
+  if ( ( got = fread( raw, 1, size, tr->file ) ) != size ) {
+    if ( got == 0 ) {
+      return 0;
+    }
+    logMessage( LOG_ERROR_LEVEL, "Truncated trace record" );
+    return -1;
+  }
+
+  tr->usecs += get_le( &raw[4], 4 );
+  rec->instruction = get_le( raw, 4 );
+  rec->usecs = tr->usecs;
+  rec->hash = tr->hashes ? get_le( &raw[SMSA_TRACE_RECORD_SIZE], 8 ) : 0;
+
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_trace_read_close
+// Description  : Close a trace being read
+//
+// Inputs       : tr - the trace
+// Outputs      : none
+
+void smsa_trace_read_close( SMSA_TRACE_READER *tr ) {
+  if ( tr->file != NULL ) {
+    fclose( tr->file );
+  }
+  tr->file = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : put_le
+// Description  : Store an integer little endian
+//
+// Inputs       : p - where to store it
+//                val - the integer
+//                bytes - the number of bytes to store
+// Outputs      : none
+
+void put_le( unsigned char *p, uint64_t val, int bytes ) {
+  int i;
+
+  for ( i = 0; i < bytes; i++ ) {
+    p[i] = ( val >> ( 8 * i ) ) & 0xff;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : get_le
+// Description  : Load a little endian integer
+//
+// Inputs       : p - where it is stored
+//                bytes - the number of bytes it has
+// Outputs      : the integer
+
+uint64_t get_le( const unsigned char *p, int bytes ) {
+  uint64_t val = 0;
+  int i;
+
+  for ( i = bytes - 1; i >= 0; i-- ) {
+    val = ( val << 8 ) | p[i];
+  }
+
+  return( val );
+}
@@ -0,0 +1,88 @@
+#ifndef SMSA_TRACE_INCLUDED
+#define SMSA_TRACE_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : smsa_trace.h
+//  Description    : This is the operation trace of the SMSA tools.  The
+//                   driver records every smsa_operation call it makes (the
+//                   encoded instruction word, when it was made and, if
+//                   asked, a hash of the block moved), and smsatrace plays
+//                   a trace back against the device.
+//
+//                   Binary layout (all integers little endian):
+//                     header : 8 byte magic SMSA_TRACE_MAGIC, flags (4),
+//                              unused (4)
+//                     record : instruction (4), microseconds since the
+//                              previous record (4), and with
+//                              SMSA_TRACE_HASHES the FNV-1a hash of the
+//                              block (8, 0 for operations without one)
+//
+//   Author        :
+//   Last Modified :
+//
+
+// Include Files
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// Project Include Files
+#include <smsa.h>
+
+// Defines
+#define SMSA_TRACE_MAGIC       "SMSATRC1" // First bytes of a trace
+#define SMSA_TRACE_MAGIC_SIZE  8
+#define SMSA_TRACE_HEADER_SIZE 16         // Bytes before the first record
+#define SMSA_TRACE_RECORD_SIZE 8          // Bytes in a record without a hash
+#define SMSA_TRACE_HASH_SIZE   8          // Bytes a hash adds to a record
+#define SMSA_TRACE_HASHES      0x1        // Flag: records carry block hashes
+
+//
+// Type Definitions
+
+// A single traced operation
+typedef struct {
+  uint32_t instruction; // The encoded operation passed to smsa_operation
+  uint64_t usecs;       // When it was made, microseconds from the trace start
+  uint64_t hash;        // Hash of the block read or written (0 if none)
+} SMSA_TRACE_RECORD;
+
+// A trace being read
+typedef struct {
+  FILE *file;           // The open trace
+  bool hashes;          // Do the records carry hashes?
+  uint64_t usecs;       // Time of the last record read
+} SMSA_TRACE_READER;
+
+//
+// Interfaces
+
+int smsa_trace_open( const char *path, bool hashes );
+	// Start recording operations to a new trace, with block hashes if asked
+
+int smsa_trace_close( void );
+	// Stop recording and close the trace, -1 if a record was lost
+
+bool smsa_trace_enabled( void );
+	// Is a trace being recorded?
+
+int smsa_trace_record( uint32_t instruction, uint64_t nsecs, unsigned char *block );
+	// Record an operation made at nsecs (monotonic) moving block (NULL if none), a failure stops recording
+
+uint64_t smsa_trace_hash( unsigned char *block );
+	// Get the hash of an SMSA_BLOCK_SIZE block as it is kept in a trace
+
+const char * smsa_trace_op_name( uint32_t op );
+	// Get the short name of a device opcode ("UNKNOWN" if there is none)
+
+int smsa_trace_read_open( const char *path, SMSA_TRACE_READER *tr );
+	// Open a trace to read
+
+int smsa_trace_next( SMSA_TRACE_READER *tr, SMSA_TRACE_RECORD *rec );
+	// Get the next record: 1 if one was read, 0 at the end, -1 on failure
+
+void smsa_trace_read_close( SMSA_TRACE_READER *tr );
+	// Close a trace being read
+
+#endif
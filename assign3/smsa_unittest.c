@@ -0,0 +1,137 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : smsa_unittest.c
+//  Description   : This is the UNIT TEST of the source SMSA disk array
+//                  (smsa.c), the same test libsmsa.so carries.
+//
+//   Author :
+//   Last Modified :
+//
+
+// Include Files
+#include <string.h>
+
+// Project Includes
+#include <smsa_unittest.h>
+#include <cmpsc311_log.h>
+#include <cmpsc311_util.h>
+
+//
+// Functional Prototypes
+
+uint32_t encode_SMSA_operation( SMSA_DISK_COMMAND opcode, SMSA_DRUM_ID drum, SMSA_BLOCK_ID block );
+int doVread( uint32_t addr, uint32_t len );
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_unit_test
+// Description  : Write a pattern to every block, remount, read every block
+//                back (last block first) and sign every block of drum 0
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int smsa_unit_test( void ) {
+
+	// Local variables
+	unsigned char block[SMSA_BLOCK_SIZE], tblock[SMSA_BLOCK_SIZE];
+	int drum, blk;
+
+	enableLogLevels( LOG_ERROR_LEVEL|LOG_WARNING_LEVEL|LOG_INFO_LEVEL|LOG_OUTPUT_LEVEL );
+	logMessage( LOG_INFO_LEVEL, "UNIT TEST Beginning ..." );
+
+	// Mount, visit every drum, then write the pattern drum by drum
+	smsa_operation( encode_SMSA_operation(SMSA_MOUNT, 0, 0), NULL );
+	for ( drum=0; drum<SMSA_DISK_ARRAY_SIZE; drum++ ) {
+		smsa_operation( encode_SMSA_operation(SMSA_SEEK_DRUM, drum, 0), NULL );
+	}
+	for ( drum=0; drum<SMSA_DISK_ARRAY_SIZE; drum++ ) {
+		smsa_operation( encode_SMSA_operation(SMSA_SEEK_DRUM, drum, 0), NULL );
+		for ( blk=0; blk<SMSA_MAX_BLOCK_ID; blk++ ) {
+			smsa_operation( encode_SMSA_operation(SMSA_DISK_WRITE, 0, 0), test_disk_block(drum, blk, tblock) );
+		}
+	}
+
+	// Remount and check the blocks
+	smsa_operation( encode_SMSA_operation(SMSA_UNMOUNT, 0, 0), NULL );
+	smsa_operation( encode_SMSA_operation(SMSA_MOUNT, 0, 0), NULL );
+	for ( drum=0; drum<SMSA_DISK_ARRAY_SIZE; drum++ ) {
+		smsa_operation( encode_SMSA_operation(SMSA_SEEK_DRUM, drum, 0), NULL );
+		for ( blk=SMSA_MAX_BLOCK_ID-1; blk>=0; blk-- ) {
+			smsa_operation( encode_SMSA_operation(SMSA_SEEK_BLOCK, 0, blk), NULL );
+			smsa_operation( encode_SMSA_operation(SMSA_DISK_READ, 0, 0), block );
+			test_disk_block( drum, blk, tblock );
+			if ( memcmp(tblock, block, SMSA_BLOCK_SIZE) ) {
+				logMessage( LOG_ERROR_LEVEL, "UNIT TEST FAILED DISK BLOCK COMPARE [drum=%d,block=%d]", drum, blk );
+				return( -1 );
+			}
+			logMessage( LOG_INFO_LEVEL, "Drum/Block [%d,%d] compare correct (%0x == %0x)\n",
+				drum, blk, tblock[0], block[0] );
+		}
+	}
+
+	// Sign the blocks (the drum field is 0 throughout, as in the library)
+	for ( drum=0; drum<SMSA_DISK_ARRAY_SIZE; drum++ ) {
+		for ( blk=0; blk<SMSA_MAX_BLOCK_ID; blk++ ) {
+			smsa_operation( encode_SMSA_operation(SMSA_BLOCK_SIGN, 0, blk), NULL );
+		}
+	}
+
+	logMessage( LOG_INFO_LEVEL, "UNIT TEST Successful." );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_vread_unit_test
+// Description  : Walk the address space in random steps, logging each read
+//                (the reads themselves are left to the driver's tests)
+//
+// Inputs       : none
+// Outputs      : 0 if successful, -1 if failure
+
+int smsa_vread_unit_test( void ) {
+
+	// Local variables
+	uint32_t addr, len;
+
+	for ( addr=0; addr<=MAX_SMSA_VIRTUAL_ADDRESS; addr+=len ) {
+		len = getRandomValue( 1, SMSA_MAXIMUM_RDWR_SIZE );
+		logMessage( LOG_INFO_LEVEL, "*****" );
+		logMessage( LOG_INFO_LEVEL, "VREAD Unit Test : reading address %u, len %u", addr, len );
+		doVread( addr, len );
+	}
+
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : test_disk_block
+// Description  : Fill a block with the test pattern of a drum and block
+//
+// Inputs       : did - the drum
+//                bid - the block
+//                blk - the SMSA_BLOCK_SIZE buffer to fill
+// Outputs      : the filled buffer
+
+unsigned char * test_disk_block( SMSA_DRUM_ID did, SMSA_BLOCK_ID bid, unsigned char *blk ) {
+	memset( blk, did^bid, SMSA_BLOCK_SIZE );
+	return( blk );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : doVread
+// Description  : One read of the vread unit test (nothing to do here)
+//
+// Inputs       : addr - the address of the read
+//                len - the number of bytes
+// Outputs      : 0 always
+
+int doVread( uint32_t addr, uint32_t len ) {
+	return( 0 );
+}
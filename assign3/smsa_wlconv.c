@@ -0,0 +1,133 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : smsa_wlconv.c
+//  Description   : This is the workload converter for the SMSA tools.  It
+//                  turns text .dat workloads into binary ones and back.
+//
+//   Author :
+//   Last Modified :
+//
+
+// Include Files
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+// Project Includes
+#include <smsa_workload.h>
+#include <cmpsc311_log.h>
+
+// Defines
+#define SMSA_WLCONV_ARGUMENTS "hbt"
+#define USAGE \
+	"USAGE: smsawlconv [-h] [-b | -t] <input-workload> <output-workload>\n" \
+	"\n" \
+	"where:\n" \
+	"    -h - help mode (display this message)\n" \
+	"    -b - write a binary workload\n" \
+	"    -t - write a text workload\n" \
+	"\n" \
+	"    By default the output is in the other format from the input.\n" \
+	"\n" \
+
+//
+// Functional Prototypes
+
+int convert_workload( const char *in, const char *out, int format );
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : main
+// Description  : The main function for the workload converter
+//
+// Inputs       : argc - the number of command line parameters
+//                argv - the parameters
+// Outputs      : 0 if successful, -1 if failure
+
+int main( int argc, char *argv[] )
+{
+	// Local variables
+	int ch, format = -1;
+
+	// Process the command line parameters
+	while ((ch = getopt(argc, argv, SMSA_WLCONV_ARGUMENTS)) != -1) {
+
+		switch (ch) {
+		case 'h': // Help, print usage
+			fprintf( stderr, USAGE );
+			return( -1 );
+
+		case 'b': // Binary output
+			format = 1;
+			break;
+
+		case 't': // Text output
+			format = 0;
+			break;
+
+		default:  // Default (unknown)
+			fprintf( stderr, "Unknown command line option (%c), aborting.\n", ch );
+			return( -1 );
+		}
+	}
+
+	if ( optind + 2 != argc ) {
+		fprintf( stderr, "Missing command line parameters, use -h to see usage, aborting.\n" );
+		return( -1 );
+	}
+
+	initializeLogWithFilehandle( CMPSC311_LOG_STDERR );
+	return( convert_workload( argv[optind], argv[optind+1], format ) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : convert_workload
+// Description  : Stream every command of a workload into a new file
+//
+// Inputs       : in - the name of the workload to read
+//                out - the name of the workload to write
+//                format - 1 for binary, 0 for text, -1 for the other format
+// Outputs      : 0 if successful, -1 if failure
+
+int convert_workload( const char *in, const char *out, int format ) {
+
+	// Local variables
+	SMSA_WORKLOAD_FILE wf;
+	SMSA_WORKLOAD_CMD cmd;
+	FILE *fhandle;
+	bool binary;
+	int ret;
+
+	if ( smsa_workload_open( in, &wf ) ) {
+		return( -1 );
+	}
+	binary = ( format == -1 ) ? !wf.binary : format;
+
+	if ( (fhandle = fopen( out, binary ? "wb" : "w" )) == NULL ) {
+		logMessage( LOG_ERROR_LEVEL, "Failure opening the output workload [%s], error: %s.\n",
+			out, strerror(errno) );
+		smsa_workload_close( &wf );
+		return( -1 );
+	}
+
+	ret = binary ? smsa_workload_put_header( fhandle ) : 0;
+	while ( !ret && ((ret = smsa_workload_next( &wf, &cmd )) == 1) ) {
+		ret = smsa_workload_put( fhandle, &cmd, binary );
+	}
+	smsa_workload_close( &wf );
+
+	if ( fclose( fhandle ) || ret ) {
+		logMessage( LOG_ERROR_LEVEL, "Failure converting workload [%s] to [%s]", in, out );
+		return( -1 );
+	}
+
+	// Return successfully
+	return( 0 );
+}
@@ -0,0 +1,477 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : smsa_workload.c
+//  Description    : This is the workload loader for the SMSA tools.  It
+//                   parses both the text and the binary workload formats.
+//
+//   Author        :
+//   Last Modified :
+//
+
+// Include Files
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Project Include Files
+#include <smsa_workload.h>
+#include <cmpsc311_log.h>
+
+// Defines
+#define SMSA_WORKLOAD_INITIAL_CMDS 1024
+#define SMSA_WORKLOAD_LINE_MAX 255      // Longest line fgets( line, 256, ... ) returns
+#define SMSA_WORKLOAD_IS_SPACE(c) ( ( (c) == ' ' ) || ( ( (c) >= '\t' ) && ( (c) <= '\r' ) ) )
+
+// Functional Prototypes
+int add_command( SMSA_WORKLOAD *wl, uint32_t *capacity, SMSA_WORKLOAD_CMD *cmd );
+int next_line( SMSA_WORKLOAD_FILE *wf, SMSA_WORKLOAD_CMD *cmd );
+int next_record( SMSA_WORKLOAD_FILE *wf, SMSA_WORKLOAD_CMD *cmd );
+bool has_prefix( const char *str, size_t len, const char *prefix );
+size_t scan_word( const char **p, const char *end, size_t width );
+bool scan_uint( const char **p, const char *end, size_t width, uint32_t *val );
+void log_line( const char *fmt, const char *str, size_t len );
+
+// Interfaces
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_load_workload
+// Description  : Read and parse a whole workload file
+//
+// Inputs       : wload - the name of the workload file
+//                wl - the workload to fill in
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_load_workload( const char *wload, SMSA_WORKLOAD *wl ) {
+  SMSA_WORKLOAD_FILE wf;
+  SMSA_WORKLOAD_CMD command;
+  uint32_t capacity = 0;
+  int ret;
+
+  wl->cmds = NULL;
+  wl->count = 0;
+
+  if ( smsa_workload_open( wload, &wf ) ) {
+    return -1;
+  }
+
+  while ( ( ret = smsa_workload_next( &wf, &command ) ) == 1 ) {
+    if ( add_command( wl, &capacity, &command ) ) {
+      ret = -1;
+      break;
+    }
+  }
+  smsa_workload_close( &wf );
+
+  // Anything short of the end of the file is a parse or memory failure
+  if ( ret ) {
+    smsa_free_workload( wl );
+    return -1;
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_free_workload
+// Description  : Release a loaded workload
+//
+// Inputs       : wl - the workload to release
+// Outputs      : none
+
+void smsa_free_workload( SMSA_WORKLOAD *wl ) {
+  free( wl->cmds );
+  wl->cmds = NULL;
+  wl->count = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_workload_open
+// Description  : Map a workload file so that it can be parsed in place
+//
+// Inputs       : wload - the name of the workload file
+//                wf - the mapping to fill in
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_workload_open( const char *wload, SMSA_WORKLOAD_FILE *wf ) {
+  struct stat st;
+  void *data;
+  int fd;
+
+  memset( wf, 0x0, sizeof(SMSA_WORKLOAD_FILE) );
+  if ( ( fd = open( wload, O_RDONLY ) ) == -1 ) {
+    logMessage( LOG_ERROR_LEVEL, "Failure opening the workload file [%s], error: %s.\n",
+        wload, strerror(errno) );
+    return -1;
+  }
+
+  if ( fstat( fd, &st ) == -1 ) {
+    logMessage( LOG_ERROR_LEVEL, "Failure reading the workload file [%s], error: %s.\n",
+        wload, strerror(errno) );
+    close( fd );
+    return -1;
+  }
+
+  // An empty file has nothing to map and no commands
+  if ( st.st_size > 0 ) {
+    data = mmap( NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    if ( data == MAP_FAILED ) {
+      logMessage( LOG_ERROR_LEVEL, "Failure mapping the workload file [%s], error: %s.\n",
+          wload, strerror(errno) );
+      close( fd );
+      return -1;
+    }
+    madvise( data, st.st_size, MADV_SEQUENTIAL );
+    wf->data = data;
+    wf->size = st.st_size;
+  }
+  close( fd );
+
+  // Binary workloads start with the magic, the records follow it
+  if ( has_prefix( wf->data, wf->size, SMSA_WORKLOAD_MAGIC ) ) {
+    wf->binary = true;
+    wf->pos = SMSA_WORKLOAD_MAGIC_SIZE;
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_workload_next
+// Description  : Parse the next command out of the mapped file, in either
+//                format.  A READ or WRITE longer than SMSA_MAXIMUM_RDWR_SIZE
+//                is a parse error, as the commands are replayed through
+//                buffers of that size.
+//
+// Inputs       : wf - the mapped workload file
+//                cmd - the place to put the command
+// Outputs      : 1 if a command was parsed, 0 at the end of the file, -1 if
+//                the line could not be parsed
+
+int smsa_workload_next( SMSA_WORKLOAD_FILE *wf, SMSA_WORKLOAD_CMD *cmd ) {
+  int ret;
+
+  if ( wf->pos >= wf->size ) {
+    return 0;
+  }
+  ret = wf->binary ? next_record( wf, cmd ) : next_line( wf, cmd );
+
+  if ( ( ret == 1 ) && ( cmd->len > SMSA_MAXIMUM_RDWR_SIZE ) ) {
+    logMessage( LOG_ERROR_LEVEL, "Virtual command too long, aborting (addr=%u, len=%u, largest %u)",
+        cmd->addr, cmd->len, SMSA_MAXIMUM_RDWR_SIZE );
+    return -1;
+  }
+
+  return( ret );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : next_line
+// Description  : Parse a text line.  Lines are split and fields read exactly
+//                as the fgets/sscanf loop of simulate_SMSA did ("%7s %7u
+//                %4u %3u" on 255 byte lines), with the same error messages,
+//                but nothing is copied.
+//
+// Inputs       : wf - the mapped workload file, not at its end
+//                cmd - the place to put the command
+// Outputs      : 1 if a command was parsed, -1 if the line could not be parsed
+
+int next_line( SMSA_WORKLOAD_FILE *wf, SMSA_WORKLOAD_CMD *cmd ) {
+  const char *line, *end, *nl, *p, *word;
+  size_t len, wlen;
+
+  // Find the end of the line, or where fgets would have cut it short
+  line = &wf->data[wf->pos];
+  len = wf->size - wf->pos;
+  if ( len > SMSA_WORKLOAD_LINE_MAX ) {
+    len = SMSA_WORKLOAD_LINE_MAX;
+  }
+  if ( ( nl = memchr( line, '\n', len ) ) != NULL ) {
+    len = nl - line + 1;
+  }
+  end = line + len;
+  wf->pos += len;
+  memset( cmd, 0x0, sizeof(SMSA_WORKLOAD_CMD) );
+
+  if ( has_prefix( line, len, SMSA_WORKLOAD_MOUNT ) ) {
+    cmd->op = SMSA_WL_MOUNT;
+    return 1;
+  }
+  if ( has_prefix( line, len, SMSA_WORKLOAD_UNMOUNT ) ) {
+    cmd->op = SMSA_WL_UNMOUNT;
+    return 1;
+  }
+  if ( has_prefix( line, len, SMSA_WORKLOAD_SIGNALL ) ) {
+    cmd->op = SMSA_WL_SIGNALL;
+    return 1;
+  }
+
+  // Command word, address, length and fill byte
+  p = line;
+  wlen = scan_word( &p, end, 7 );
+  word = p - wlen;
+  if ( ( wlen == 0 ) || !scan_uint( &p, end, 7, &cmd->addr ) ||
+       !scan_uint( &p, end, 4, &cmd->len ) || !scan_uint( &p, end, 3, &cmd->ch ) ) {
+    log_line( "Error parsing virtual command [%s\n]", line, len );
+    return -1;
+  }
+
+  if ( has_prefix( word, wlen, SMSA_WORKLOAD_READ ) ) {
+    cmd->op = SMSA_WL_READ;
+  }
+  else if ( has_prefix( word, wlen, SMSA_WORKLOAD_WRITE ) ) {
+    cmd->op = SMSA_WL_WRITE;
+  }
+  else {
+    log_line( "Unknown virtual command, aborting [%s]", word, wlen );
+    return -1;
+  }
+
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_workload_close
+// Description  : Unmap a workload file
+//
+// Inputs       : wf - the mapped workload file
+// Outputs      : none
+
+void smsa_workload_close( SMSA_WORKLOAD_FILE *wf ) {
+  if ( wf->data != NULL ) {
+    munmap( (void *)wf->data, wf->size );
+  }
+  memset( wf, 0x0, sizeof(SMSA_WORKLOAD_FILE) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_workload_put
+// Description  : Write a command in either workload format
+//
+// Inputs       : out - the file to write to
+//                cmd - the command
+//                binary - true for a binary record, false for a text line
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_workload_put( FILE *out, SMSA_WORKLOAD_CMD *cmd, bool binary ) {
+  const char *names[] = { SMSA_WORKLOAD_MOUNT, SMSA_WORKLOAD_UNMOUNT, SMSA_WORKLOAD_SIGNALL,
+      SMSA_WORKLOAD_READ, SMSA_WORKLOAD_WRITE };
+  unsigned char rec[SMSA_WORKLOAD_RECORD_SIZE];
+
+  if ( !binary ) {
+    if ( cmd->op <= SMSA_WL_SIGNALL ) {
+      return( ( fprintf( out, "%s\n", names[cmd->op] ) < 0 ) ? -1 : 0 );
+    }
+    return( ( fprintf( out, "%s %u %u %u\n", names[cmd->op], cmd->addr, cmd->len, cmd->ch ) < 0 ) ? -1 : 0 );
+  }
+
+  // The record fields are narrower than the text ones
+  if ( ( cmd->len > 0xffff ) || ( cmd->ch > 0xff ) ) {
+    logMessage( LOG_ERROR_LEVEL, "Command does not fit a binary record [len=%u, ch=%u]",
+        cmd->len, cmd->ch );
+    return -1;
+  }
+
+  rec[0] = cmd->addr & 0xff;
+  rec[1] = ( cmd->addr >> 8 ) & 0xff;
+  rec[2] = ( cmd->addr >> 16 ) & 0xff;
+  rec[3] = ( cmd->addr >> 24 ) & 0xff;
+  rec[4] = cmd->len & 0xff;
+  rec[5] = ( cmd->len >> 8 ) & 0xff;
+  rec[6] = cmd->op;
+  rec[7] = cmd->ch;
+
+  return( ( fwrite( rec, SMSA_WORKLOAD_RECORD_SIZE, 1, out ) != 1 ) ? -1 : 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_workload_put_header
+// Description  : Write the magic that starts a binary workload
+//
+// Inputs       : out - the file to write to
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_workload_put_header( FILE *out ) {
+  return( ( fwrite( SMSA_WORKLOAD_MAGIC, SMSA_WORKLOAD_MAGIC_SIZE, 1, out ) != 1 ) ? -1 : 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : next_record
+// Description  : Decode the next binary command record
+//
+// Inputs       : wf - the mapped workload file
+//                cmd - the place to put the command
+// Outputs      : 1 if a command was decoded, -1 if the record is bad
+
+int next_record( SMSA_WORKLOAD_FILE *wf, SMSA_WORKLOAD_CMD *cmd ) {
+  const unsigned char *rec = (const unsigned char *)&wf->data[wf->pos];
+
+  if ( wf->size - wf->pos < SMSA_WORKLOAD_RECORD_SIZE ) {
+    logMessage( LOG_ERROR_LEVEL, "Truncated binary workload record at offset %zu",
+        wf->pos );
+    return -1;
+  }
+  if ( rec[6] > SMSA_WL_WRITE ) {
+    logMessage( LOG_ERROR_LEVEL, "Unknown binary workload command [%u] at offset %zu",
+        rec[6], wf->pos );
+    return -1;
+  }
+  wf->pos += SMSA_WORKLOAD_RECORD_SIZE;
+
+  cmd->op = rec[6];
+  cmd->addr = rec[0] | ( rec[1] << 8 ) | ( rec[2] << 16 ) | ( (uint32_t)rec[3] << 24 );
+  cmd->len = rec[4] | ( rec[5] << 8 );
+  cmd->ch = rec[7];
+  if ( cmd->op <= SMSA_WL_SIGNALL ) {
+    cmd->addr = cmd->len = cmd->ch = 0;
+  }
+
+  return 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : add_command
+// Description  : Append a command to the workload, growing it as needed
+//
+// Inputs       : wl - the workload
+//                capacity - the number of commands allocated
+//                cmd - the command to append
+// Outputs      : -1 if failure or 0 if successful
+
+int add_command( SMSA_WORKLOAD *wl, uint32_t *capacity, SMSA_WORKLOAD_CMD *cmd ) {
+  SMSA_WORKLOAD_CMD *cmds;
+  uint32_t grown;
+
+  if ( wl->count == *capacity ) {
+    grown = ( *capacity == 0 ) ? SMSA_WORKLOAD_INITIAL_CMDS : *capacity * 2;
+    if ( ( cmds = realloc( wl->cmds, grown * sizeof(SMSA_WORKLOAD_CMD) ) ) == NULL ) {
+      logMessage( LOG_ERROR_LEVEL, "Unable to allocate workload [%u commands]", grown );
+      return -1;
+    }
+    wl->cmds = cmds;
+    *capacity = grown;
+  }
+
+  wl->cmds[wl->count++] = *cmd;
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : has_prefix
+// Description  : Check if a string that is not NUL terminated starts with a
+//                prefix
+//
+// Inputs       : str - the string
+//                len - the number of bytes in the string
+//                prefix - the prefix to look for
+// Outputs      : true if the string starts with the prefix
+
+bool has_prefix( const char *str, size_t len, const char *prefix ) {
+  size_t plen = strlen( prefix );
+
+  return( ( len >= plen ) && ( memcmp( str, prefix, plen ) == 0 ) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : scan_word
+// Description  : Skip white space and step over up to width non-space
+//                characters, like a "%<width>s" conversion
+//
+// Inputs       : p - the parse position, moved past the word
+//                end - the end of the line
+//                width - the most characters to take
+// Outputs      : the length of the word (0 if there is none)
+
+size_t scan_word( const char **p, const char *end, size_t width ) {
+  const char *s = *p;
+  size_t len = 0;
+
+  while ( ( s < end ) && SMSA_WORKLOAD_IS_SPACE( *s ) ) {
+    s++;
+  }
+  while ( ( s < end ) && ( len < width ) && !SMSA_WORKLOAD_IS_SPACE( *s ) ) {
+    s++;
+    len++;
+  }
+
+  *p = s;
+  return( len );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : scan_uint
+// Description  : Skip white space and read an unsigned decimal number of up
+//                to width characters, like a "%<width>u" conversion (a sign
+//                counts towards the width and a minus negates the value)
+//
+// Inputs       : p - the parse position, moved past the number
+//                end - the end of the line
+//                width - the most characters to take
+//                val - the place to put the number
+// Outputs      : true if a number was read, false if not
+
+bool scan_uint( const char **p, const char *end, size_t width, uint32_t *val ) {
+  const char *s = *p, *digits;
+  bool negative = false;
+  uint32_t v = 0;
+
+  while ( ( s < end ) && SMSA_WORKLOAD_IS_SPACE( *s ) ) {
+    s++;
+  }
+  if ( ( s < end ) && ( ( *s == '+' ) || ( *s == '-' ) ) ) {
+    negative = ( *s == '-' );
+    s++;
+    width--;
+  }
+
+  digits = s;
+  while ( ( s < end ) && ( width > 0 ) && ( *s >= '0' ) && ( *s <= '9' ) ) {
+    v = v * 10 + ( *s - '0' );
+    s++;
+    width--;
+  }
+  if ( s == digits ) {
+    return false;
+  }
+
+  *p = s;
+  *val = negative ? -v : v;
+  return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : log_line
+// Description  : Log an error about part of the mapped file, which has to be
+//                copied out to be NUL terminated
+//
+// Inputs       : fmt - the message format, with one %s
+//                str - the text to include
+//                len - the number of bytes of text
+// Outputs      : none
+
+void log_line( const char *fmt, const char *str, size_t len ) {
+  char text[SMSA_WORKLOAD_LINE_MAX + 1];
+
+  memcpy( text, str, len );
+  text[len] = '\0';
+  logMessage( LOG_ERROR_LEVEL, fmt, text );
+}
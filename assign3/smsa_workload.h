@@ -0,0 +1,95 @@
+#ifndef SMSA_WORKLOAD_INCLUDED
+#define SMSA_WORKLOAD_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : smsa_workload.h
+//  Description    : This is the workload loader for the SMSA tools.  It reads
+//                   a whole workload file into an array of commands so that
+//                   it can be replayed without parsing in the way, or
+//                   steps through a mapped workload one command at a time.
+//                   Workloads are either the text .dat format or a binary
+//                   format of fixed-width records, told apart by the magic
+//                   at the start of binary files.
+//
+//                   Binary layout (all integers little endian):
+//                     header : 8 byte magic SMSA_WORKLOAD_MAGIC
+//                     record : addr (4 bytes), len (2), op (1), ch (1)
+//
+//   Author        :
+//   Last Modified :
+//
+
+// Include Files
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// Project Include Files
+#include <smsa.h>
+
+// Defines
+#define SMSA_WORKLOAD_MAGIC       "SMSAWLB1" // First bytes of a binary workload
+#define SMSA_WORKLOAD_MAGIC_SIZE  8
+#define SMSA_WORKLOAD_RECORD_SIZE 8          // Bytes in a binary command record
+
+//
+// Type Definitions
+
+// The commands a workload can contain
+typedef enum {
+  SMSA_WL_MOUNT   = 0, // Mount the array
+  SMSA_WL_UNMOUNT = 1, // Unmount the array
+  SMSA_WL_SIGNALL = 2, // Sign every block on the array
+  SMSA_WL_READ    = 3, // Read from the virtual address space
+  SMSA_WL_WRITE   = 4, // Write a fill byte to the virtual address space
+} SMSA_WORKLOAD_OP;
+
+// A single workload command
+typedef struct {
+  SMSA_WORKLOAD_OP op; // The command
+  uint32_t addr;       // Virtual address (READ/WRITE)
+  uint32_t len;        // Number of bytes (READ/WRITE)
+  uint32_t ch;         // Fill byte (WRITE)
+} SMSA_WORKLOAD_CMD;
+
+// A loaded workload
+typedef struct {
+  SMSA_WORKLOAD_CMD *cmds; // The commands in file order
+  uint32_t count;          // Number of commands
+} SMSA_WORKLOAD;
+
+// A workload file mapped into memory, parsed in place
+typedef struct {
+  const char *data;        // The mapped file (NULL if empty)
+  size_t size;             // Bytes in the file
+  size_t pos;              // Start of the next line or record
+  bool binary;             // Fixed-width records rather than text?
+} SMSA_WORKLOAD_FILE;
+
+//
+// Interfaces
+
+int smsa_load_workload( const char *wload, SMSA_WORKLOAD *wl );
+	// Read and parse a workload file
+
+void smsa_free_workload( SMSA_WORKLOAD *wl );
+	// Release a loaded workload
+
+int smsa_workload_open( const char *wload, SMSA_WORKLOAD_FILE *wf );
+	// Map a workload file for parsing
+
+int smsa_workload_next( SMSA_WORKLOAD_FILE *wf, SMSA_WORKLOAD_CMD *cmd );
+	// Parse the next command, 1 if one was parsed, 0 at the end, -1 on error
+
+void smsa_workload_close( SMSA_WORKLOAD_FILE *wf );
+	// Unmap a workload file
+
+int smsa_workload_put( FILE *out, SMSA_WORKLOAD_CMD *cmd, bool binary );
+	// Write a command as a text line or a binary record
+
+int smsa_workload_put_header( FILE *out );
+	// Write the magic that starts a binary workload
+
+#endif
@@ -0,0 +1,283 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : smsa_written.c
+//  Description    : This is the written-block map used by the SMSA driver.
+//                   The map file is replaced whole on each save (written
+//                   beside it, then renamed over it), so a crash leaves
+//                   either the old map or the new one.
+//
+//   Author        :
+//   Last Modified :
+//
+
+// Include Files
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// Project Include Files
+#include <smsa_written.h>
+#include <cmpsc311_log.h>
+
+// Defines
+#define SMSA_WRITTEN_MAGIC 0x534d5750            // "SMWP"
+#define SMSA_WRITTEN_WORDS ( SMSA_MAX_BLOCK_ID / 64 ) // Bit words per drum
+#define SMSA_WRITTEN_PATH_SIZE 4096
+
+//
+// Type Definitions
+
+// The map as it is kept in the file
+typedef struct {
+  uint32_t magic;                          // SMSA_WRITTEN_MAGIC
+  uint32_t unused;
+  int64_t size;                            // Size of SMSA_DISK_FILE, -1 if none
+  int64_t mtime_sec, mtime_nsec;           // When SMSA_DISK_FILE was last modified
+  uint64_t bits[SMSA_DISK_ARRAY_SIZE][SMSA_WRITTEN_WORDS]; // Bit per block
+} SMSA_WRITTEN_MAP;
+
+// Functional Prototypes
+void written_stamp( SMSA_WRITTEN_MAP *map );
+
+//
+// Global data
+static SMSA_WRITTEN_MAP written_map;
+static bool written_on = false;            // tracking writes?
+static uint64_t written_zeroed[SMSA_DISK_ARRAY_SIZE]; // blocks answered as zeros
+
+// Interfaces
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_written_load
+// Description  : Start tracking from a saved map.  With no map saved the
+//                array is only taken to be new (nothing written) if there is
+//                no SMSA_DISK_FILE either.  Otherwise a missing or
+//                unreadable map, or one saved before SMSA_DISK_FILE was last
+//                modified, marks every block written; formatting a drum
+//                clears its blocks again.
+//
+// Inputs       : path - the map file
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_written_load( const char *path ) {
+  SMSA_WRITTEN_MAP saved;
+  ssize_t n;
+  int fd;
+
+  memset( &written_map, 0x0, sizeof(written_map) );
+  memset( written_zeroed, 0x0, sizeof(written_zeroed) );
+  written_on = true;
+
+  if ( ( fd = open( path, O_RDONLY ) ) < 0 ) {
+    if ( errno == ENOENT ) {
+      written_stamp( &written_map );
+      if ( written_map.size >= 0 ) {
+        logMessage( LOG_INFO_LEVEL, "No written map [%s] for %s, treating every block as written",
+            path, SMSA_DISK_FILE );
+        memset( written_map.bits, 0xff, sizeof(written_map.bits) );
+      }
+      return 0;
+    }
+    logMessage( LOG_ERROR_LEVEL, "Unable to open written map [%s]: %s", path, strerror( errno ) );
+    written_on = false;
+    return -1;
+  }
+  n = read( fd, &saved, sizeof(saved) );
+  close( fd );
+
+  written_stamp( &written_map );
+  if ( ( n != sizeof(saved) ) || ( saved.magic != SMSA_WRITTEN_MAGIC ) ) {
+    logMessage( LOG_WARNING_LEVEL, "Written map [%s] is unreadable, treating every block as written", path );
+    memset( written_map.bits, 0xff, sizeof(written_map.bits) );
+  }
+  else if ( ( saved.size != written_map.size ) || ( saved.mtime_sec != written_map.mtime_sec ) ||
+            ( saved.mtime_nsec != written_map.mtime_nsec ) ) {
+    logMessage( LOG_WARNING_LEVEL, "Written map [%s] is older than %s, treating every block as written",
+        path, SMSA_DISK_FILE );
+    memset( written_map.bits, 0xff, sizeof(written_map.bits) );
+  }
+  else {
+    memcpy( written_map.bits, saved.bits, sizeof(written_map.bits) );
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_written_save
+// Description  : Keep the map for the next load, stamped with the current
+//                size and modification time of SMSA_DISK_FILE.  Save after
+//                the array file has been written back, or the next load
+//                will find the map stale.
+//
+// Inputs       : path - the map file
+// Outputs      : -1 if failure or 0 if successful
+
+int smsa_written_save( const char *path ) {
+  char temp[SMSA_WRITTEN_PATH_SIZE];
+  int fd, ret = 0;
+
+  if ( !written_on ) {
+    return 0;
+  }
+  if ( snprintf( temp, sizeof(temp), "%s.new", path ) >= (int)sizeof(temp) ) {
+    logMessage( LOG_ERROR_LEVEL, "Written map path is too long [%s]", path );
+    return -1;
+  }
+
+  written_map.magic = SMSA_WRITTEN_MAGIC;
+  written_stamp( &written_map );
+  if ( ( fd = open( temp, O_WRONLY|O_CREAT|O_TRUNC, 0644 ) ) < 0 ) {
+    logMessage( LOG_ERROR_LEVEL, "Unable to create written map [%s]: %s", temp, strerror( errno ) );
+    return -1;
+  }
+  if ( ( write( fd, &written_map, sizeof(written_map) ) != sizeof(written_map) ) || fsync( fd ) ) {
+    ret = -1;
+  }
+  if ( close( fd ) || ret || rename( temp, path ) ) {
+    logMessage( LOG_ERROR_LEVEL, "Unable to save written map [%s]: %s", path, strerror( errno ) );
+    unlink( temp );
+    return -1;
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_written_close
+// Description  : Stop tracking, every block counts as written until the
+//                next load.  The counters are kept.
+//
+// Inputs       : none
+// Outputs      : none
+
+void smsa_written_close( void ) {
+  written_on = false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_written_test
+// Description  : Check whether a block has been written
+//
+// Inputs       : drum - the drum of the block
+//                block - the block within the drum
+// Outputs      : true if written (or not tracking), false if never written
+
+bool smsa_written_test( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block ) {
+  if ( !written_on ) {
+    return true;
+  }
+  return( ( written_map.bits[drum][block / 64] >> ( block % 64 ) ) & 1 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_written_set
+// Description  : Note that a block has been written
+//
+// Inputs       : drum - the drum of the block
+//                block - the block within the drum
+// Outputs      : none
+
+void smsa_written_set( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block ) {
+  written_map.bits[drum][block / 64] |= ( (uint64_t)1 << ( block % 64 ) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_written_clear
+// Description  : Note that a drum has been formatted, none of its blocks
+//                have been written
+//
+// Inputs       : drum - the drum
+// Outputs      : none
+
+void smsa_written_clear( SMSA_DRUM_ID drum ) {
+  memset( written_map.bits[drum], 0x0, sizeof(written_map.bits[drum]) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_written_span
+// Description  : Get how far into a drum its written blocks reach
+//
+// Inputs       : drum - the drum
+// Outputs      : one past the last written block, 0 if none are
+
+uint32_t smsa_written_span( SMSA_DRUM_ID drum ) {
+  int word;
+
+  if ( !written_on ) {
+    return SMSA_MAX_BLOCK_ID;
+  }
+  for ( word = SMSA_WRITTEN_WORDS - 1; word >= 0; word-- ) {
+    if ( written_map.bits[drum][word] != 0 ) {
+      return( word * 64 + 64 - __builtin_clzll( written_map.bits[drum][word] ) );
+    }
+  }
+
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_written_zeroed
+// Description  : Count blocks of a drum that were answered as zeros
+//
+// Inputs       : drum - the drum
+//                blocks - the number of blocks
+// Outputs      : none
+
+void smsa_written_zeroed( SMSA_DRUM_ID drum, uint32_t blocks ) {
+  written_zeroed[drum] += blocks;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : smsa_written_stats
+// Description  : Get the blocks answered as zeros since the last load,
+//                summed over the drums
+//
+// Inputs       : none
+// Outputs      : the number of blocks
+
+uint64_t smsa_written_stats( void ) {
+  uint64_t total = 0;
+  int drum;
+
+  for ( drum = 0; drum < SMSA_DISK_ARRAY_SIZE; drum++ ) {
+    total += written_zeroed[drum];
+  }
+
+  return( total );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : written_stamp
+// Description  : Record the current size and modification time of SMSA_DISK_FILE
+//                in a map
+//
+// Inputs       : map - the map to stamp
+// Outputs      : none
+
+void written_stamp( SMSA_WRITTEN_MAP *map ) {
+  struct stat st;
+
+  if ( stat( SMSA_DISK_FILE, &st ) ) {
+    map->size = -1;
+    map->mtime_sec = map->mtime_nsec = 0;
+    return;
+  }
+  map->size = st.st_size;
+  map->mtime_sec = st.st_mtim.tv_sec;
+  map->mtime_nsec = st.st_mtim.tv_nsec;
+}
@@ -0,0 +1,63 @@
+#ifndef SMSA_WRITTEN_INCLUDED
+#define SMSA_WRITTEN_INCLUDED
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File           : smsa_written.h
+//  Description    : This is the written-block map used by the SMSA driver,
+//                   one bit for each block of the array that has been
+//                   written since it was new or its drum was formatted.
+//                   Blocks never written read as zeros, so the driver can
+//                   answer them without the device.  The map is kept in a
+//                   file between mounts along with the size and modification
+//                   time of SMSA_DISK_FILE; if the array file has changed
+//                   since, the map is stale and every block counts as
+//                   written.
+//                   Each drum has its own bits, so like the cache, calls
+//                   for the same drum must not run concurrently.
+//
+//   Author        :
+//   Last Modified :
+//
+
+// Include Files
+#include <stdint.h>
+#include <stdbool.h>
+
+// Project Include Files
+#include <smsa.h>
+
+// Defines
+#define SMSA_WRITTEN_FILE "smsa_written.dat" // Default map, next to SMSA_DISK_FILE
+
+//
+// Interfaces
+
+int smsa_written_load( const char *path );
+	// Start tracking from the map in path (none there, and no SMSA_DISK_FILE, means a new array)
+
+int smsa_written_save( const char *path );
+	// Keep the map in path for the next load
+
+void smsa_written_close( void );
+	// Stop tracking, every block counts as written (counters are kept)
+
+bool smsa_written_test( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block );
+	// Has the block been written? (always true when not tracking)
+
+void smsa_written_set( SMSA_DRUM_ID drum, SMSA_BLOCK_ID block );
+	// Note that a block has been written
+
+void smsa_written_clear( SMSA_DRUM_ID drum );
+	// Note that a drum has been formatted
+
+uint32_t smsa_written_span( SMSA_DRUM_ID drum );
+	// Get the number of blocks up to and including the last written one
+
+void smsa_written_zeroed( SMSA_DRUM_ID drum, uint32_t blocks );
+	// Count blocks of a drum answered as zeros
+
+uint64_t smsa_written_stats( void );
+	// Get the number of blocks answered as zeros since the last load
+
+#endif
@@ -0,0 +1,952 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : smsabench.c
+//  Description   : This is the benchmark for the SMSA driver.  It replays
+//                  workload files through the virtual driver with logging
+//                  silenced and reports throughput as CSV.  With -t it
+//                  instead measures random block I/O from 1 to 16 threads,
+//                  with -m the bytes per cycle of the copies between the
+//                  driver and the caller's buffer, and with -S the
+//                  throughput of striped transfers over 1 to 16 arrays.
+//
+//   Author :
+//   Last Modified :
+//
+
+// Include Files
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Project Includes
+#include <smsa.h>
+#include <smsa_driver.h>
+#include <smsa_journal.h>
+#include <smsa_written.h>
+#include <smsa_async.h>
+#include <smsa_workload.h>
+#include <smsa_signall.h>
+#include <smsa_stripe.h>
+#include <cmpsc311_log.h>
+
+// Defines
+#define SMSA_BENCH_ARGUMENTS "hn:c:wsa:o:t:p:r:m:S:u:jz"
+#define SMSA_BENCH_DEFAULT_RUNS 5
+#define SMSA_BENCH_MAX_THREADS 16
+#define SMSA_BENCH_WRITE_PCT 30
+#define SMSA_BENCH_COPY_SPAN 4096 // Bytes per call in the copy benchmark
+#define SMSA_BENCH_STRIPE_SPAN MAX_SMSA_VIRTUAL_ADDRESS // Bytes per striped call
+#define USAGE \
+	"USAGE: smsabench [-h] [-n <runs>] [-c <blocks>] [-w] [-s] [-a <depth>] [-o <usecs>] [-t <ops>] [-p <threads>] [-r <blocks>] [-m <MB>] [-S <MB>] [-u <bytes>] [-j] [-z] [<workload-file> ...]\n" \
+	"\n" \
+	"where:\n" \
+	"    -h - help mode (display this message)\n" \
+	"    -n - number of times to replay each workload (default 5)\n" \
+	"    -c - size of the driver block cache in blocks (0 disables)\n" \
+	"    -w - buffer writes in the driver cache (write back)\n" \
+	"    -s - skip SIGNALL commands\n" \
+	"    -a - replay through the async queue with up to <depth> requests in flight\n" \
+	"    -o - with -a or -t, run requests in C-LOOK order with a <usecs> deadline\n" \
+	"    -t - contention mode, <ops> random block reads/writes split over 1..16 threads\n" \
+	"    -p - hash SIGNALL block signatures on <threads> threads\n" \
+	"    -r - largest driver read-ahead window in blocks (0 disables)\n" \
+	"    -m - copy mode, bytes per cycle moving <MB> megabytes per case\n" \
+	"    -S - stripe mode, writing and reading <MB> megabytes over 1..16 arrays\n" \
+	"    -u - stripe unit in bytes for stripe mode (default 4096)\n" \
+	"    -j - journal writes to " SMSA_JOURNAL_FILE " (not in stripe mode)\n" \
+	"    -z - read never-written blocks as zeros, map in " SMSA_WRITTEN_FILE " (not in stripe mode)\n" \
+	"\n" \
+	"    <workload-file> - workloads to replay (default linear.dat random.dat simple.dat)\n" \
+	"\n" \
+
+//
+// Type definitions
+
+// The measurements from one replay of a workload
+typedef struct {
+	double seconds;         // Wall time for the replay
+	uint64_t bytes;         // Bytes moved by READ and WRITE commands
+	uint64_t device_ops;    // Operations the driver sent to the device
+} SMSA_BENCH_RUN;
+
+// How the copy benchmark moves the bytes
+typedef enum {
+	SMSA_BENCH_BYTE_LOOP = 0, // The driver's old per-byte loop
+	SMSA_BENCH_MEMCPY    = 1, // memcpy, as the driver copies edges now
+	SMSA_BENCH_VREAD     = 2, // smsa_vread from the cache
+} SMSA_BENCH_COPY;
+
+// The share of a contention run done by one thread
+typedef struct {
+	uint32_t ops;           // Number of block reads/writes to make
+	unsigned int seed;      // Seed for the thread's addresses
+	int err;                // Set if any driver call failed
+} SMSA_BENCH_THREAD;
+
+//
+// Global Data
+int skip_signall = 0;
+int async_depth = 0;
+int async_clook = 0;
+uint32_t contention_ops = 0;
+uint32_t copy_mbytes = 0;
+uint32_t stripe_mbytes = 0;
+uint32_t stripe_unit = SMSA_STRIPE_DEFAULT_UNIT;
+int signall_threads = 0;
+
+//
+// Functional Prototypes
+
+int bench_workload( const char *wload, int runs );
+int replay_workload( SMSA_WORKLOAD *wl, SMSA_BENCH_RUN *run );
+int replay_async( SMSA_WORKLOAD *wl, SMSA_BENCH_RUN *run );
+int async_call( SMSA_ASYNC_OP op );
+int async_settle( SMSA_ASYNC_REQUEST *reqs );
+int bench_contention( int runs );
+int contention_run( int threads, double *seconds, uint64_t *dev_ops );
+void * contention_thread( void *arg );
+int bench_copy( int runs );
+int copy_case( const char *name, int runs, uint32_t offset, SMSA_BENCH_COPY how );
+void byte_copy( uint32_t len, uint32_t offset, int *copied, unsigned char *temp, unsigned char *buf );
+int bench_stripe( int runs );
+int stripe_run( int members, double *seconds );
+uint64_t now_cycles( void );
+uint64_t device_ops( void );
+double now_seconds( void );
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : main
+// Description  : The main function for the SMSA benchmark
+//
+// Inputs       : argc - the number of command line parameters
+//                argv - the parameters
+// Outputs      : 0 if successful, -1 if failure
+
+int main( int argc, char *argv[] )
+{
+	// Local variables
+	char *defaults[] = { "linear.dat", "random.dat", "simple.dat" };
+	int ch, i, runs = SMSA_BENCH_DEFAULT_RUNS;
+
+	// Process the command line parameters
+	while ((ch = getopt(argc, argv, SMSA_BENCH_ARGUMENTS)) != -1) {
+
+		switch (ch) {
+		case 'h': // Help, print usage
+			fprintf( stderr, USAGE );
+			return( -1 );
+
+		case 'n': // Number of runs
+			runs = atoi( optarg );
+			break;
+
+		case 'c': // Set the driver cache size
+			smsa_vcache_size( strtoul(optarg, NULL, 10) );
+			break;
+
+		case 'w': // Write back mode
+			smsa_vwrite_mode( SMSA_WRITE_BACK );
+			break;
+
+		case 's': // Skip the signature sweeps
+			skip_signall = 1;
+			break;
+
+		case 'a': // Replay through the async queue
+			async_depth = atoi( optarg );
+			break;
+
+		case 'o': // C-LOOK async scheduling
+			smsa_async_scheduler( SMSA_ASYNC_CLOOK, strtoul(optarg, NULL, 10) );
+			async_clook = 1;
+			break;
+
+		case 'p': // Parallel signature sweeps
+			signall_threads = atoi( optarg );
+			break;
+
+		case 'r': // Set the driver read-ahead depth
+			smsa_vreadahead( strtoul(optarg, NULL, 10) );
+			break;
+
+		case 't': // Multithreaded contention benchmark
+			contention_ops = strtoul( optarg, NULL, 10 );
+			break;
+
+		case 'm': // Copy microbenchmark
+			copy_mbytes = strtoul( optarg, NULL, 10 );
+			break;
+
+		case 'S': // Striped throughput benchmark
+			stripe_mbytes = strtoul( optarg, NULL, 10 );
+			break;
+
+		case 'u': // Stripe unit
+			stripe_unit = strtoul( optarg, NULL, 10 );
+			break;
+
+		case 'j': // Write-ahead journal
+			smsa_vjournal( SMSA_JOURNAL_FILE );
+			break;
+
+		case 'z': // Written-block map
+			smsa_vwritten( SMSA_WRITTEN_FILE );
+			break;
+
+		default:  // Default (unknown)
+			fprintf( stderr, "Unknown command line option (%c), aborting.\n", ch );
+			return( -1 );
+		}
+	}
+
+	if ( runs < 1 ) {
+		fprintf( stderr, "Number of runs must be at least 1, aborting.\n" );
+		return( -1 );
+	}
+
+	// Only errors get through, everything else would be timed too
+	initializeLogWithFilehandle( CMPSC311_LOG_STDERR );
+	disableLogLevels( LOG_WARNING_LEVEL|LOG_INFO_LEVEL|LOG_OUTPUT_LEVEL );
+	if ( contention_ops > 0 ) {
+		return( bench_contention( runs ) );
+	}
+	if ( copy_mbytes > 0 ) {
+		return( bench_copy( runs ) );
+	}
+	if ( stripe_mbytes > 0 ) {
+		return( bench_stripe( runs ) );
+	}
+
+	printf( "# type,workload,run,commands,seconds,cmds_per_sec,mb_per_sec,dev_ops_per_cmd\n" );
+	printf( "# type,workload,runs,commands,mean_cmds_per_sec,stddev_cmds_per_sec,"
+		"mean_mb_per_sec,stddev_mb_per_sec,dev_ops_per_cmd\n" );
+	if ( async_depth > 0 ) {
+		printf( "# type,workload,requests,mean_seek_blocks,mean_queue_usecs,max_queue_usecs,expired\n" );
+	}
+
+	if ( optind >= argc ) {
+		for ( i=0; i<3; i++ ) {
+			if ( bench_workload( defaults[i], runs ) ) {
+				return( -1 );
+			}
+		}
+	} else {
+		for ( i=optind; i<argc; i++ ) {
+			if ( bench_workload( argv[i], runs ) ) {
+				return( -1 );
+			}
+		}
+	}
+
+	// Return successfully
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_workload
+// Description  : Replay a workload a number of times, printing a "run" line
+//                for each replay and a "summary" line with the mean and
+//                standard deviation across replays, and through the async
+//                queue an "async" line with its scheduling counters
+//
+// Inputs       : wload - the name of the workload file
+//                runs - the number of replays
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_workload( const char *wload, int runs ) {
+
+	// Local variables
+	SMSA_WORKLOAD wl;
+	SMSA_BENCH_RUN run;
+	SMSA_ASYNC_STATS astats;
+	double cps, mbps, sum_cps = 0, sum_cps2 = 0, sum_mbps = 0, sum_mbps2 = 0, opc = 0;
+	int i;
+
+	if ( smsa_load_workload( wload, &wl ) ) {
+		fprintf( stderr, "Failure loading workload [%s], aborting.\n", wload );
+		return( -1 );
+	}
+
+	// Each workload gets its own worker, so its counters start at zero
+	if ( (async_depth > 0) && smsa_async_start() ) {
+		smsa_free_workload( &wl );
+		return( -1 );
+	}
+
+	for ( i=0; i<runs; i++ ) {
+		if ( (async_depth > 0) ? replay_async( &wl, &run ) : replay_workload( &wl, &run ) ) {
+			fprintf( stderr, "Failure replaying workload [%s], aborting.\n", wload );
+			smsa_async_stop();
+			smsa_free_workload( &wl );
+			return( -1 );
+		}
+
+		cps = wl.count / run.seconds;
+		mbps = run.bytes / run.seconds / 1000000.0;
+		opc = (double)run.device_ops / wl.count;
+		sum_cps += cps;
+		sum_cps2 += cps * cps;
+		sum_mbps += mbps;
+		sum_mbps2 += mbps * mbps;
+		printf( "run,%s,%d,%u,%.6f,%.1f,%.3f,%.3f\n", wload, i+1, wl.count,
+			run.seconds, cps, mbps, opc );
+	}
+
+	printf( "summary,%s,%d,%u,%.1f,%.1f,%.3f,%.3f,%.3f\n", wload, runs, wl.count,
+		sum_cps/runs, sqrt( fmax( 0, sum_cps2/runs - (sum_cps/runs)*(sum_cps/runs) ) ),
+		sum_mbps/runs, sqrt( fmax( 0, sum_mbps2/runs - (sum_mbps/runs)*(sum_mbps/runs) ) ),
+		opc );
+	if ( async_depth > 0 ) {
+		smsa_async_stats( &astats );
+		smsa_async_stop();
+		printf( "async,%s,%" PRIu64 ",%.1f,%.1f,%.1f,%" PRIu64 "\n", wload, astats.requests,
+			astats.requests ? (double)astats.seek_blocks / astats.requests : 0,
+			astats.requests ? astats.queue_nsecs / 1e3 / astats.requests : 0,
+			astats.queue_max_nsecs / 1e3, astats.expired );
+	}
+	fflush( stdout );
+
+	smsa_free_workload( &wl );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : replay_workload
+// Description  : Run every command of a workload through the driver once
+//
+// Inputs       : wl - the loaded workload
+//                run - the place to put the measurements
+// Outputs      : 0 if successful, -1 if failure
+
+int replay_workload( SMSA_WORKLOAD *wl, SMSA_BENCH_RUN *run ) {
+
+	// Local variables
+	unsigned char buf[SMSA_MAXIMUM_RDWR_SIZE];
+	SMSA_WORKLOAD_CMD *cmd;
+	double start;
+	uint32_t i;
+	int err = 0, mounted = 0;
+
+	memset( run, 0x0, sizeof(SMSA_BENCH_RUN) );
+	start = now_seconds();
+
+	for ( i=0; (i<wl->count) && !err; i++ ) {
+		cmd = &wl->cmds[i];
+
+		switch ( cmd->op ) {
+		case SMSA_WL_MOUNT:
+			// The driver counters restart at every mount
+			if ( mounted ) {
+				run->device_ops += device_ops();
+			}
+			err = smsa_vmount();
+			mounted = 1;
+			break;
+
+		case SMSA_WL_UNMOUNT:
+			err = smsa_vunmount();
+			break;
+
+		case SMSA_WL_SIGNALL:
+			if ( skip_signall ) {
+				break;
+			}
+			if ( !(err = smsa_vflush()) ) {
+				err = smsa_signall( signall_threads );
+			}
+			break;
+
+		case SMSA_WL_READ:
+			err = smsa_vread( cmd->addr, cmd->len, buf );
+			run->bytes += cmd->len;
+			break;
+
+		case SMSA_WL_WRITE:
+			memset( buf, cmd->ch, cmd->len );
+			err = smsa_vwrite( cmd->addr, cmd->len, buf );
+			run->bytes += cmd->len;
+			break;
+		}
+	}
+
+	run->seconds = now_seconds() - start;
+	if ( mounted ) {
+		run->device_ops += device_ops();
+	}
+
+	return( err ? -1 : 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : replay_async
+// Description  : Run every command of a workload through the async queue
+//                once.  READ and WRITE are submitted without waiting, using
+//                a ring of async_depth requests; the other commands wait for
+//                the ring to empty and run on their own.
+//
+// Inputs       : wl - the loaded workload
+//                run - the place to put the measurements
+// Outputs      : 0 if successful, -1 if failure
+
+int replay_async( SMSA_WORKLOAD *wl, SMSA_BENCH_RUN *run ) {
+
+	// Local variables
+	SMSA_ASYNC_REQUEST *reqs, *req;
+	unsigned char *bufs;
+	SMSA_WORKLOAD_CMD *cmd;
+	double start;
+	uint32_t i, slot = 0;
+	int err = 0, mounted = 0;
+
+	reqs = calloc( async_depth, sizeof(SMSA_ASYNC_REQUEST) );
+	bufs = malloc( async_depth * SMSA_MAXIMUM_RDWR_SIZE );
+	if ( (reqs == NULL) || (bufs == NULL) ) {
+		free( reqs );
+		free( bufs );
+		return( -1 );
+	}
+
+	memset( run, 0x0, sizeof(SMSA_BENCH_RUN) );
+	start = now_seconds();
+
+	for ( i=0; (i<wl->count) && !err; i++ ) {
+		cmd = &wl->cmds[i];
+
+		switch ( cmd->op ) {
+		case SMSA_WL_MOUNT:
+			if ( (err = async_settle( reqs )) ) {
+				break;
+			}
+			if ( mounted ) {
+				run->device_ops += device_ops();
+			}
+			err = async_call( SMSA_ASYNC_MOUNT );
+			mounted = 1;
+			break;
+
+		case SMSA_WL_UNMOUNT:
+			if ( !(err = async_settle( reqs )) ) {
+				err = async_call( SMSA_ASYNC_UNMOUNT );
+			}
+			break;
+
+		case SMSA_WL_SIGNALL:
+			if ( skip_signall ) {
+				break;
+			}
+			if ( !(err = async_settle( reqs )) && !(err = async_call( SMSA_ASYNC_FLUSH )) ) {
+				err = smsa_signall( signall_threads );
+			}
+			break;
+
+		case SMSA_WL_READ:
+		case SMSA_WL_WRITE:
+			// Reuse the oldest request in the ring once it is done
+			req = &reqs[slot];
+			if ( (req->state != SMSA_ASYNC_IDLE) && (err = smsa_async_wait( req )) ) {
+				break;
+			}
+			req->op = (cmd->op == SMSA_WL_READ) ? SMSA_ASYNC_READ : SMSA_ASYNC_WRITE;
+			req->addr = cmd->addr;
+			req->len = cmd->len;
+			req->buf = &bufs[slot * SMSA_MAXIMUM_RDWR_SIZE];
+			if ( cmd->op == SMSA_WL_WRITE ) {
+				memset( req->buf, cmd->ch, cmd->len );
+			}
+			err = smsa_async_submit( req );
+			run->bytes += cmd->len;
+			slot = (slot + 1) % async_depth;
+			break;
+		}
+	}
+
+	if ( !err ) {
+		err = async_settle( reqs );
+	}
+	smsa_async_drain();
+	run->seconds = now_seconds() - start;
+	if ( mounted ) {
+		run->device_ops += device_ops();
+	}
+
+	free( reqs );
+	free( bufs );
+	return( err ? -1 : 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : async_call
+// Description  : Submit an operation with no data and wait for it
+//
+// Inputs       : op - the operation
+// Outputs      : the result of the operation
+
+int async_call( SMSA_ASYNC_OP op ) {
+
+	// Local variables
+	SMSA_ASYNC_REQUEST req;
+
+	memset( &req, 0x0, sizeof(req) );
+	req.op = op;
+	if ( smsa_async_submit( &req ) ) {
+		return( -1 );
+	}
+	return( smsa_async_wait( &req ) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : async_settle
+// Description  : Wait for every request in the ring and check the results
+//
+// Inputs       : reqs - the ring of async_depth requests
+// Outputs      : 0 if all succeeded, -1 if any failed
+
+int async_settle( SMSA_ASYNC_REQUEST *reqs ) {
+
+	// Local variables
+	int i, err = 0;
+
+	for ( i=0; i<async_depth; i++ ) {
+		if ( reqs[i].state != SMSA_ASYNC_IDLE ) {
+			err |= smsa_async_wait( &reqs[i] );
+			reqs[i].state = SMSA_ASYNC_IDLE;
+		}
+	}
+	return( err ? -1 : 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_contention
+// Description  : Measure driver throughput as the number of threads calling
+//                it grows, doubling from 1 to SMSA_BENCH_MAX_THREADS.  The
+//                same total number of operations is split over the threads.
+//
+// Inputs       : runs - the number of runs at each thread count
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_contention( int runs ) {
+
+	// Local variables
+	double seconds, ops_sec, sum = 0, sum2 = 0;
+	SMSA_DRIVER_STATS stats;
+	uint64_t dev_ops = 0;
+	int threads, i;
+
+	printf( "# type,threads,run,ops,seconds,ops_per_sec,dev_ops_per_op\n" );
+	printf( "# type,threads,runs,ops,mean_ops_per_sec,stddev_ops_per_sec,dev_ops_per_op\n" );
+	printf( "# type,threads,run,journal_records,journal_commits,records_per_commit\n" );
+
+	for ( threads=1; threads<=SMSA_BENCH_MAX_THREADS; threads*=2 ) {
+		sum = sum2 = 0;
+		for ( i=0; i<runs; i++ ) {
+			if ( contention_run( threads, &seconds, &dev_ops ) ) {
+				fprintf( stderr, "Failure running contention benchmark [%d threads], aborting.\n", threads );
+				return( -1 );
+			}
+			ops_sec = contention_ops / seconds;
+			sum += ops_sec;
+			sum2 += ops_sec * ops_sec;
+			printf( "contention,%d,%d,%u,%.6f,%.1f,%.3f\n", threads, i+1, contention_ops,
+				seconds, ops_sec, (double)dev_ops / contention_ops );
+
+			// The journal keeps its counters past the unmount
+			smsa_vstats( &stats );
+			if ( stats.journal_commits > 0 ) {
+				printf( "journal,%d,%d,%" PRIu64 ",%" PRIu64 ",%.2f\n", threads, i+1, stats.journal_records,
+					stats.journal_commits, (double)stats.journal_records / stats.journal_commits );
+			}
+		}
+
+		printf( "contention_summary,%d,%d,%u,%.1f,%.1f,%.3f\n", threads, runs, contention_ops,
+			sum/runs, sqrt( fmax( 0, sum2/runs - (sum/runs)*(sum/runs) ) ),
+			(double)dev_ops / contention_ops );
+		fflush( stdout );
+	}
+
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : contention_run
+// Description  : Mount the array, run the threads to completion and unmount.
+//                Under C-LOOK the async worker runs meanwhile, so the
+//                threads' calls wait their turn in its queue.
+//
+// Inputs       : threads - the number of threads
+//                seconds - the place to put the wall time of the threads
+//                dev_ops - the place to put the device operation count
+// Outputs      : 0 if successful, -1 if failure
+
+int contention_run( int threads, double *seconds, uint64_t *dev_ops ) {
+
+	// Local variables
+	pthread_t tids[SMSA_BENCH_MAX_THREADS];
+	SMSA_BENCH_THREAD work[SMSA_BENCH_MAX_THREADS];
+	double start;
+	int i, started, err = 0;
+
+	if ( smsa_vmount() ) {
+		return( -1 );
+	}
+	if ( async_clook && smsa_async_start() ) {
+		smsa_vunmount();
+		return( -1 );
+	}
+
+	start = now_seconds();
+	for ( started=0; started<threads; started++ ) {
+		work[started].ops = contention_ops / threads + ( started < contention_ops % threads );
+		work[started].seed = started + 1;
+		work[started].err = 0;
+		if ( pthread_create( &tids[started], NULL, contention_thread, &work[started] ) ) {
+			err = 1;
+			break;
+		}
+	}
+	for ( i=0; i<started; i++ ) {
+		pthread_join( tids[i], NULL );
+		err |= work[i].err;
+	}
+	*seconds = now_seconds() - start;
+	*dev_ops = device_ops();
+
+	if ( async_clook ) {
+		smsa_async_stop();
+	}
+	if ( smsa_vunmount() ) {
+		return( -1 );
+	}
+	return( err ? -1 : 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : contention_thread
+// Description  : Read or write whole random blocks, SMSA_BENCH_WRITE_PCT
+//                percent of them writes
+//
+// Inputs       : arg - the thread's SMSA_BENCH_THREAD
+// Outputs      : NULL
+
+void * contention_thread( void *arg ) {
+
+	// Local variables
+	SMSA_BENCH_THREAD *work = arg;
+	unsigned char buf[SMSA_BLOCK_SIZE];
+	uint32_t i, addr;
+
+	for ( i=0; (i<work->ops) && !work->err; i++ ) {
+		addr = ( rand_r( &work->seed ) % (SMSA_DISK_ARRAY_SIZE * SMSA_MAX_BLOCK_ID) ) * SMSA_BLOCK_SIZE;
+		if ( (rand_r( &work->seed ) % 100) < SMSA_BENCH_WRITE_PCT ) {
+			memset( buf, i & 0xff, SMSA_BLOCK_SIZE );
+			work->err = smsa_vwrite( addr, SMSA_BLOCK_SIZE, buf );
+		} else {
+			work->err = smsa_vread( addr, SMSA_BLOCK_SIZE, buf );
+		}
+	}
+
+	return( NULL );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_copy
+// Description  : Measure the bytes per cycle of moving data to the caller.
+//                The byte_loop and memcpy cases copy the block edges the way
+//                the driver used to and does now; the vread cases time
+//                smsa_vread of a block-aligned and an unaligned span that
+//                the cache holds, so no device operations are timed.
+//
+// Inputs       : runs - the number of runs of each case
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_copy( int runs ) {
+
+	// Local variables
+	int err = 0;
+
+	printf( "# type,case,run,bytes,cycles,bytes_per_cycle\n" );
+	printf( "# type,case,runs,bytes,mean_bytes_per_cycle,stddev_bytes_per_cycle\n" );
+#if !defined(__x86_64__) && !defined(__i386__)
+	printf( "# no cycle counter, cycles are nanoseconds\n" );
+#endif
+
+	if ( smsa_vmount() ) {
+		return( -1 );
+	}
+	err |= copy_case( "byte_loop", runs, 0, SMSA_BENCH_BYTE_LOOP );
+	err |= copy_case( "memcpy", runs, 0, SMSA_BENCH_MEMCPY );
+	err |= copy_case( "vread_aligned", runs, 0, SMSA_BENCH_VREAD );
+	err |= copy_case( "vread_unaligned", runs, 13, SMSA_BENCH_VREAD );
+	if ( smsa_vunmount() || err ) {
+		fprintf( stderr, "Failure running copy benchmark, aborting.\n" );
+		return( -1 );
+	}
+
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : copy_case
+// Description  : Run one case of the copy benchmark, moving copy_mbytes
+//                megabytes SMSA_BENCH_COPY_SPAN bytes at a time
+//
+// Inputs       : name - the case name for the CSV lines
+//                runs - the number of runs
+//                offset - the byte offset of the span in its first block
+//                how - how to move the bytes
+// Outputs      : 0 if successful, -1 if failure
+
+int copy_case( const char *name, int runs, uint32_t offset, SMSA_BENCH_COPY how ) {
+
+	// Local variables
+	static unsigned char src[SMSA_BENCH_COPY_SPAN + SMSA_BLOCK_SIZE], dst[SMSA_BENCH_COPY_SPAN];
+	uint64_t bytes = (uint64_t)copy_mbytes * 1024 * 1024, moved, cycles;
+	double rate, sum = 0, sum2 = 0;
+	uint32_t blk;
+	int i, copied;
+
+	// Warm the cache with the span before timing the driver
+	if ( ( how == SMSA_BENCH_VREAD ) && smsa_vread( offset, SMSA_BENCH_COPY_SPAN, dst ) ) {
+		return( -1 );
+	}
+
+	for ( i=0; i<runs; i++ ) {
+		cycles = now_cycles();
+		for ( moved=0; moved<bytes; moved+=SMSA_BENCH_COPY_SPAN ) {
+			if ( how == SMSA_BENCH_VREAD ) {
+				if ( smsa_vread( offset, SMSA_BENCH_COPY_SPAN, dst ) ) {
+					return( -1 );
+				}
+			} else if ( how == SMSA_BENCH_BYTE_LOOP ) {
+				copied = 0;
+				for ( blk=0; blk<SMSA_BENCH_COPY_SPAN/SMSA_BLOCK_SIZE; blk++ ) {
+					byte_copy( SMSA_BENCH_COPY_SPAN, ( blk == 0 ) ? offset : 0, &copied,
+						&src[blk*SMSA_BLOCK_SIZE], dst );
+				}
+			} else {
+				for ( blk=0; blk<SMSA_BENCH_COPY_SPAN/SMSA_BLOCK_SIZE; blk++ ) {
+					memcpy( &dst[blk*SMSA_BLOCK_SIZE], &src[blk*SMSA_BLOCK_SIZE], SMSA_BLOCK_SIZE );
+				}
+			}
+		}
+		cycles = now_cycles() - cycles;
+
+		rate = (double)bytes / cycles;
+		sum += rate;
+		sum2 += rate * rate;
+		printf( "copy,%s,%d,%" PRIu64 ",%" PRIu64 ",%.4f\n", name, i+1, bytes,
+			cycles, rate );
+	}
+
+	printf( "copy_summary,%s,%d,%" PRIu64 ",%.4f,%.4f\n", name, runs, bytes,
+		sum/runs, sqrt( fmax( 0, sum2/runs - (sum/runs)*(sum/runs) ) ) );
+	fflush( stdout );
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : byte_copy
+// Description  : The per-byte copy the driver used for every block before
+//                the direct transfers, kept here as the baseline
+//
+// Inputs       : len - the number of bytes in the whole transfer
+//                offset - the offset in the block to start at
+//                copied - a reference to the number of bytes already copied
+//                temp - the block
+//                buf - the destination of the whole transfer
+// Outputs      : none
+
+void byte_copy( uint32_t len, uint32_t offset, int *copied, unsigned char *temp, unsigned char *buf ) {
+
+	// Local variables
+	int i = offset;
+
+	do {
+		buf[*copied] = temp[i];
+		(*copied)++;
+		i++;
+	} while( ( i < SMSA_BLOCK_SIZE ) && ( *copied < len ) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : bench_stripe
+// Description  : Measure striped transfer throughput as the number of
+//                member arrays doubles from 1 to SMSA_STRIPE_MAX_MEMBERS.
+//                The same bytes are moved at every member count, in
+//                SMSA_BENCH_STRIPE_SPAN transfers, so each member does less
+//                of the work as the count grows.
+//
+// Inputs       : runs - the number of runs at each member count
+// Outputs      : 0 if successful, -1 if failure
+
+int bench_stripe( int runs ) {
+
+	// Local variables
+	uint64_t bytes = (uint64_t)stripe_mbytes * 1024 * 1024 * 2;
+	double seconds, rate, sum, sum2;
+	int members, i;
+
+	// The members are processes, so the scaling depends on the CPUs there are
+	printf( "# cpus,%ld\n", sysconf( _SC_NPROCESSORS_ONLN ) );
+	printf( "# type,members,unit,run,bytes,seconds,mb_per_sec\n" );
+	printf( "# type,members,unit,runs,bytes,mean_mb_per_sec,stddev_mb_per_sec\n" );
+
+	for ( members=1; members<=SMSA_STRIPE_MAX_MEMBERS; members*=2 ) {
+		if ( smsa_stripe_open( members, stripe_unit, NULL ) ) {
+			fprintf( stderr, "Unable to open stripe set [%d members], aborting.\n", members );
+			return( -1 );
+		}
+
+		sum = sum2 = 0;
+		for ( i=0; i<runs; i++ ) {
+			if ( stripe_run( members, &seconds ) ) {
+				fprintf( stderr, "Failure running stripe benchmark [%d members], aborting.\n", members );
+				smsa_stripe_close();
+				return( -1 );
+			}
+			rate = bytes / seconds / (1024*1024);
+			sum += rate;
+			sum2 += rate * rate;
+			printf( "stripe,%d,%u,%d,%" PRIu64 ",%.6f,%.2f\n", members, stripe_unit, i+1,
+				bytes, seconds, rate );
+		}
+
+		printf( "stripe_summary,%d,%u,%d,%" PRIu64 ",%.2f,%.2f\n", members, stripe_unit, runs,
+			bytes, sum/runs, sqrt( fmax( 0, sum2/runs - (sum/runs)*(sum/runs) ) ) );
+		fflush( stdout );
+		if ( smsa_stripe_close() ) {
+			return( -1 );
+		}
+	}
+
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : stripe_run
+// Description  : Mount the stripe set, write stripe_mbytes megabytes across
+//                it and read them back, then unmount
+//
+// Inputs       : members - the number of member arrays
+//                seconds - the place to put the wall time of the transfers
+// Outputs      : 0 if successful, -1 if failure
+
+int stripe_run( int members, double *seconds ) {
+
+	// Local variables
+	static unsigned char buf[SMSA_BENCH_STRIPE_SPAN];
+	uint64_t bytes = (uint64_t)stripe_mbytes * 1024 * 1024, moved;
+	uint32_t addr, size = smsa_stripe_size();
+	double start;
+	int err = 0;
+
+	if ( smsa_stripe_vmount() ) {
+		return( -1 );
+	}
+
+	memset( buf, members, SMSA_BENCH_STRIPE_SPAN );
+	start = now_seconds();
+	for ( moved=0, addr=0; !err && (moved<bytes); moved+=SMSA_BENCH_STRIPE_SPAN ) {
+		err = smsa_stripe_vwrite( addr, SMSA_BENCH_STRIPE_SPAN, buf );
+		addr = ( addr + SMSA_BENCH_STRIPE_SPAN ) % size;
+	}
+	for ( moved=0, addr=0; !err && (moved<bytes); moved+=SMSA_BENCH_STRIPE_SPAN ) {
+		err = smsa_stripe_vread( addr, SMSA_BENCH_STRIPE_SPAN, buf );
+		addr = ( addr + SMSA_BENCH_STRIPE_SPAN ) % size;
+	}
+	if ( !err ) {
+		err = smsa_stripe_vflush();
+	}
+	*seconds = now_seconds() - start;
+
+	if ( smsa_stripe_vunmount() || err ) {
+		return( -1 );
+	}
+	return( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : now_cycles
+// Description  : Read the CPU cycle counter (the monotonic clock in
+//                nanoseconds where there is none)
+//
+// Inputs       : none
+// Outputs      : the current cycle count
+
+uint64_t now_cycles( void ) {
+#if defined(__x86_64__) || defined(__i386__)
+	return( __rdtsc() );
+#else
+	// Local variables
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return( (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec );
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : device_ops
+// Description  : Get the number of operations the driver sent to the device
+//                since the last mount
+//
+// Inputs       : none
+// Outputs      : the operation count
+
+uint64_t device_ops( void ) {
+
+	// Local variables
+	SMSA_DRIVER_STATS stats;
+	uint64_t total = 0;
+	int i;
+
+	smsa_vstats( &stats );
+	for ( i=0; i<SMSA_MAX_COMMAND; i++ ) {
+		total += stats.ops[i];
+	}
+	return( total );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : now_seconds
+// Description  : Read the monotonic clock
+//
+// Inputs       : none
+// Outputs      : the current time in seconds
+
+double now_seconds( void ) {
+
+	// Local variables
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return( ts.tv_sec + ts.tv_nsec / 1000000000.0 );
+}
@@ -0,0 +1,231 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+//  File          : smsatrace.c
+//  Description   : This is the trace player for the SMSA tools.  It sends the
+//                  operations of a trace recorded by the driver (smsasim -T)
+//                  back to the device, as fast as it will take them or at
+//                  the times they were first made, or prints the trace.
+//
+//   Author :
+//   Last Modified :
+//
+
+// Include Files
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+
+// Project Includes
+#include <smsa.h>
+#include <smsa_trace.h>
+#include <cmpsc311_log.h>
+
+// Defines
+#define SMSA_TRACE_ARGUMENTS "hvl:rp"
+#define USAGE \
+	"USAGE: smsatrace [-h] [-v] [-l <logfile>] [-r | -p] <tracefile>\n" \
+	"\n" \
+	"where:\n" \
+	"    -h - help mode (display this message)\n" \
+	"    -v - verbose output\n" \
+	"    -l - write log messages to the filename <logfile>\n" \
+	"    -r - replay at the times the operations were recorded\n" \
+	"    -p - print the trace instead of replaying it\n" \
+	"\n" \
+	"    By default the trace is replayed as fast as the device allows.  The\n" \
+	"    trace holds no block contents, so replayed writes store zeros.\n" \
+	"\n" \
+
+//
+// Functional Prototypes
+
+int replay_trace( const char *path, int timed );
+int print_trace( const char *path );
+uint64_t trace_now( void );
+
+//
+// Functions
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : main
+// Description  : The main function for the trace player
+//
+// Inputs       : argc - the number of command line parameters
+//                argv - the parameters
+// Outputs      : 0 if successful, -1 if failure
+
+int main( int argc, char *argv[] )
+{
+	// Local variables
+	int ch, verbose = 0, log_initialized = 0, timed = 0, print = 0;
+
+	// Process the command line parameters
+	while ((ch = getopt(argc, argv, SMSA_TRACE_ARGUMENTS)) != -1) {
+
+		switch (ch) {
+		case 'h': // Help, print usage
+			fprintf( stderr, USAGE );
+			return( -1 );
+
+		case 'v': // Verbose Flag
+			verbose = 1;
+			break;
+
+		case 'l': // Set the log filename
+			initializeLogWithFilename( optarg );
+			log_initialized = 1;
+			break;
+
+		case 'r': // Original timing
+			timed = 1;
+			break;
+
+		case 'p': // Print the trace
+			print = 1;
+			break;
+
+		default:  // Default (unknown)
+			fprintf( stderr, "Unknown command line option (%c), aborting.\n", ch );
+			return( -1 );
+		}
+	}
+
+	if ( optind + 1 != argc ) {
+		fprintf( stderr, "Missing command line parameters, use -h to see usage, aborting.\n" );
+		return( -1 );
+	}
+
+	// Setup the log as needed
+	if ( ! log_initialized ) {
+		initializeLogWithFilehandle( CMPSC311_LOG_STDERR );
+	}
+	if ( verbose ) {
+		enableLogLevels( LOG_INFO_LEVEL );
+	}
+
+	if ( print ) {
+		return( print_trace( argv[optind] ) );
+	}
+	return( replay_trace( argv[optind], timed ) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : replay_trace
+// Description  : Send every operation of a trace to the device
+//
+// Inputs       : path - the trace to replay
+//                timed - 1 to wait for the recorded time of each operation
+// Outputs      : 0 if successful, -1 if failure
+
+int replay_trace( const char *path, int timed ) {
+
+	// Local variables
+	SMSA_TRACE_READER tr;
+	SMSA_TRACE_RECORD rec;
+	unsigned char block[SMSA_BLOCK_SIZE];
+	uint64_t ops = 0, failed = 0, late = 0, start, now, due;
+	struct timespec ts;
+	uint32_t op;
+	double secs;
+	int ret;
+
+	if ( smsa_trace_read_open( path, &tr ) ) {
+		return( -1 );
+	}
+
+	start = trace_now();
+	while ( (ret = smsa_trace_next( &tr, &rec )) == 1 ) {
+
+		// Wait until the operation is due, noting how late it was made
+		if ( timed ) {
+			due = start + rec.usecs * 1000;
+			now = trace_now();
+			if ( now < due ) {
+				ts.tv_sec = ( due - now ) / 1000000000;
+				ts.tv_nsec = ( due - now ) % 1000000000;
+				nanosleep( &ts, NULL );
+				now = trace_now();
+			}
+			late += ( now > due ) ? now - due : 0;
+		}
+
+		// Reads and writes need a block, the rest take none
+		op = rec.instruction >> 26;
+		if ( (op == SMSA_DISK_READ) || (op == SMSA_DISK_WRITE) ) {
+			memset( block, 0x0, SMSA_BLOCK_SIZE );
+			failed += ( smsa_operation( rec.instruction, block ) != 0 );
+		} else {
+			failed += ( smsa_operation( rec.instruction, NULL ) != 0 );
+		}
+		ops ++;
+	}
+	smsa_trace_read_close( &tr );
+
+	secs = ( trace_now() - start ) / 1e9;
+	logMessage( LOG_OUTPUT_LEVEL, "Replayed %" PRIu64 " operations (%" PRIu64 " failed) in %.3f seconds, %.0f ops/sec",
+		ops, failed, secs, ( secs > 0 ) ? ops / secs : 0 );
+	if ( timed && ops ) {
+		logMessage( LOG_OUTPUT_LEVEL, "Average lateness %.1f usecs", late / 1e3 / ops );
+	}
+
+	// Return successfully if the whole trace was read and replayed
+	return( ( (ret == 0) && (failed == 0) ) ? 0 : -1 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : print_trace
+// Description  : Print a trace as text, one operation per line
+//
+// Inputs       : path - the trace to print
+// Outputs      : 0 if successful, -1 if failure
+
+int print_trace( const char *path ) {
+
+	// Local variables
+	SMSA_TRACE_READER tr;
+	SMSA_TRACE_RECORD rec;
+	uint32_t op;
+	int ret;
+
+	if ( smsa_trace_read_open( path, &tr ) ) {
+		return( -1 );
+	}
+
+	while ( (ret = smsa_trace_next( &tr, &rec )) == 1 ) {
+		op = rec.instruction >> 26;
+		printf( "%12" PRIu64 " %-11s drum %2u block %3u", rec.usecs, smsa_trace_op_name( op ),
+			(rec.instruction >> 22) & 0xf, rec.instruction & 0x3fffff );
+		if ( tr.hashes ) {
+			printf( " hash %016" PRIx64, rec.hash );
+		}
+		printf( "\n" );
+	}
+	smsa_trace_read_close( &tr );
+
+	// Return successfully if the whole trace was read
+	return( (ret == 0) ? 0 : -1 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : trace_now
+// Description  : Get the monotonic clock in nanoseconds
+//
+// Inputs       : none
+// Outputs      : the time
+
+uint64_t trace_now( void ) {
+
+	// Local variables
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return( (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec );
+}
@@ -7,15 +7,24 @@
 //                  uses a known correct file with correct output containing
 //                  checksums generated from a correct implementation of the
 //                  homework to compare against a student's output file or
-//                  piped program output.
+//                  piped program output.  With -p the two files are memory
+//                  mapped and compared in parallel chunks, with the same
+//                  results as the line by line comparison.
 //
 //   Author : Eric Kilmer
 //   Last Modified : Oct 11 20:59:24 EST 2013
 //
 
 // Include files
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 // Project includes
 
@@ -24,13 +33,14 @@
 // Token which indicates a line to compare
 #define OUTPUT_TOK "[OUTPUT]"
 #define MAX_LINE_LEN 256
+#define MAX_THREADS 64
 
 // Output indicators for which line belongs to which file
 #define MASTER_IND  "MASTER  >>>>>"
 #define STUDENT_IND "STUDENT >>>>>"
 
 #define USAGE \
-  "\nUSAGE: [smsasim <workload> 2>&1 | ] verify <master-file> [<student-file>]\n" \
+  "\nUSAGE: [smsasim <workload> 2>&1 | ] verify [-p <threads>] <master-file> [<student-file>]\n" \
   "Verifies a student's resulting output with the master's output.\n" \
   "Either compare the real-time output of a student's program, or\n" \
   "compare the output files of the student's with the master's.\n" \
@@ -41,6 +51,8 @@
   "   <master-file> - The correct md5sum values generated by a known correct\n" \
   "                   implementation of smsasim.\n" \
   "   <stduent-file> - The student's output from their program.\n" \
+  "   -p <threads> - Map both files and compare them on <threads> threads\n" \
+  "                  (only when comparing two files).\n" \
   "\n"
 
 // Fancy color escapes code output
@@ -48,15 +60,47 @@
 #define ANSI_COLOR_GREEN   "\x1b[32m"
 #define ANSI_COLOR_RESET   "\x1b[0m"
 
+//
+// Type Definitions
+
+// A log mapped into memory and split the way fgets would read it
+typedef struct {
+  const char *data;   // The mapped file
+  size_t size;        // Bytes in the file
+  size_t *lines;      // Start offset of each fgets line
+  size_t count;       // Number of fgets lines
+  size_t reads;       // fgets calls made before feof() is true
+} MAPPED_LOG;
+
+// The work of one comparison thread
+typedef struct {
+  MAPPED_LOG *master, *student;
+  size_t first, last;   // Range of line pairs (or bytes when splitting)
+  size_t *found;        // Mismatched pairs / line offsets found
+  size_t nfound, cap;
+  int failed;           // Set if memory ran out
+} VERIFY_WORK;
+
 //
 // Global Data
 char line_master[MAX_LINE_LEN], line_student[MAX_LINE_LEN];
+int verify_threads = 0;
 
 
 //
 // Functional Prototypes
 int verify_line( char *master, char *student );
 int verify_files( FILE *master, FILE *student );
+int verify_mapped( const char *master_name, const char *student_name );
+int map_log( const char *name, MAPPED_LOG *log );
+void unmap_log( MAPPED_LOG *log );
+void * split_range( void *arg );
+void * compare_range( void *arg );
+int run_threads( VERIFY_WORK *work, int nwork, void *(*fn)( void * ) );
+int record_found( VERIFY_WORK *work, size_t value );
+const char * log_line( MAPPED_LOG *log, size_t pair, size_t *len );
+const char * find_output( const char *line, size_t len );
+int copy_output( MAPPED_LOG *log, size_t pair, char *buf );
 
 
 //
@@ -77,6 +121,21 @@ int main( int argc, char **argv ) {
   student = NULL;
 
   unsigned int mismatches;
+
+  // Parallel mode, only worth it (and only possible) for two files
+  if ( ( argc > 2 ) && ( strcmp( argv[1], "-p" ) == 0 ) ) {
+    verify_threads = atoi( argv[2] );
+    if ( ( verify_threads < 1 ) || ( verify_threads > MAX_THREADS ) ) {
+      fprintf( stderr, "Number of threads must be 1 to %d\n", MAX_THREADS );
+      return ( -1 );
+    }
+    argv[2] = argv[0];
+    argv += 2;
+    argc -= 2;
+    if ( ( argc == 3 ) && ( access( argv[1], R_OK ) == 0 ) && ( access( argv[2], R_OK ) == 0 ) ) {
+      return ( verify_mapped( argv[1], argv[2] ) ? -1 : 0 );
+    }
+  }
   
   // Two arguments means that we are comparing two files where the first input
   // is the master and the second one is the student's.
@@ -221,3 +280,387 @@ int verify_files( FILE *master, FILE *student ) {
 
   return ( mismatched );
 }
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : verify_mapped
+// Description  : Compare two log files the way verify_files does, but with
+//                both files mapped and the work spread over verify_threads
+//                threads.  The pairing of lines (including the stale line
+//                re-compared when one file ends first), the counts, the
+//                mismatch output and its order are the same.
+//
+// Inputs       : master_name - the master file.
+//                student_name - the student's file.
+// Outputs      : The number of mismatches (0 for success)
+
+int verify_mapped( const char *master_name, const char *student_name ) {
+  VERIFY_WORK work[MAX_THREADS];
+  MAPPED_LOG master, student;
+  size_t total, line, i;
+  unsigned int mismatched = 0;
+  int t;
+
+  if ( map_log( master_name, &master ) ) {
+    printf( "Error trying to open master file: [%s]\n", master_name );
+    return ( -1 );
+  }
+  if ( map_log( student_name, &student ) ) {
+    printf( "Error trying to open student file: [%s]\n", student_name );
+    unmap_log( &master );
+    return ( -1 );
+  }
+  printf( "Beginning diff check:\n\n" );
+
+  // The loop stops as soon as either file reports feof()
+  total = ( master.reads < student.reads ) ? master.reads : student.reads;
+
+  memset( work, 0x0, sizeof(work) );
+  for ( t = 0; t < verify_threads; t++ ) {
+    work[t].master = &master;
+    work[t].student = &student;
+    work[t].first = total * t / verify_threads;
+    work[t].last = total * ( t + 1 ) / verify_threads;
+  }
+  if ( run_threads( work, verify_threads, compare_range ) ) {
+    fprintf( stderr, "Unable to run the comparison threads\n" );
+    unmap_log( &master );
+    unmap_log( &student );
+    return ( -1 );
+  }
+
+  // Print the mismatches in line order, as the serial loop would; pairs
+  // missing a token count as mismatches but print nothing
+  for ( t = 0; t < verify_threads; t++ ) {
+    for ( i = 0; i < work[t].nfound; i++ ) {
+      line = work[t].found[i];
+      mismatched++;
+      if ( copy_output( &master, line, line_master ) &&
+           copy_output( &student, line, line_student ) ) {
+        printf( ANSI_COLOR_GREEN "%s %s" ANSI_COLOR_RESET, 
+            MASTER_IND, line_master );
+        printf( ANSI_COLOR_RED "%s %s\n" ANSI_COLOR_RESET, 
+            STUDENT_IND, line_student );
+      }
+    }
+    free( work[t].found );
+  }
+
+  printf( "Number correct / Total compared: %d/%d\n", (unsigned int)total-mismatched, (unsigned int)total );
+  if ( mismatched ) {
+    printf( ANSI_COLOR_RED      "Failed.\n"     ANSI_COLOR_RESET);
+  }
+  else {
+    printf( ANSI_COLOR_GREEN    "Success.\n"    ANSI_COLOR_RESET);
+  }
+
+  unmap_log( &master );
+  unmap_log( &student );
+  return ( mismatched );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : map_log
+// Description  : Map a log file and index it into the lines fgets would
+//                return with a MAX_LINE_LEN buffer.  The file is cut at line
+//                boundaries into one piece per thread and the pieces are
+//                indexed in parallel.
+//
+// Inputs       : name - the file to map
+//                log - the mapped log to fill in
+// Outputs      : 0 if successful, -1 if failure
+
+int map_log( const char *name, MAPPED_LOG *log ) {
+  VERIFY_WORK work[MAX_THREADS];
+  struct stat st;
+  const char *nl;
+  size_t cut, last;
+  int fd, t, ret = 0;
+
+  memset( log, 0x0, sizeof(MAPPED_LOG) );
+  if ( ( fd = open( name, O_RDONLY ) ) == -1 ) {
+    return ( -1 );
+  }
+  if ( fstat( fd, &st ) == -1 ) {
+    close( fd );
+    return ( -1 );
+  }
+  log->size = st.st_size;
+  if ( log->size > 0 ) {
+    log->data = mmap( NULL, log->size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    if ( log->data == MAP_FAILED ) {
+      log->data = NULL;
+      close( fd );
+      return ( -1 );
+    }
+    madvise( (void *)log->data, log->size, MADV_SEQUENTIAL );
+  }
+  close( fd );
+
+  // Cut the file just after a newline, so no fgets line spans two pieces
+  memset( work, 0x0, sizeof(work) );
+  cut = 0;
+  for ( t = 0; t < verify_threads; t++ ) {
+    work[t].master = log;
+    work[t].first = cut;
+    if ( t == verify_threads - 1 ) {
+      cut = log->size;
+    }
+    else if ( log->size * ( t + 1 ) / verify_threads > cut ) {
+      cut = log->size * ( t + 1 ) / verify_threads;
+      nl = memchr( log->data + cut, '\n', log->size - cut );
+      cut = ( nl == NULL ) ? log->size : (size_t)( nl - log->data ) + 1;
+    }
+    work[t].last = cut;
+  }
+  if ( run_threads( work, verify_threads, split_range ) ) {
+    ret = -1;
+  }
+
+  // Join the pieces into one index
+  for ( t = 0; ( t < verify_threads ) && !ret; t++ ) {
+    log->count += work[t].nfound;
+  }
+  if ( !ret && ( ( log->lines = malloc( ( log->count + 1 ) * sizeof(size_t) ) ) == NULL ) ) {
+    ret = -1;
+  }
+  log->count = 0;
+  for ( t = 0; t < verify_threads; t++ ) {
+    if ( !ret ) {
+      memcpy( &log->lines[log->count], work[t].found, work[t].nfound * sizeof(size_t) );
+      log->count += work[t].nfound;
+    }
+    free( work[t].found );
+  }
+  if ( ret ) {
+    unmap_log( log );
+    return ( -1 );
+  }
+
+  // fgets sets EOF when it reads up to the end of the file, which it does on
+  // a last line with no newline that fits in the buffer; otherwise the call
+  // after the last line does it
+  log->reads = log->count + 1;
+  if ( log->count > 0 ) {
+    last = log->size - log->lines[log->count - 1];
+    if ( ( log->data[log->size - 1] != '\n' ) && ( last < MAX_LINE_LEN - 1 ) ) {
+      log->reads = log->count;
+    }
+  }
+
+  return ( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : unmap_log
+// Description  : Release a mapped log
+//
+// Inputs       : log - the mapped log
+// Outputs      : none
+
+void unmap_log( MAPPED_LOG *log ) {
+  if ( log->data != NULL ) {
+    munmap( (void *)log->data, log->size );
+  }
+  free( log->lines );
+  memset( log, 0x0, sizeof(MAPPED_LOG) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : split_range
+// Description  : Thread body, record where each fgets line starts in a piece
+//                of the file
+//
+// Inputs       : arg - the VERIFY_WORK (first and last are byte offsets)
+// Outputs      : NULL
+
+void * split_range( void *arg ) {
+  VERIFY_WORK *work = arg;
+  const char *data = work->master->data, *nl;
+  size_t pos, len;
+
+  pos = work->first;
+  while ( pos < work->last ) {
+    if ( record_found( work, pos ) ) {
+      return( NULL );
+    }
+    len = work->last - pos;
+    if ( len > MAX_LINE_LEN - 1 ) {
+      len = MAX_LINE_LEN - 1;
+    }
+    nl = memchr( data + pos, '\n', len );
+    pos += ( nl == NULL ) ? len : (size_t)( nl - ( data + pos ) ) + 1;
+  }
+
+  return( NULL );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : compare_range
+// Description  : Thread body, compare a range of line pairs and record the
+//                ones that do not match
+//
+// Inputs       : arg - the VERIFY_WORK (first and last are pair numbers)
+// Outputs      : NULL
+
+void * compare_range( void *arg ) {
+  VERIFY_WORK *work = arg;
+  const char *master, *student, *master_out, *student_out;
+  size_t pair, master_len, student_len;
+
+  for ( pair = work->first; pair < work->last; pair++ ) {
+    master = log_line( work->master, pair, &master_len );
+    student = log_line( work->student, pair, &student_len );
+    master_out = find_output( master, master_len );
+    student_out = find_output( student, student_len );
+
+    // Same test as verify_line, on the text after the token
+    if ( ( master_out == NULL ) || ( student_out == NULL ) ||
+         ( master_len - ( master_out - master ) != student_len - ( student_out - student ) ) ||
+         memcmp( master_out, student_out, master_len - ( master_out - master ) ) ) {
+      if ( record_found( work, pair ) ) {
+        return( NULL );
+      }
+    }
+  }
+
+  return( NULL );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : run_threads
+// Description  : Run a thread body over each piece of work and wait for them
+//
+// Inputs       : work - the pieces of work
+//                nwork - the number of pieces
+//                fn - the thread body
+// Outputs      : 0 if successful, -1 if failure
+
+int run_threads( VERIFY_WORK *work, int nwork, void *(*fn)( void * ) ) {
+  pthread_t threads[MAX_THREADS];
+  int t, started, ret = 0;
+
+  // The first piece runs on this thread
+  for ( started = 1; started < nwork; started++ ) {
+    if ( pthread_create( &threads[started], NULL, fn, &work[started] ) ) {
+      break;
+    }
+  }
+  fn( &work[0] );
+  for ( t = 1; t < started; t++ ) {
+    pthread_join( threads[t], NULL );
+  }
+
+  // Anything that did not start runs here
+  for ( t = started; t < nwork; t++ ) {
+    fn( &work[t] );
+  }
+  for ( t = 0; t < nwork; t++ ) {
+    ret |= work[t].failed;
+  }
+
+  return ( ret ? -1 : 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : record_found
+// Description  : Append a value to the list a thread has found
+//
+// Inputs       : work - the thread's work
+//                value - the value to add
+// Outputs      : 0 if successful, -1 if out of memory
+
+int record_found( VERIFY_WORK *work, size_t value ) {
+  size_t *grown;
+
+  if ( work->nfound == work->cap ) {
+    work->cap = ( work->cap == 0 ) ? 1024 : work->cap * 2;
+    if ( ( grown = realloc( work->found, work->cap * sizeof(size_t) ) ) == NULL ) {
+      work->failed = 1;
+      return ( -1 );
+    }
+    work->found = grown;
+  }
+  work->found[work->nfound++] = value;
+
+  return ( 0 );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : log_line
+// Description  : Get the line in a buffer for a pair, the way the serial loop
+//                sees it: past the end of the file fgets fails and the buffer
+//                still holds the last line (or nothing if there was none).
+//                A NUL in the line ends it, as it would the string.
+//
+// Inputs       : log - the mapped log
+//                pair - the pair number
+//                len - set to the length of the line
+// Outputs      : the start of the line
+
+const char * log_line( MAPPED_LOG *log, size_t pair, size_t *len ) {
+  const char *line, *nul;
+  size_t end;
+
+  if ( log->count == 0 ) {
+    *len = 0;
+    return ( "" );
+  }
+  if ( pair >= log->count ) {
+    pair = log->count - 1;
+  }
+  line = log->data + log->lines[pair];
+  end = ( pair + 1 < log->count ) ? log->lines[pair + 1] : log->size;
+  *len = end - log->lines[pair];
+  if ( ( nul = memchr( line, '\0', *len ) ) != NULL ) {
+    *len = nul - line;
+  }
+
+  return ( line );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : find_output
+// Description  : Find the output token in a line that is not NUL terminated
+//
+// Inputs       : line - the line
+//                len - its length
+// Outputs      : the token in the line, or NULL if it is not there
+
+const char * find_output( const char *line, size_t len ) {
+  return ( memmem( line, len, OUTPUT_TOK, sizeof(OUTPUT_TOK) - 1 ) );
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// Function     : copy_output
+// Description  : Copy the text from the output token to the end of the line
+//                for a pair into a string buffer
+//
+// Inputs       : log - the mapped log
+//                pair - the pair number
+//                buf - a MAX_LINE_LEN buffer
+// Outputs      : 1 if the line has the token, 0 if not
+
+int copy_output( MAPPED_LOG *log, size_t pair, char *buf ) {
+  const char *line, *out;
+  size_t len;
+
+  line = log_line( log, pair, &len );
+  if ( ( out = find_output( line, len ) ) == NULL ) {
+    return ( 0 );
+  }
+  len -= out - line;
+  memcpy( buf, out, len );
+  buf[len] = '\0';
+
+  return ( 1 );
+}